@@ -0,0 +1,136 @@
+//
+//  bake.cpp - Headless clip baking
+//
+//  Bakes clips to world space joint transforms without opening a window:
+//  only the GL free core (skeleton and animation files, timeline, pose) is
+//  linked, and every frame is evaluated as fast as the pool's threads allow
+//  (see ClipBake.h for the output formats).  Meant for long batch runs and
+//  for regression tests that diff the CSV output against a known good one.
+//
+//    bake [-rate fps] [-format binary|csv] [-o path] model.txt clip.anim...
+//
+//  With one clip the result goes to -o, or to stdout when it is missing or
+//  "-".  With several, each clip.anim is written next to it as
+//  clip.anim.bake or clip.anim.csv.  A skeleton ending in .skel is read as
+//  binary.  Build it from the repository root, for example:
+//
+//    g++ -std=c++17 -O2 -mavx -Isrc -I<glm> bake/bake.cpp src/AnimationFile.cpp
+//      src/ClipBake.cpp src/MappedFile.cpp src/Pose.cpp src/QuatSimd.cpp
+//      src/SkeletonFile.cpp src/ThreadPool.cpp src/Timeline.cpp src/Trace.cpp
+//      -o bake -lpthread
+//
+
+#include "AnimationFile.h"
+#include "ClipBake.h"
+#include "SkeletonFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static void usage() {
+	fprintf(stderr, "usage: bake [-rate fps] [-format binary|csv] [-o path] model.txt clip.anim...\n");
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool bakeClip(const SkeletonFile &skeleton, const std::string &clipPath, const std::string &outPath,
+	BakeFormat format, float rate) {
+
+	AnimationFile clip;
+	if (!clip.loadText(clipPath)) {
+		fprintf(stderr, "%s: %s\n", clipPath.c_str(), clip.error.c_str());
+		return false;
+	}
+
+	ClipBake baker;
+	std::vector<std::string> unmatched;
+	baker.setup(skeleton, clip, &unmatched);
+	for (int i = 0; i < unmatched.size(); i++) {
+		fprintf(stderr, "%s: no joint %s in the skeleton, track skipped\n", clipPath.c_str(), unmatched[i].c_str());
+	}
+
+	bool bStdout = outPath.empty() || outPath == "-";
+	FILE *out = stdout;
+	if (bStdout) {
+#ifdef _WIN32
+		if (format == BakeBinary) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+	else out = fopen(outPath.c_str(), "wb");
+	if (!out) {
+		fprintf(stderr, "can't open %s\n", outPath.c_str());
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool bOk = baker.write(out, format, rate);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!bStdout) bOk = (fclose(out) == 0) && bOk;
+	if (!bOk) {
+		fprintf(stderr, "%s: write failed\n", bStdout ? "stdout" : outPath.c_str());
+		return false;
+	}
+
+	int nFrames = baker.frameCount(rate);
+	fprintf(stderr, "%s: %d frames x %d joints in %.3f s (%.0f frames/s)\n", clipPath.c_str(),
+		nFrames, baker.jointCount(), seconds, seconds > 0 ? nFrames / seconds : 0.0);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	float rate = 30;
+	BakeFormat format = BakeBinary;
+	std::string outPath;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool bValue = i + 1 < argc;
+		if (arg == "-rate" && bValue) rate = (float)atof(argv[++i]);
+		else if (arg == "-o" && bValue) outPath = argv[++i];
+		else if (arg == "-format" && bValue) {
+			std::string name = argv[++i];
+			if (name == "binary") format = BakeBinary;
+			else if (name == "csv") format = BakeCsv;
+			else {
+				usage();
+				return 2;
+			}
+		}
+		else if (arg.size() > 1 && arg[0] == '-') {
+			usage();
+			return 2;
+		}
+		else paths.push_back(arg);
+	}
+	if (paths.size() < 2 || !(rate > 0) || (paths.size() > 2 && !outPath.empty())) {
+		usage();
+		return 2;
+	}
+
+	SkeletonFile skeleton;
+	bool bLoaded = endsWith(paths[0], ".skel") ? skeleton.loadBinary(paths[0]) : skeleton.loadText(paths[0]);
+	if (!bLoaded) {
+		fprintf(stderr, "%s: %s\n", paths[0].c_str(), skeleton.error.c_str());
+		return 1;
+	}
+
+	int failed = 0;
+	for (int i = 1; i < paths.size(); i++) {
+		std::string path = outPath;
+		if (paths.size() > 2) path = paths[i] + (format == BakeCsv ? ".csv" : ".bake");
+		if (!bakeClip(skeleton, paths[i], path, format, rate)) failed++;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+//
+//  AnimationFile.cpp - Reading and writing keyed clips (model.anim)
+//
+
+#include "AnimationFile.h"
+#include "MappedFile.h"
+#include "TextParse.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace TextParse;
+
+static const char *channelNames[ChannelCount] = { "tx", "ty", "tz", "rx", "ry", "rz" };
+static const char *interpNames[] = { "linear", "ease", "step" };
+
+bool AnimationFile::loadText(const std::string &path) {
+	MappedFile file;
+	if (!file.open(path)) {
+		clear();
+		error = "can't open " + path;
+		return false;
+	}
+	return parseText(file.data(), file.size());
+}
+
+void AnimationFile::clear() {
+	timeline.clear();
+	trackJoints.clear();
+	error.clear();
+}
+
+int AnimationFile::addTrack(const std::string &joint, const AnimTrack &track) {
+	if (std::find(trackJoints.begin(), trackJoints.end(), joint) != trackJoints.end()) return -1;
+	trackJoints.push_back(joint);
+	timeline.tracks.push_back(track);
+	return timeline.size() - 1;
+}
+
+// track -joint NAME -rotation euler|quat;
+//
+static bool parseTrack(LineParser &lp, const char *&q, const char *eol, std::string &joint, bool &bQuat) {
+	const char *name = NULL;
+	while (true) {
+		q = skipSpace(q, eol);
+		if (q < eol && *q == ';') break;
+		if (matchWord(q, eol, "-joint")) {
+			q = skipSpace(q, eol);
+			name = q;
+			q = skipName(q, eol);
+			if (q == name) return lp.fail(q, "expected a joint name");
+			joint.assign(name, q - name);
+		}
+		else if (matchWord(q, eol, "-rotation")) {
+			q = skipSpace(q, eol);
+			if (matchWord(q, eol, "euler")) bQuat = false;
+			else if (matchWord(q, eol, "quat")) bQuat = true;
+			else return lp.fail(q, "expected 'euler' or 'quat'");
+		}
+		else return lp.fail(q, q == eol ? "expected ';'" : "unknown option");
+	}
+	if (!name) return lp.fail(q, "expected '-joint'");
+	return true;
+}
+
+// key -channel C -time T -value V -interp I;
+//
+static bool parseKey(LineParser &lp, const char *&q, const char *eol, AnimTrack &track) {
+	int channel = -1;
+	bool bRotate = false;
+	bool bTime = false;
+	const char *valueAt = NULL;
+	float time = 0, value = 0;
+	glm::quat orientation;
+	AnimInterp interp = InterpLinear;
+	while (true) {
+		q = skipSpace(q, eol);
+		if (q < eol && *q == ';') break;
+		if (matchWord(q, eol, "-channel")) {
+			q = skipSpace(q, eol);
+			const char *at = q;
+			channel = -1;
+			bRotate = matchWord(q, eol, "rotate");
+			for (int c = 0; c < ChannelCount && !bRotate && channel < 0; c++) {
+				if (matchWord(q, eol, channelNames[c])) channel = c;
+			}
+			if (!bRotate && channel < 0) return lp.fail(at, "unknown channel");
+			if (bRotate ? !track.bQuatRotation : channel >= ChannelRotX && track.bQuatRotation) {
+				return lp.fail(at, track.bQuatRotation ? "quaternion tracks key 'rotate'" : "euler tracks key rx, ry and rz");
+			}
+		}
+		else if (matchWord(q, eol, "-time")) {
+			if (!lp.number(q, eol, time)) return false;
+			bTime = true;
+		}
+		else if (matchWord(q, eol, "-value")) {
+			// either form is read here; whether it suits the channel is
+			// checked once the whole command is known
+			q = skipSpace(q, eol);
+			valueAt = q;
+			if (q < eol && *q == '<') {
+				if (!lp.quaternion(q, eol, orientation)) return false;
+			}
+			else if (!lp.number(q, eol, value)) return false;
+		}
+		else if (matchWord(q, eol, "-interp")) {
+			q = skipSpace(q, eol);
+			const char *at = q;
+			int k = 0;
+			while (k < 3 && !matchWord(q, eol, interpNames[k])) k++;
+			if (k == 3) return lp.fail(at, "expected 'linear', 'ease' or 'step'");
+			interp = (AnimInterp)k;
+		}
+		else return lp.fail(q, q == eol ? "expected ';'" : "unknown option");
+	}
+	if (!bRotate && channel < 0) return lp.fail(q, "expected '-channel'");
+	if (!bTime) return lp.fail(q, "expected '-time'");
+	if (!valueAt) return lp.fail(q, "expected '-value'");
+	if (bRotate != (*valueAt == '<')) return lp.fail(valueAt, bRotate ? "expected '<'" : "expected a number");
+
+	if (bRotate) track.quatChannel.setKey(time, orientation, interp);
+	else track.channels[channel].setKey(time, value, interp);
+	return true;
+}
+
+bool AnimationFile::parseText(const char *data, size_t size) {
+	clear();
+
+	const char *end = data + size;
+	const char *p = data;
+	int line = 0;
+	LineParser lp;
+	while (p < end && !lp.message) {
+		const char *eol = (const char *)memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+		line++;
+		lp.lineStart = p;
+
+		const char *q = skipSpace(p, eol);
+		p = eol + 1;
+		if (q == eol) continue;    // blank line
+
+		if (matchWord(q, eol, "track")) {
+			const char *at = q;
+			std::string joint;
+			AnimTrack track;
+			if (!parseTrack(lp, q, eol, joint, track.bQuatRotation)) break;
+			if (addTrack(joint, track) < 0) {
+				lp.fail(skipSpace(at, eol), "joint already has a track");
+				break;
+			}
+		}
+		else if (matchWord(q, eol, "key")) {
+			if (timeline.tracks.empty()) {
+				lp.fail(q, "key before the first track");
+				break;
+			}
+			if (!parseKey(lp, q, eol, timeline.tracks.back())) break;
+		}
+		else {
+			lp.fail(q, "expected 'track' or 'key'");
+			break;
+		}
+
+		q = skipSpace(q + 1, eol);
+		if (q != eol) {
+			lp.fail(q, "unexpected text after ';'");
+			break;
+		}
+	}
+
+	if (lp.message) {
+		error = lp.describe(line);
+		timeline.clear();
+		trackJoints.clear();
+		return false;
+	}
+	return true;
+}
+
+bool AnimationFile::saveText(const std::string &path) const {
+	std::string text;
+	for (int i = 0; i < timeline.size(); i++) {
+		const AnimTrack &track = timeline.tracks[i];
+		text += "track -joint " + trackJoints[i] + " -rotation " + (track.bQuatRotation ? "quat" : "euler") + ";\n";
+		for (int c = 0; c < ChannelCount; c++) {
+			if (track.bQuatRotation && c >= ChannelRotX) break;
+			const AnimCurve &curve = track.channels[c];
+			for (int k = 0; k < curve.keyCount(); k++) {
+				text += std::string("key -channel ") + channelNames[c] +
+					" -time " + formatFloat(curve.times[k]) +
+					" -value " + formatFloat(curve.values[k]) +
+					" -interp " + interpNames[curve.interps[k]] + ";\n";
+			}
+		}
+		if (track.bQuatRotation) {
+			const AnimQuatCurve &curve = track.quatChannel;
+			for (int k = 0; k < curve.keyCount(); k++) {
+				text += "key -channel rotate -time " + formatFloat(curve.times[k]) +
+					" -value " + formatQuat(curve.values[k]) +
+					" -interp " + interpNames[curve.interps[k]] + ";\n";
+			}
+		}
+	}
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+	bool bOk = fwrite(text.data(), 1, text.size(), f) == text.size();
+	return (fclose(f) == 0) && bOk;
+}
@@ -0,0 +1,45 @@
+//
+//  AnimationFile.h - Reading and writing keyed clips (model.anim)
+//
+//  A Timeline saved next to the skeleton it animates, in the same command
+//  style as model.txt.  A track names the joint it drives; the keys after
+//  it are its keys, one channel each:
+//
+//    track -joint joint1 -rotation euler;
+//    key -channel tx -time 0 -value 0.5 -interp ease;
+//    key -channel rz -time 1 -value 90 -interp linear;
+//    track -joint joint2 -rotation quat;
+//    key -channel rotate -time 0 -value <0, 0, 0, 1> -interp ease;
+//
+//  Channels are tx ty tz (position) and rx ry rz (euler degrees), or rotate
+//  for a quaternion track, written <x, y, z, w>.  Numbers round trip
+//  exactly (see TextParse.h), and errors are reported with their line and
+//  column like SkeletonFile's.  Only depends on glm.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Timeline.h"
+
+class AnimationFile {
+public:
+	bool loadText(const std::string &path);
+	bool parseText(const char *data, size_t size);
+	bool saveText(const std::string &path) const;
+
+	// add a track driving the named joint, returns its index in the
+	// timeline or -1 if the joint already has one
+	//
+	int addTrack(const std::string &joint, const AnimTrack &track);
+
+	void clear();
+
+	// tracks[i] of the timeline drives the joint named trackJoints[i]
+	//
+	Timeline timeline;
+	std::vector<std::string> trackJoints;
+
+	// "line L, column C: message" after a failed load or parse
+	std::string error;
+};
@@ -0,0 +1,594 @@
+//
+//  AppBenchmarks.cpp - Benchmarks of the app's hot paths
+//
+
+#include "AppBenchmarks.h"
+#include "Benchmark.h"
+#include "ofApp.h"
+#include "boxset.h"
+#include "ClipBlend.h"
+#include "ClipCompression.h"
+#include "Crowd.h"
+#include "MeshCache.h"
+#include "MeshLod.h"
+#include "ObjLoader.h"
+#include "RigGenerator.h"
+#include "SkeletonBatch.h"
+
+#include <filesystem>
+#include <random>
+
+// Joints of a skeleton linked up the way ofApp::loadFromFile() does it
+//
+struct JointRig {
+	vector<Joint> storage;
+	vector<Joint *> joints;
+
+	explicit JointRig(const SkeletonFile &file) {
+		storage.reserve(file.joints.size());
+		for (int i = 0; i < file.joints.size(); i++) {
+			const JointDesc &desc = file.joints[i];
+			storage.push_back(Joint(desc.translation, 0.2));
+			joints.push_back(&storage.back());
+			joints[i]->name = desc.name;
+			joints[i]->setRotation(desc.rotation);
+		}
+		for (int i = 0; i < file.joints.size(); i++) {
+			if (file.joints[i].parent >= 0) joints[file.joints[i].parent]->addChild(joints[i]);
+		}
+	}
+	JointRig(const JointRig &) = delete;
+	JointRig &operator=(const JointRig &) = delete;
+};
+
+static void benchMatrices(BenchmarkSuite &suite, bool bQuick) {
+	int depths[] = { 1, 8, 64, 512 };
+	for (int d : depths) {
+		if (!suite.wantsGroup("getMatrix")) return;
+		JointRig rig(generateRig(RigShape::chain(d)));
+		Joint *root = rig.joints.front();
+		Joint *leaf = rig.joints.back();
+		leaf->getMatrix();
+		suite.run("getMatrix/cached", { { "depth", d } }, 1, [&]() {
+			benchKeep(leaf->getMatrix()[3][0]);
+		});
+
+		// an edit at the root makes the leaf walk the whole chain
+		//
+		suite.run("getMatrix/rootEdited", { { "depth", d } }, 1, [&]() {
+			root->markDirty();
+			benchKeep(leaf->getMatrix()[3][0]);
+		});
+	}
+
+	// every joint of a bushy rig after the root moved, like a frame of the app
+	//
+	int sizes[] = { 1000, 10000, 100000 };
+	for (int n : sizes) {
+		if (bQuick && n > 10000) break;
+		if (!suite.wantsGroup("getMatrix/wholeRig")) return;
+		JointRig rig(generateRig(RigShape::tree(32, 3, n)));
+		suite.run("getMatrix/wholeRig", { { "joints", n } }, n, [&]() {
+			rig.joints.front()->markDirty();
+			float sum = 0;
+			for (int i = 0; i < rig.joints.size(); i++) sum += rig.joints[i]->getMatrix()[3][1];
+			benchKeep(sum);
+		});
+	}
+}
+
+// BoxSet against Box::intersect on the same boxes: the hit masks, one ray at a
+// time and as a packet, and the entry distances where Box reports one.  The
+// rays include ones with zero direction components, whose slabs go NaN
+//
+static bool checkBoxSet(const vector<Box> &boxes, const BoxSet &set, const vector<_Ray> &rays, float t0, float t1) {
+	int words = set.maskWords();
+	int nRays = rays.size();
+	vector<uint32_t> hits(words), packetHits(nRays * words);
+	vector<float> tEntry(set.size()), packetEntry(nRays * set.size());
+	set.intersect(rays.data(), nRays, t0, t1, packetHits.data(), packetEntry.data());
+
+	int mismatches = 0;
+	for (int j = 0; j < nRays; j++) {
+		set.intersect(rays[j], t0, t1, hits.data(), tEntry.data());
+		for (int i = 0; i < boxes.size(); i++) {
+			float tHit = 0;
+			bool bHit = boxes[i].intersect(rays[j], t0, t1, tHit);
+			bool bSetHit = (hits[i / 32] >> (i % 32)) & 1;
+			bool bPacketHit = (packetHits[j * words + i / 32] >> (i % 32)) & 1;
+			bool bSameEntry = !bHit || tEntry[i] <= t0 || tEntry[i] == tHit;
+			if (bSetHit != bHit || bPacketHit != bHit || !bSameEntry || packetEntry[j * set.size() + i] != tEntry[i]) mismatches++;
+		}
+	}
+	if (mismatches) cout << "BoxSet: " << mismatches << " of " << nRays * boxes.size() << " results differ from Box::intersect" << endl;
+	return mismatches == 0;
+}
+
+static bool benchIntersect(BenchmarkSuite &suite) {
+	const int nRays = 1024;
+
+	// rays from around the unit sphere towards points near the origin,
+	// about half of them hitting
+	//
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	vector<Ray> rays;
+	vector<_Ray> boxRays;
+	for (int i = 0; i < nRays; i++) {
+		glm::vec3 from = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0, 0, 0.01f)) * 10.0f;
+		glm::vec3 to = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.5f;
+		glm::vec3 d = glm::normalize(to - from);
+		rays.push_back(Ray(from, d));
+		boxRays.push_back(_Ray(Vector3(from.x, from.y, from.z), Vector3(d.x, d.y, d.z)));
+	}
+
+	Sphere sphere(glm::vec3(0.1, 0.2, 0), 1.5);
+	Cube cube(glm::vec3(0.1, 0.2, 0), glm::vec3(20, 35, 10), glm::vec3(1, 1.5, 0.75));
+	SceneObject *objects[] = { &sphere, &cube };
+	const char *names[] = { "Sphere::intersect", "Cube::intersect" };
+	for (int k = 0; k < 2; k++) {
+		SceneObject *obj = objects[k];
+		int hits = 0;
+		suite.run(names[k], { { "rays", nRays } }, nRays, [&]() {
+			glm::vec3 point, normal;
+			hits = 0;
+			for (int i = 0; i < nRays; i++) hits += obj->intersect(rays[i], point, normal);
+			benchKeep(hits);
+		});
+	}
+
+	Box box(Vector3(-1, -1.5, -0.75), Vector3(1, 1.5, 0.75));
+	suite.run("Box::intersect", { { "rays", nRays } }, nRays, [&]() {
+		int hits = 0;
+		for (int i = 0; i < nRays; i++) {
+			float t;
+			hits += box.intersect(boxRays[i], 0, 1000, t);
+		}
+		benchKeep(hits);
+	});
+
+	// a ray against many boxes, the way a picker or BVH leaf tests them
+	//
+	const int nBoxes = 1024;
+	const int nSetRays = 64;
+	vector<Box> boxes;
+	BoxSet set;
+	set.reserve(nBoxes);
+	for (int i = 0; i < nBoxes; i++) {
+		glm::vec3 c = glm::vec3(unit(rng), unit(rng), unit(rng)) * 3.0f;
+		glm::vec3 e = (glm::vec3(unit(rng), unit(rng), unit(rng)) + 1.5f) * 0.1f;
+		boxes.push_back(Box(Vector3(c.x - e.x, c.y - e.y, c.z - e.z), Vector3(c.x + e.x, c.y + e.y, c.z + e.z)));
+		set.add(boxes.back());
+	}
+	vector<_Ray> setRays(boxRays.begin(), boxRays.begin() + nSetRays);
+	vector<uint32_t> hitMasks(nSetRays * set.maskWords());
+	vector<float> tEntry(nSetRays * nBoxes);
+
+	BenchParams params = { { "rays", nSetRays }, { "boxes", nBoxes } };
+	suite.run("Box::intersect/boxes", params, nSetRays * nBoxes, [&]() {
+		int hits = 0;
+		for (int j = 0; j < nSetRays; j++) {
+			for (int i = 0; i < nBoxes; i++) {
+				float t;
+				hits += boxes[i].intersect(setRays[j], 0, 1000, t);
+			}
+		}
+		benchKeep(hits);
+	});
+	suite.run("BoxSet::intersect", params, nSetRays * nBoxes, [&]() {
+		int hits = 0;
+		for (int j = 0; j < nSetRays; j++) hits += set.intersect(setRays[j], 0, 1000, hitMasks.data(), tEntry.data());
+		benchKeep(hits);
+	});
+	suite.run("BoxSet::intersect/packet", params, nSetRays * nBoxes, [&]() {
+		benchKeep(set.intersect(setRays.data(), nSetRays, 0, 1000, hitMasks.data(), tEntry.data()));
+	});
+
+	for (int i = 0; i < nSetRays; i++) {
+		Vector3 d = setRays[i].direction;
+		if (i % 4 == 0) d = Vector3(0, d.y(), d.z());
+		if (i % 8 == 1) d = Vector3(d.x(), -0.0f, 0);
+		setRays.push_back(_Ray(setRays[i].origin, d));
+	}
+	setRays.push_back(_Ray(Vector3(0.1f, 0.1f, 0.1f), Vector3(1, 0, 0)));
+	return checkBoxSet(boxes, set, setRays, 0, 1000);
+}
+
+static void benchKeyframe(BenchmarkSuite &suite, bool bQuick) {
+	int sizes[] = { 10, 100, 1000, 10000, 100000 };
+	for (int n : sizes) {
+		if (bQuick && n > 10000) break;
+		if (!suite.wantsGroup("Keyframe")) return;
+		for (int quat = 0; quat < 2; quat++) {
+			JointRig rig(generateRig(RigShape::tree(32, 3, n)));
+			vector<SceneObject *> nodes(rig.joints.begin(), rig.joints.end());
+
+			// every joint keyed at the start and, turned a bit, at the end
+			//
+			Keyframe animation;
+			animation.bQuatRotation = quat != 0;
+			animation.setValues(nodes, Keyframe::startKeyTime);
+			for (int i = 0; i < nodes.size(); i++) {
+				nodes[i]->setRotation(nodes[i]->getRotation() + glm::vec3(10, 20, 30));
+			}
+			animation.setValues(nodes, Keyframe::endKeyTime);
+
+			BenchParams params = { { "nodes", n }, { "quat", quat } };
+			suite.run("Keyframe::setTheStage", params, 1, [&]() {
+				animation.setTheStage(false);
+			});
+			animation.setTheStage(false);
+			suite.run("Keyframe::playback", params, 1, [&]() {
+				if (!animation.playback()) animation.setTheStage(false);
+			});
+		}
+	}
+}
+
+// the draw buffers of a posed rig, what ofApp::drawSkeleton() builds each frame
+//
+static void benchSkeletonBatch(BenchmarkSuite &suite, bool bQuick) {
+	int sizes[] = { 1000, 10000, 100000 };
+	for (int n : sizes) {
+		if (bQuick && n > 10000) break;
+		if (!suite.wantsGroup("SkeletonBatch")) return;
+		SkeletonFile file = generateRig(RigShape::tree(32, 3, n));
+		PoseBuffer pose;
+		for (int i = 0; i < file.joints.size(); i++) {
+			pose.addJoint(file.joints[i].parent, file.joints[i].translation, file.joints[i].rotation);
+		}
+		pose.computeWorld();
+		vector<float> radii(n, 0.2f);
+		vector<glm::vec4> colors(n, glm::vec4(0, 0, 1, 1));
+
+		SkeletonBatch batch;
+		suite.run("SkeletonBatch::build", { { "joints", n } }, n, [&]() {
+			batch.build(n, pose.parents.data(), pose.world.data(), pose.translations.data(), radii.data(), colors.data());
+			benchKeep(batch.lineVertices.back().x);
+		});
+	}
+}
+
+// One frame of a crowd at 60 Hz: every instance samples a one second
+// quaternion clip and poses its rig.  Time is per instance, so 16.7 ms over
+// it is how many characters keep up with 60 Hz on this machine
+//
+// a track per rig joint, keyed at 30 fps for a second, swinging about the
+// rest pose around axis
+//
+static void swingClip(const PoseBuffer &rig, glm::vec3 axis, float amplitude, Timeline &clip) {
+	clip.clear();
+	for (int i = 0; i < rig.size(); i++) {
+		int t = clip.addTrack();
+		AnimTrack &track = clip.tracks[t];
+		track.bQuatRotation = true;
+		for (int a = 0; a < 3; a++) track.channels[ChannelPosX + a].setKey(0, rig.translations[i][a]);
+		for (int f = 0; f <= 30; f++) {
+			float angle = amplitude * std::sin(f * 0.2f + i);
+			track.quatChannel.setKey(f / 30.0f, rig.orientations[i] * glm::angleAxis(angle, axis));
+		}
+	}
+}
+
+static void benchCrowd(BenchmarkSuite &suite, bool bQuick) {
+	int rigSizes[] = { 32, 64 };
+	int counts[] = { 100, 1000, 10000 };
+	for (int joints : rigSizes) {
+		if (!suite.wantsGroup("Crowd") && !suite.wantsGroup("CompressedClip")) return;
+		Crowd crowd;
+		crowd.setRig(generateRig(RigShape::tree(8, 2, joints)));
+		Timeline clip;
+		swingClip(crowd.rig, glm::vec3(0, 0, 1), 0.3f, clip);
+		CompressedClip compressed;
+		suite.run("CompressedClip::compress", { { "tracks", clip.size() }, { "keys", 31 } }, 1, [&]() {
+			compressed.compress(clip, ClipCompressionSettings());
+		});
+		if (compressed.size() != clip.size()) compressed.compress(clip, ClipCompressionSettings());
+
+		// the same crowd playing the clip as it is and compressed
+		//
+		for (int n : counts) {
+			if (bQuick && n > 1000) break;
+			crowd.setClip(&clip);
+			crowd.clear();
+			for (int k = 0; k < n; k++) {
+				glm::mat4 root = glm::translate(glm::mat4(1.0), glm::vec3(k % 100, 0, k / 100));
+				crowd.addInstance(root, (k % 30) / 30.0f);
+			}
+			BenchParams params = { { "instances", n }, { "joints", crowd.jointCount() } };
+			suite.run("Crowd::update", params, n, [&]() {
+				crowd.update(1.0f / 60);
+				benchKeep(crowd.world(n - 1)[0][3][0]);
+			});
+			crowd.setClip(&compressed);
+			suite.run("Crowd::update/compressed", params, n, [&]() {
+				crowd.update(1.0f / 60);
+				benchKeep(crowd.world(n - 1)[0][3][0]);
+			});
+		}
+	}
+}
+
+// Largest difference between a clip and its compressed version, sampled
+// every 0.1 ms the way playback would see them
+//
+static void sampledClipError(const Timeline &clip, const CompressedClip &compressed, float &positionError, float &rotationError) {
+	vector<TrackSample> a, b;
+	vector<TrackCursor> cursors;
+	positionError = rotationError = 0;
+	int frames = (int)std::ceil((clip.endTime() - clip.startTime()) * 10000);
+	for (int f = 0; f <= frames; f++) {
+		float t = std::min(clip.startTime() + f * 1e-4f, clip.endTime());
+		clip.sample(t, a);
+		compressed.sample(t, b, cursors);
+		for (int i = 0; i < clip.size(); i++) {
+			bool bQuat = clip.tracks[i].bQuatRotation;
+			glm::quat qa = glm::normalize(bQuat ? a[i].orientation : eulerToQuat(a[i].rotation));
+			glm::quat qb = bQuat ? b[i].orientation : eulerToQuat(b[i].rotation);
+			if (glm::dot(qa, qb) < 0) qb = -qb;
+			float angle = glm::degrees(4.0f * std::atan2(glm::length(qa - qb), glm::length(qa + qb)));
+			positionError = std::max(positionError, glm::length(a[i].position - b[i].position));
+			rotationError = std::max(rotationError, angle);
+		}
+	}
+}
+
+// Compressed clips hold their tolerances between keys too, and report what
+// they hold: eased keys (what the app's '1' and '2' keys set) on one channel,
+// and seeded tracks mixing eased, linear and stepped keys
+//
+static bool checkClipCompression() {
+	vector<Timeline> clips(2);
+	clips[0].addTrack();
+	for (int i = 0; i <= 20; i++) clips[0].tracks[0].channels[ChannelPosX].setKey(0.1f * i, (float)i, InterpEase);
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int i = 0; i < 8; i++) {
+		AnimTrack &track = clips[1].tracks[clips[1].addTrack()];
+		track.bQuatRotation = i % 2;
+		glm::vec3 p(0), r(0);
+		float time = 0;
+		for (int k = 0; k < 30; k++) {
+			p += glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.05f;
+			r += glm::vec3(unit(rng), unit(rng), unit(rng)) * 4.0f;
+			track.setKey(time, p, r, (AnimInterp)(rng() % 3));
+			time += 0.05f + 0.04f * unit(rng);
+		}
+	}
+
+	ClipCompressionSettings settings;
+	bool bOk = true;
+	for (int c = 0; c < clips.size(); c++) {
+		CompressedClip compressed;
+		ClipCompressionReport report;
+		compressed.compress(clips[c], settings, &report);
+		float positionError, rotationError;
+		sampledClipError(clips[c], compressed, positionError, rotationError);
+		bool bHolds = positionError <= settings.positionTolerance && rotationError <= settings.rotationTolerance;
+		bool bReported = positionError <= report.maxPositionError() * 1.01f + 1e-6f && rotationError <= report.maxRotationError() * 1.01f + 1e-3f;
+		if (bHolds && bReported) continue;
+		cout << "CompressedClip: clip " << c << " is off by " << positionError << " and " << rotationError << " degrees between keys, reported "
+			<< report.maxPositionError() << " and " << report.maxRotationError() << endl;
+		bOk = false;
+	}
+	return bOk;
+}
+
+// A character playing two clips at once with a cross-fade between them and a
+// masked additive layer on top, one frame per call.  The frame's scratch
+// memory comes from the arena, which has to stop growing once it has seen a
+// frame: returns false if it still grows while being timed
+//
+static bool benchBlend(BenchmarkSuite &suite) {
+	int rigSizes[] = { 32, 256 };
+	bool bSteady = true;
+	for (int joints : rigSizes) {
+		if (!suite.wantsGroup("ClipBlender")) break;
+		// Crowd puts the file in parent first order for us
+		//
+		Crowd rigSource;
+		rigSource.setRig(generateRig(RigShape::tree(8, 2, joints)));
+		const PoseBuffer &rig = rigSource.rig;
+		PoseBuffer pose = rig;
+
+		Timeline walk, run, breathe;
+		swingClip(rig, glm::vec3(0, 0, 1), 0.3f, walk);
+		swingClip(rig, glm::vec3(1, 0, 0), 0.6f, run);
+		swingClip(rig, glm::vec3(0, 1, 0), 0.05f, breathe);
+		JointMask upperBody = JointMask::subtree(rig.parents, std::min(1, rig.size() - 1));
+
+		ClipBlender blender;
+		blender.addLayer(&walk);
+		blender.layers[blender.addLayer(&run)].weight = 0.5f;
+		int additive = blender.addLayer(&breathe, true);
+		blender.layers[additive].mask = &upperBody;
+
+		FrameArena arena(1024);
+		float time = 0;
+		auto frame = [&]() {
+			time = std::fmod(time + 1.0f / 60, 1.0f);
+			for (int l = 0; l < blender.layers.size(); l++) blender.layers[l].time = time;
+			arena.reset();
+			blender.evaluate(arena, rig, pose);
+			benchKeep(pose.orientations[rig.size() - 1].x);
+		};
+		frame();
+		frame();
+		size_t warmCapacity = arena.capacity();
+		if (!suite.run("ClipBlender::evaluate", { { "joints", rig.size() }, { "layers", 3 } }, 1, frame)) continue;
+		if (arena.capacity() != warmCapacity) {
+			cout << "ClipBlender: frame arena grew from " << warmCapacity << " to " << arena.capacity() << " bytes after warm-up" << endl;
+			bSteady = false;
+		}
+	}
+	return bSteady;
+}
+
+// skeletons written to and read back from a scratch folder
+//
+static void benchFiles(BenchmarkSuite &suite, bool bQuick) {
+	if (!suite.wantsGroup("skeleton")) return;
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "skeleton-bench";
+	std::filesystem::create_directories(dir, ec);
+	if (ec) {
+		cout << "can't create " << dir.string() << ", file benchmarks skipped" << endl;
+		return;
+	}
+	string textPath = (dir / "model.txt").string();
+	string binaryPath = (dir / "model.skel").string();
+
+	int sizes[] = { 1000, 10000, 100000 };
+	for (int n : sizes) {
+		if (bQuick && n > 10000) break;
+		SkeletonFile rigFile = generateRig(RigShape::tree(16, 4, n));
+		BenchParams params = { { "joints", n } };
+
+		// saveToFile(): the joints into a SkeletonFile, then both forms
+		//
+		JointRig rig(rigFile);
+		suite.run("skeleton/save", params, n, [&]() {
+			SkeletonFile file;
+			unordered_map<SceneObject *, int> jointIndex;
+			for (int i = 0; i < rig.joints.size(); i++) jointIndex[rig.joints[i]] = i;
+			for (int i = 0; i < rig.joints.size(); i++) {
+				JointDesc desc;
+				desc.name = rig.joints[i]->name;
+				desc.rotation = rig.joints[i]->getRotation();
+				desc.translation = rig.joints[i]->position;
+				desc.parent = rig.joints[i]->parent ? jointIndex[rig.joints[i]->parent] : -1;
+				file.addJoint(desc);
+			}
+			benchKeep(file.saveText(textPath) && file.saveBinary(binaryPath));
+		});
+		suite.run("skeleton/saveText", params, n, [&]() {
+			benchKeep(rigFile.saveText(textPath));
+		});
+		suite.run("skeleton/loadText", params, n, [&]() {
+			SkeletonFile file;
+			benchKeep(file.loadText(textPath));
+		});
+		suite.run("skeleton/loadBinary", params, n, [&]() {
+			SkeletonFile file;
+			benchKeep(file.loadBinary(binaryPath));
+		});
+
+		// loadFromFile() past the parse: the joints and their links
+		//
+		suite.run("skeleton/buildJoints", params, n, [&]() {
+			JointRig loaded(rigFile);
+			benchKeep((double)loaded.joints.size());
+		});
+
+		// the same into the app's joint pool, cleared first like a reload:
+		// after the first call every joint reuses its slot
+		//
+		ObjectPool<Joint> pool;
+		vector<Joint *> pooled(rigFile.joints.size());
+		suite.run("skeleton/buildJointsPooled", params, n, [&]() {
+			pool.clear();
+			for (int i = 0; i < pooled.size(); i++) {
+				const JointDesc &desc = rigFile.joints[i];
+				pooled[i] = pool.get(pool.create(desc.translation, 0.2f));
+				pooled[i]->name = desc.name;
+				pooled[i]->setRotation(desc.rotation);
+			}
+			for (int i = 0; i < pooled.size(); i++) {
+				if (rigFile.joints[i].parent >= 0) pooled[rigFile.joints[i].parent]->addChild(pooled[i]);
+			}
+			benchKeep((double)pool.size());
+		});
+	}
+	std::filesystem::remove_all(dir, ec);
+}
+
+// on a copy of the model in a scratch folder, so the caches written next to
+// it don't replace the app's own
+//
+static void benchObj(BenchmarkSuite &suite) {
+	if (!suite.wantsGroup("obj") && !suite.wantsGroup("MeshLod")) return;
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "obj-bench";
+	std::filesystem::create_directories(dir, ec);
+	string path = (dir / "engineerfriend.obj").string();
+	if (!ec) std::filesystem::copy_file(ofToDataPath("engineerfriend.obj"), path, std::filesystem::copy_options::overwrite_existing, ec);
+	if (ec) {
+		cout << "can't copy engineerfriend.obj to " << dir.string() << ", OBJ benchmarks skipped" << endl;
+		return;
+	}
+	string cachePath = MeshCache::cachePath(path);
+	MeshData mesh;
+	ObjLoader loader;
+	if (!loader.load(path, mesh)) {
+		cout << path << ": " << loader.error << ", OBJ benchmarks skipped" << endl;
+		return;
+	}
+	BenchParams params = { { "vertices", mesh.vertexCount() }, { "triangles", mesh.indices.size() / 3 } };
+	suite.run("obj/load", params, 1, [&]() {
+		MeshData m;
+		benchKeep(loader.load(path, m));
+	});
+	suite.run("MeshLod::build", params, 1, [&]() {
+		MeshLod lod;
+		lod.build(mesh, NULL);
+		benchKeep(lod.size());
+	});
+
+	// Model::loadSource() as the app calls it: a first load parses, builds
+	// the levels and the picking BVH and writes the cache, a later one maps it
+	//
+	suite.run("obj/loadSource", params, 1, [&]() {
+		remove(cachePath.c_str());
+		benchKeep(Model::loadSource(path).isValid());
+	});
+	if (Model::loadSource(path).cache) {
+		suite.run("obj/loadSourceCached", params, 1, [&]() {
+			benchKeep(Model::loadSource(path).isValid());
+		});
+	}
+	std::filesystem::remove_all(dir, ec);
+}
+
+bool wantsBenchmarks(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--bench") return true;
+	}
+	return false;
+}
+
+int runBenchmarks(int argc, char *argv[]) {
+	BenchmarkSuite suite;
+	string outPath = ofToDataPath("bench.json");
+	string label;
+	bool bQuick = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool bValue = i + 1 < argc && argv[i + 1][0] != '-';
+		if (arg == "--bench" && bValue) outPath = argv[++i];
+		else if (arg == "--bench-filter" && bValue) suite.filter = argv[++i];
+		else if (arg == "--bench-label" && bValue) label = argv[++i];
+		else if (arg == "--bench-quick") bQuick = true;
+	}
+	if (bQuick) {
+		suite.samples = 5;
+		suite.minSampleSeconds = 0.01;
+	}
+
+	benchMatrices(suite, bQuick);
+	bool bChecked = benchIntersect(suite);
+	benchKeyframe(suite, bQuick);
+	benchSkeletonBatch(suite, bQuick);
+	benchCrowd(suite, bQuick);
+	bChecked = benchBlend(suite) && bChecked;
+	bChecked = checkClipCompression() && bChecked;
+	benchFiles(suite, bQuick);
+	benchObj(suite);
+
+	if (!suite.writeJson(outPath, label)) {
+		cout << "Could not write " << outPath << endl;
+		return 1;
+	}
+	cout << suite.results.size() << " results written to " << outPath << endl;
+	return bChecked ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+//
+//  AppBenchmarks.h - Benchmarks of the app's hot paths
+//
+//  Run the app with --bench to time the core paths without opening a
+//  window: world matrices of joint chains of growing depth, ray tests of
+//  the pickable primitives, of the Box kernel and of BoxSet over 1024
+//  boxes (checked against Box::intersect first), Keyframe playback of
+//  10 to 100k animated joints, the draw buffers of 1k to 100k joints
+//  (SkeletonBatch), a Crowd of 100 to 10k characters playing a clip as
+//  is and compressed by CompressedClip (whose error is checked against
+//  the clip sampled every 0.1 ms), a ClipBlender frame of two
+//  cross-faded clips and an additive layer (checked not to grow its
+//  FrameArena after warm-up), reading and writing skeleton files of 1k to
+//  100k joints built by RigGenerator (the work of loadFromFile() and
+//  saveToFile()), and loading data/engineerfriend.obj and building its
+//  levels of detail.
+//
+//    app --bench [results.json] [--bench-filter text] [--bench-label name] [--bench-quick]
+//
+//  Results go to the console and to results.json (bench.json in the data
+//  folder by default, see Benchmark.h for what it holds).  --bench-quick
+//  stops at 10k joints and takes fewer samples.  The exit code is 1 if a
+//  check fails.
+//
+#pragma once
+
+// true if the command line asks for the benchmarks
+//
+bool wantsBenchmarks(int argc, char *argv[]);
+
+// run them, returns the exit code of the process
+//
+int runBenchmarks(int argc, char *argv[]);
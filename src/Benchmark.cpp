@@ -0,0 +1,141 @@
+//
+//  Benchmark.cpp - Timing harness with machine readable results
+//
+
+#include "Benchmark.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+static volatile double benchSink;
+
+void benchKeep(double v) {
+	benchSink = benchSink + v;
+}
+
+bool BenchmarkSuite::wants(const std::string &name) const {
+	return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+bool BenchmarkSuite::wantsGroup(const std::string &group) const {
+	return wants(group) || filter.find(group) == 0;
+}
+
+static double secondsOf(const std::function<void()> &fn, int64_t calls) {
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t i = 0; i < calls; i++) fn();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+const BenchResult *BenchmarkSuite::run(const std::string &name, const BenchParams &params, int64_t opsPerCall,
+	const std::function<void()> &fn) {
+
+	if (!wants(name)) return NULL;
+
+	// the warm up call doubles as the first guess of the cost
+	//
+	int64_t calls = 1;
+	double seconds = secondsOf(fn, calls);
+	while (seconds < minSampleSeconds) {
+		double scale = seconds > 0 ? std::min(minSampleSeconds * 1.2 / seconds, 100.0) : 100.0;
+		calls = std::max(calls + 1, (int64_t)(calls * scale));
+		seconds = secondsOf(fn, calls);
+	}
+
+	std::vector<double> times(samples);
+	for (int s = 0; s < samples; s++) times[s] = secondsOf(fn, calls) * 1e9 / ((double)calls * opsPerCall);
+	std::sort(times.begin(), times.end());
+
+	BenchResult r;
+	r.name = name;
+	r.params = params;
+	r.opsPerCall = opsPerCall;
+	r.calls = calls;
+	r.samples = samples;
+	r.minNs = times.front();
+	r.medianNs = times[samples / 2];
+	r.meanNs = 0;
+	for (int s = 0; s < samples; s++) r.meanNs += times[s] / samples;
+	results.push_back(r);
+
+	std::string shown = name;
+	for (int i = 0; i < params.size(); i++) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), " %s=%g", params[i].first.c_str(), params[i].second);
+		shown += buf;
+	}
+	printf("%-56s %12.1f ns/op  (min %.1f)\n", shown.c_str(), r.medianNs, r.minNs);
+	fflush(stdout);
+	return &results.back();
+}
+
+static std::string jsonString(const std::string &s) {
+	std::string out = "\"";
+	for (int i = 0; i < s.size(); i++) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += (char)c;
+		}
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else out += (char)c;
+	}
+	return out + "\"";
+}
+
+static std::string jsonNumber(double v) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.17g", v);
+	return buf;
+}
+
+bool BenchmarkSuite::writeJson(const std::string &path, const std::string &label) const {
+#if defined(__AVX__)
+	const char *simd = "avx";
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	const char *simd = "sse2";
+#else
+	const char *simd = "scalar";
+#endif
+#ifdef NDEBUG
+	const char *build = "release";
+#else
+	const char *build = "debug";
+#endif
+
+	std::string text = "{\n";
+	text += "  \"format\": 1,\n";
+	text += "  \"label\": " + jsonString(label) + ",\n";
+	text += "  \"time\": " + jsonNumber((double)time(NULL)) + ",\n";
+	text += "  \"build\": " + jsonString(build) + ",\n";
+	text += "  \"simd\": " + jsonString(simd) + ",\n";
+	text += "  \"threads\": " + std::to_string(hardwareThreads()) + ",\n";
+	text += "  \"results\": [";
+	for (int i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		text += i ? ",\n    {" : "\n    {";
+		text += "\"name\": " + jsonString(r.name) + ", \"params\": {";
+		for (int k = 0; k < r.params.size(); k++) {
+			text += (k ? ", " : "") + jsonString(r.params[k].first) + ": " + jsonNumber(r.params[k].second);
+		}
+		text += "}, \"ops_per_call\": " + std::to_string(r.opsPerCall);
+		text += ", \"calls\": " + std::to_string(r.calls);
+		text += ", \"samples\": " + std::to_string(r.samples);
+		text += ", \"min_ns\": " + jsonNumber(r.minNs);
+		text += ", \"median_ns\": " + jsonNumber(r.medianNs);
+		text += ", \"mean_ns\": " + jsonNumber(r.meanNs) + "}";
+	}
+	text += "\n  ]\n}\n";
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+	bool bOk = fwrite(text.data(), 1, text.size(), f) == text.size();
+	return (fclose(f) == 0) && bOk;
+}
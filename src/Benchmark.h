@@ -0,0 +1,66 @@
+//
+//  Benchmark.h - Timing harness with machine readable results
+//
+//  A case is a function doing a known number of operations.  It is run
+//  once to warm up, then calibrated to a repeat count that makes one
+//  sample at least minSampleSeconds long, then timed over several samples;
+//  the minimum, median and mean time per operation are kept.  The median is
+//  the number to compare, the minimum shows how noisy the machine was.
+//
+//  Results are written as JSON together with what they depend on (SIMD
+//  level, thread count, build type), so runs of two versions on the same
+//  machine can be compared by a script.  Only depends on the standard
+//  library.
+//
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, double>> BenchParams;
+
+struct BenchResult {
+	std::string name;
+	BenchParams params;
+	int64_t opsPerCall = 1;
+	int64_t calls = 0;          // per sample
+	int samples = 0;
+	double minNs = 0;           // per operation
+	double medianNs = 0;
+	double meanNs = 0;
+};
+
+class BenchmarkSuite {
+public:
+	double minSampleSeconds = 0.02;
+	int samples = 9;
+
+	// only cases whose name contains filter are run
+	//
+	std::string filter;
+
+	bool wants(const std::string &name) const;
+
+	// whether any case named group... may be run, to skip costly setup
+	//
+	bool wantsGroup(const std::string &group) const;
+
+	// time fn, which does opsPerCall operations per call.  Returns NULL if
+	// the case is filtered out
+	//
+	const BenchResult *run(const std::string &name, const BenchParams &params, int64_t opsPerCall,
+		const std::function<void()> &fn);
+
+	// label names the build or version being measured
+	//
+	bool writeJson(const std::string &path, const std::string &label) const;
+
+	std::vector<BenchResult> results;
+};
+
+// keeps a result alive so the work producing it isn't optimized away
+//
+void benchKeep(double v);
@@ -0,0 +1,394 @@
+//
+//  Bvh.cpp - Bounding volume hierarchy over axis aligned boxes
+//
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include "Bvh.h"
+#include "Parallel.h"
+
+void Bvh::clear() {
+	nodes.clear();
+	items.clear();
+	parentOf.clear();
+	leafOf.clear();
+	itemMin.clear();
+	itemMax.clear();
+}
+
+void Bvh::build(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs, int leafSize) {
+	clear();
+	int n = (int)mins.size();
+	if (n == 0) return;
+
+	itemMin = mins;
+	itemMax = maxs;
+	items.resize(n);
+	leafOf.resize(n);
+	std::vector<glm::vec3> centers(n);
+	for (int i = 0; i < n; i++) {
+		items[i] = i;
+		centers[i] = (mins[i] + maxs[i]) * 0.5f;
+	}
+
+	nodes.reserve(2 * n);
+	parentOf.reserve(2 * n);
+	nodes.push_back(BvhNode());
+	parentOf.push_back(-1);
+	buildNode(0, 0, n, 1, std::max(leafSize, 1), centers);
+}
+
+// Split the items in [first, first + count) at the median centroid along
+// the longest axis of the centroid bounds.
+//
+void Bvh::buildNode(int node, int first, int count, int depth, int leafSize, std::vector<glm::vec3> &centers) {
+	glm::vec3 cMin = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 cMax = -cMin;
+	for (int k = first; k < first + count; k++) {
+		cMin = glm::min(cMin, centers[items[k]]);
+		cMax = glm::max(cMax, centers[items[k]]);
+	}
+
+	glm::vec3 extent = cMax - cMin;
+	bool degenerate = (extent.x <= 0 && extent.y <= 0 && extent.z <= 0);
+	if (count <= leafSize || degenerate || depth >= maxDepth - 1) {
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	int half = count / 2;
+	std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+		[&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+	int left = (int)nodes.size();
+	nodes.push_back(BvhNode());
+	nodes.push_back(BvhNode());
+	parentOf.push_back(node);
+	parentOf.push_back(node);
+	nodes[node].leftOrFirst = left;
+	nodes[node].count = 0;
+
+	buildNode(left, first, half, depth + 1, leafSize, centers);
+	buildNode(left + 1, first + half, count - half, depth + 1, leafSize, centers);
+	updateBounds(node);
+}
+
+void Bvh::makeLeaf(int node, int first, int count) {
+	nodes[node].leftOrFirst = first;
+	nodes[node].count = count;
+	for (int k = first; k < first + count; k++) leafOf[items[k]] = node;
+	updateBounds(node);
+}
+
+// ---------------------------------------------------------------------------
+//  SAH build
+//
+
+static const int sahBins = 16;
+
+// subtrees with more items than this are built on another thread, nodes with
+// more items than this are binned in parallel
+//
+static const int sahParallelItems = 1 << 15;
+
+static float surfaceArea(const glm::vec3 &min, const glm::vec3 &max) {
+	glm::vec3 e = max - min;
+	if (e.x < 0 || e.y < 0 || e.z < 0) return 0;
+	return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+// per axis bins of one node.  only the counts are cleared up front; the
+// bounds of a bin are written by the first item that lands in it
+//
+struct SahBins {
+	SahBins() {
+		for (int a = 0; a < 3; a++) {
+			for (int b = 0; b < sahBins; b++) binCount[a][b] = 0;
+		}
+	}
+	void add(int a, int b, const glm::vec3 &min, const glm::vec3 &max) {
+		if (binCount[a][b]++ == 0) {
+			binMin[a][b] = min;
+			binMax[a][b] = max;
+		}
+		else {
+			binMin[a][b] = glm::min(binMin[a][b], min);
+			binMax[a][b] = glm::max(binMax[a][b], max);
+		}
+	}
+	void merge(const SahBins &o) {
+		for (int a = 0; a < 3; a++) {
+			for (int b = 0; b < sahBins; b++) {
+				if (o.binCount[a][b] == 0) continue;
+				if (binCount[a][b] == 0) {
+					binMin[a][b] = o.binMin[a][b];
+					binMax[a][b] = o.binMax[a][b];
+				}
+				else {
+					binMin[a][b] = glm::min(binMin[a][b], o.binMin[a][b]);
+					binMax[a][b] = glm::max(binMax[a][b], o.binMax[a][b]);
+				}
+				binCount[a][b] += o.binCount[a][b];
+			}
+		}
+	}
+	glm::vec3 binMin[3][sahBins], binMax[3][sahBins];
+	int binCount[3][sahBins];
+};
+
+static inline int sahBin(float c, float lo, float scale) {
+	int b = (int)((c - lo) * scale);
+	return (b < 0 ? 0 : (b >= sahBins ? sahBins - 1 : b));
+}
+
+// Item bounds are copied into a contiguous array that is partitioned in
+// place, so every pass over a node reads memory sequentially instead of
+// gathering through the item indices.
+//
+struct SahRef {
+	glm::vec3 min;
+	int item;
+	glm::vec3 max;
+	float pad;
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+};
+
+void Bvh::buildSAH(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs, int leafSize) {
+	clear();
+	int n = (int)mins.size();
+	if (n == 0) return;
+
+	itemMin = mins;
+	itemMax = maxs;
+	items.resize(n);
+	leafOf.resize(n);
+	std::vector<SahRef> refs(n);
+	parallelFor(0, n, 1 << 14, [&](int b, int e) {
+		for (int i = b; i < e; i++) {
+			refs[i].min = mins[i];
+			refs[i].max = maxs[i];
+			refs[i].item = i;
+		}
+	});
+
+	// a binary tree over n leaves never has more than 2n - 1 nodes, so the
+	// array can be sized up front and handed out with an atomic counter
+	//
+	nodes.resize(2 * n - 1);
+	parentOf.resize(2 * n - 1);
+	parentOf[0] = -1;
+	std::atomic<int> nodeCount(1);
+	buildNodeSAH(0, 0, n, 1, std::max(leafSize, 1), refs.data(), nodeCount);
+	nodes.resize(nodeCount);
+	parentOf.resize(nodeCount);
+}
+
+void Bvh::buildNodeSAH(int node, int first, int count, int depth, int leafSize,
+	SahRef *refs, std::atomic<int> &nodeCount) {
+
+	SahRef *begin = refs + first;
+	if (count <= 1 || depth >= maxDepth - 1) {
+		for (int k = 0; k < count; k++) items[first + k] = begin[k].item;
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	// node and centroid bounds
+	//
+	glm::vec3 big = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 nMin = big, nMax = -big, cMin = big, cMax = -big;
+	for (int k = 0; k < count; k++) {
+		nMin = glm::min(nMin, begin[k].min);
+		nMax = glm::max(nMax, begin[k].max);
+		glm::vec3 c = begin[k].center();
+		cMin = glm::min(cMin, c);
+		cMax = glm::max(cMax, c);
+	}
+
+	// bin the centroids along all three axes at once
+	//
+	glm::vec3 extent = cMax - cMin;
+	glm::vec3 scale;
+	for (int a = 0; a < 3; a++) scale[a] = (extent[a] > 0 ? sahBins / extent[a] : 0);
+
+	auto binRange = [&](SahBins &out, int b, int e) {
+		for (int k = b; k < e; k++) {
+			const SahRef &r = begin[k];
+			glm::vec3 c = r.center();
+			for (int a = 0; a < 3; a++) out.add(a, sahBin(c[a], cMin[a], scale[a]), r.min, r.max);
+		}
+	};
+
+	SahBins bins;
+	if (count <= sahParallelItems) binRange(bins, 0, count);
+	else {
+		std::mutex binsMutex;
+		parallelFor(0, count, sahParallelItems, [&](int b, int e) {
+			SahBins local;
+			binRange(local, b, e);
+			std::lock_guard<std::mutex> lock(binsMutex);
+			bins.merge(local);
+		});
+	}
+
+	// sweep the split planes between the bins; cost is relative to
+	// intersecting every item of the node (traversal and intersection cost 1)
+	//
+	float nodeArea = std::max(surfaceArea(nMin, nMax), 1e-20f);
+	float leafCost = (float)count;
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1, bestPlane = 0;
+	for (int a = 0; a < 3; a++) {
+		if (extent[a] <= 0) continue;
+
+		float rightArea[sahBins];
+		int rightCount[sahBins];
+		glm::vec3 rMin = big, rMax = -big;
+		int rN = 0;
+		for (int b = sahBins - 1; b > 0; b--) {
+			if (bins.binCount[a][b] > 0) {
+				rMin = glm::min(rMin, bins.binMin[a][b]);
+				rMax = glm::max(rMax, bins.binMax[a][b]);
+				rN += bins.binCount[a][b];
+			}
+			rightArea[b] = surfaceArea(rMin, rMax);
+			rightCount[b] = rN;
+		}
+
+		glm::vec3 lMin = big, lMax = -big;
+		int lN = 0;
+		for (int b = 1; b < sahBins; b++) {
+			if (bins.binCount[a][b - 1] > 0) {
+				lMin = glm::min(lMin, bins.binMin[a][b - 1]);
+				lMax = glm::max(lMax, bins.binMax[a][b - 1]);
+				lN += bins.binCount[a][b - 1];
+			}
+			if (lN == 0 || rightCount[b] == 0) continue;
+			float cost = 1.0f + (surfaceArea(lMin, lMax) * lN + rightArea[b] * rightCount[b]) / nodeArea;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = a;
+				bestPlane = b;
+			}
+		}
+	}
+
+	// all centroids in one spot (nothing to split on), or small enough that
+	// a leaf is cheaper
+	//
+	if (bestAxis < 0 || (count <= leafSize && bestCost >= leafCost)) {
+		for (int k = 0; k < count; k++) items[first + k] = begin[k].item;
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	SahRef *mid = std::partition(begin, begin + count, [&](const SahRef &r) {
+		return sahBin(r.center()[bestAxis], cMin[bestAxis], scale[bestAxis]) < bestPlane;
+	});
+	int leftCount = (int)(mid - begin);
+
+	int left = nodeCount.fetch_add(2);
+	parentOf[left] = node;
+	parentOf[left + 1] = node;
+	nodes[node].leftOrFirst = left;
+	nodes[node].count = 0;
+
+	auto buildLeft = [&] { buildNodeSAH(left, first, leftCount, depth + 1, leafSize, refs, nodeCount); };
+	auto buildRight = [&] { buildNodeSAH(left + 1, first + leftCount, count - leftCount, depth + 1, leafSize, refs, nodeCount); };
+	if (count > sahParallelItems) parallelInvoke(buildLeft, buildRight);
+	else {
+		buildLeft();
+		buildRight();
+	}
+	updateBounds(node);
+}
+
+// Links are checked so a damaged file can't send traversal out of bounds;
+// parentOf and leafOf aren't stored and are rebuilt here.
+//
+bool Bvh::assign(const BvhNode *treeNodes, int nodeCount, const int *treeItems,
+	const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs) {
+
+	clear();
+	int n = (int)mins.size();
+	if (n == 0 || nodeCount <= 0 || nodeCount > 2 * n - 1) return n == 0 && nodeCount == 0;
+
+	nodes.assign(treeNodes, treeNodes + nodeCount);
+	items.assign(treeItems, treeItems + n);
+	itemMin = mins;
+	itemMax = maxs;
+	parentOf.assign(nodeCount, -1);
+	leafOf.assign(n, -1);
+	std::vector<int> depth(nodeCount, 1);
+
+	bool bValid = true;
+	for (int i = 0; i < nodeCount && bValid; i++) {
+		const BvhNode &node = nodes[i];
+		if (node.count > 0) {
+			bValid = node.leftOrFirst >= 0 && node.count <= n - node.leftOrFirst;
+			for (int k = node.leftOrFirst; bValid && k < node.leftOrFirst + node.count; k++) {
+				bValid = items[k] >= 0 && items[k] < n && leafOf[items[k]] < 0;
+				if (bValid) leafOf[items[k]] = i;
+			}
+		}
+		else {
+			// children come after their parent and have only one, so this
+			// is a tree, and it has to fit the traversal stack
+			int l = node.leftOrFirst;
+			bValid = l > i && l + 1 < nodeCount && parentOf[l] < 0 && parentOf[l + 1] < 0 && depth[i] < maxDepth;
+			if (bValid) {
+				parentOf[l] = parentOf[l + 1] = i;
+				depth[l] = depth[l + 1] = depth[i] + 1;
+			}
+		}
+	}
+	for (int i = 0; i < n && bValid; i++) bValid = leafOf[i] >= 0;
+	if (!bValid) clear();
+	return bValid;
+}
+
+// recompute the bounds of a node from its items or its children
+//
+void Bvh::updateBounds(int node) {
+	BvhNode &n = nodes[node];
+	if (n.count > 0) {
+		n.min = itemMin[items[n.leftOrFirst]];
+		n.max = itemMax[items[n.leftOrFirst]];
+		for (int k = n.leftOrFirst + 1; k < n.leftOrFirst + n.count; k++) {
+			n.min = glm::min(n.min, itemMin[items[k]]);
+			n.max = glm::max(n.max, itemMax[items[k]]);
+		}
+	}
+	else {
+		const BvhNode &l = nodes[n.leftOrFirst];
+		const BvhNode &r = nodes[n.leftOrFirst + 1];
+		n.min = glm::min(l.min, r.min);
+		n.max = glm::max(l.max, r.max);
+	}
+}
+
+// Children come after their parent (assign() checks it for loaded trees), so
+// going through the nodes backwards refits every child before its parent.
+//
+void Bvh::refit(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs) {
+	itemMin = mins;
+	itemMax = maxs;
+	for (int node = (int)nodes.size() - 1; node >= 0; node--) updateBounds(node);
+}
+
+// Walk up from the leaf, stopping as soon as a node's bounds come out unchanged.
+//
+void Bvh::refit(int item, const glm::vec3 &min, const glm::vec3 &max) {
+	itemMin[item] = min;
+	itemMax[item] = max;
+	for (int node = leafOf[item]; node >= 0; node = parentOf[node]) {
+		glm::vec3 oldMin = nodes[node].min, oldMax = nodes[node].max;
+		updateBounds(node);
+		if (nodes[node].min == oldMin && nodes[node].max == oldMax) break;
+	}
+}
@@ -0,0 +1,170 @@
+//
+//  Bvh.h - Bounding volume hierarchy over axis aligned boxes
+//
+//  Nodes live in one flat array.  An interior node stores the index of its
+//  left child (the right child is always the next node); a leaf stores a
+//  range into the items array.  Only depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <atomic>
+#include "glm/glm.hpp"
+
+struct BvhNode {
+	glm::vec3 min;
+	int leftOrFirst;      // interior: left child, leaf: first entry in Bvh::items
+	glm::vec3 max;
+	int count;            // number of items, 0 for interior nodes
+};
+
+class Bvh {
+public:
+
+	// build over the given item bounds, median split on the longest
+	// centroid axis, at most leafSize items per leaf
+	//
+	void build(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs, int leafSize = 4);
+
+	// build with the surface area heuristic, evaluated over 16 centroid bins
+	// per axis.  slower to build than build() but much faster to trace, so
+	// this is the one to use for triangle meshes.  large nodes are binned and
+	// large subtrees built in parallel
+	//
+	void buildSAH(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs, int leafSize = 4);
+
+	// take over a tree built earlier (e.g. read back from a file) instead
+	// of building one.  items must be a permutation of the item indices;
+	// returns false, leaving the bvh empty, if the tree doesn't fit them
+	//
+	bool assign(const BvhNode *nodes, int nodeCount, const int *items,
+		const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs);
+
+	// change the bounds of one item and refit the nodes above it.  the tree
+	// topology is kept, so quality degrades slowly as things move; call
+	// build() again when items are added or removed
+	//
+	void refit(int item, const glm::vec3 &min, const glm::vec3 &max);
+
+	// new bounds for every item, and every node refit in one bottom up pass
+	//
+	void refit(const std::vector<glm::vec3> &mins, const std::vector<glm::vec3> &maxs);
+
+	void clear();
+	bool empty() const { return nodes.empty(); }
+	int size() const { return (int)itemMin.size(); }
+
+	// Slab test of a ray (origin o, 1 / direction invD) against a node.
+	// On a hit inside [0, tMax], tEntry is the entry distance (0 if the origin
+	// is inside the box).  A NaN slab (origin on the plane of a slab the ray
+	// is parallel to) is treated as inside that slab.
+	//
+	static bool intersectNode(const BvhNode &node, const glm::vec3 &o, const glm::vec3 &invD, float tMax, float &tEntry) {
+		float tmin = 0, tmax = tMax;
+		for (int a = 0; a < 3; a++) {
+			float t1 = (node.min[a] - o[a]) * invD[a];
+			float t2 = (node.max[a] - o[a]) * invD[a];
+			if (t1 > t2) { float t = t1; t1 = t2; t2 = t; }
+			if (t1 > tmin) tmin = t1;
+			if (t2 < tmax) tmax = t2;
+		}
+		tEntry = tmin;
+		return tmin <= tmax;
+	}
+
+	// Closest hit query.  hitItem(item, tBest) is called for every item
+	// whose leaf is reached before tBest; it must return true (and lower
+	// tBest) when the item is hit closer than tBest.  Children are visited
+	// front to back and anything that starts beyond tBest is skipped.
+	// Returns the closest item, or -1.
+	//
+	template <class HitFunc>
+	int closestHit(const glm::vec3 &o, const glm::vec3 &d, float &tBest, HitFunc hitItem) const {
+		if (nodes.empty()) return -1;
+		glm::vec3 invD = glm::vec3(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+		int best = -1;
+		int stack[maxDepth];
+		float entry[maxDepth];
+		int sp = 0;
+		float t;
+		if (!intersectNode(nodes[0], o, invD, tBest, t)) return -1;
+		stack[sp] = 0; entry[sp++] = t;
+
+		while (sp > 0) {
+			sp--;
+			if (entry[sp] > tBest) continue;
+			const BvhNode &node = nodes[stack[sp]];
+
+			if (node.count > 0) {
+				for (int k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+					if (hitItem(items[k], tBest)) best = items[k];
+				}
+				continue;
+			}
+
+			int l = node.leftOrFirst, r = l + 1;
+			float tl, tr;
+			bool hl = intersectNode(nodes[l], o, invD, tBest, tl);
+			bool hr = intersectNode(nodes[r], o, invD, tBest, tr);
+			if (hl && hr) {
+				// push the far child first so the near one is popped next
+				if (tl > tr) { std::swap(l, r); std::swap(tl, tr); }
+				stack[sp] = r; entry[sp++] = tr;
+				stack[sp] = l; entry[sp++] = tl;
+			}
+			else if (hl) { stack[sp] = l; entry[sp++] = tl; }
+			else if (hr) { stack[sp] = r; entry[sp++] = tr; }
+		}
+		return best;
+	}
+
+	// Any hit query (shadow/occlusion rays).  hitItem(item, tMax) returns true
+	// when the item is hit before tMax; traversal stops at the first hit.
+	// Returns that item, or -1.
+	//
+	template <class HitFunc>
+	int anyHit(const glm::vec3 &o, const glm::vec3 &d, float tMax, HitFunc hitItem) const {
+		if (nodes.empty()) return -1;
+		glm::vec3 invD = glm::vec3(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+		int stack[maxDepth];
+		int sp = 0;
+		float t;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const BvhNode &node = nodes[stack[--sp]];
+			if (!intersectNode(node, o, invD, tMax, t)) continue;
+
+			if (node.count > 0) {
+				for (int k = node.leftOrFirst; k < node.leftOrFirst + node.count; k++) {
+					if (hitItem(items[k], tMax)) return items[k];
+				}
+			}
+			else {
+				stack[sp++] = node.leftOrFirst + 1;
+				stack[sp++] = node.leftOrFirst;
+			}
+		}
+		return -1;
+	}
+
+	// deepest tree the traversal stack can handle (build() stays below it)
+	//
+	static const int maxDepth = 64;
+
+	std::vector<BvhNode> nodes;
+	std::vector<int> items;            // item indices in leaf order
+	std::vector<int> parentOf;         // parent node of each node, -1 for the root
+	std::vector<int> leafOf;           // leaf node holding each item
+	std::vector<glm::vec3> itemMin;    // item bounds
+	std::vector<glm::vec3> itemMax;
+
+private:
+	void buildNode(int node, int first, int count, int depth, int leafSize, std::vector<glm::vec3> &centers);
+	void buildNodeSAH(int node, int first, int count, int depth, int leafSize,
+		struct SahRef *refs, std::atomic<int> &nodeCount);
+	void makeLeaf(int node, int first, int count);
+	void updateBounds(int node);
+};
@@ -0,0 +1,209 @@
+//
+//  ClipBake.cpp - World space joint transforms of a clip, frame by frame
+//
+
+#include "ClipBake.h"
+#include "Parallel.h"
+#include "TextParse.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void ClipBake::setup(const SkeletonFile &skeleton, const AnimationFile &clip, std::vector<std::string> *unmatched) {
+	int n = (int)skeleton.joints.size();
+	names.resize(n);
+	parents.resize(n);
+	for (int i = 0; i < n; i++) {
+		names[i] = skeleton.joints[i].name;
+		parents[i] = skeleton.joints[i].parent;
+	}
+
+	// same ordering as Crowd::setRig()
+	//
+	std::vector<int> order = PoseBuffer::sortTopological(parents);
+	rig.clear();
+	rig.reserve((int)order.size());
+	fileJoints.assign(n, -1);
+	restRotations.resize(order.size());
+	for (int k = 0; k < order.size(); k++) {
+		const JointDesc &joint = skeleton.joints[order[k]];
+		fileJoints[order[k]] = k;
+		rig.addJoint(joint.parent < 0 ? -1 : fileJoints[joint.parent], joint.translation, joint.rotation);
+		restRotations[k] = joint.rotation;
+	}
+
+	timeline = Timeline();
+	trackJoints.clear();
+	for (int i = 0; i < clip.timeline.size(); i++) {
+		int j = skeleton.find(clip.trackJoints[i]);
+		if (j < 0 || fileJoints[j] < 0) {
+			if (unmatched) unmatched->push_back(clip.trackJoints[i]);
+			continue;
+		}
+		timeline.tracks.push_back(clip.timeline.tracks[i]);
+		trackJoints.push_back(fileJoints[j]);
+	}
+	timeline.bSlerp = clip.timeline.bSlerp;
+}
+
+int ClipBake::frameCount(float rate) const {
+	return Timeline::frameCount(timeline.startTime(), timeline.endTime(), rate);
+}
+
+float ClipBake::frameTime(int f, float rate) const {
+	float start = timeline.startTime();
+	float end = timeline.endTime();
+	return (f == frameCount(rate) - 1) ? end : start + f / rate;
+}
+
+void ClipBake::bake(float rate, int first, int count, std::vector<glm::mat4> &world) const {
+	int n = jointCount();
+	int nRig = rig.size();
+	int nTracks = timeline.size();
+	world.resize((size_t)count * n);
+
+	// each task walks its frames forward with its own cursors and pose
+	//
+	parallelFor(0, count, std::max(1, 4096 / std::max(nRig, 1)), [&](int b, int e) {
+		std::vector<TrackCursor> cursors(nTracks);
+		std::vector<TrackSample> samples(nTracks);
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> orientations;
+		std::vector<glm::mat4> rigWorld(nRig);
+		for (int k = b; k < e; k++) {
+			translations = rig.translations;
+			orientations = rig.orientations;
+			timeline.sample(frameTime(first + k, rate), samples.data(), cursors.data());
+			for (int i = 0; i < nTracks; i++) {
+				const AnimTrack &track = timeline.tracks[i];
+				int j = trackJoints[i];
+				for (int c = 0; c < 3; c++) {
+					if (!track.channels[ChannelPosX + c].empty()) translations[j][c] = samples[i].position[c];
+				}
+				if (track.bQuatRotation) {
+					if (!track.quatChannel.empty()) orientations[j] = samples[i].orientation;
+				}
+				else {
+					glm::vec3 rotation = restRotations[j];
+					for (int c = 0; c < 3; c++) {
+						if (!track.channels[ChannelRotX + c].empty()) rotation[c] = samples[i].rotation[c];
+					}
+					orientations[j] = eulerToQuat(rotation);
+				}
+			}
+			PoseBuffer::computeWorld(nRig, rig.parents.data(), translations.data(), orientations.data(),
+				rig.scales.data(), rig.pivots.data(), rigWorld.data());
+
+			glm::mat4 *out = &world[(size_t)k * n];
+			for (int j = 0; j < n; j++) out[j] = fileJoints[j] >= 0 ? rigWorld[fileJoints[j]] : glm::mat4(1.0);
+		}
+	});
+}
+
+bool ClipBake::write(FILE *out, BakeFormat format, float rate, int blockFrames) const {
+	int nFrames = frameCount(rate);
+	if (!writeHeader(out, format, rate, nFrames)) return false;
+
+	std::vector<glm::mat4> world;
+	for (int first = 0; first < nFrames; first += blockFrames) {
+		int count = std::min(blockFrames, nFrames - first);
+		bake(rate, first, count, world);
+		if (!writeFrames(out, format, rate, first, count, world)) return false;
+	}
+	return fflush(out) == 0;
+}
+
+// Binary layout (little endian):
+//
+//   BakeBinaryHeader
+//   int32 parent x jointCount (-1 for roots, file order)
+//   string table: uint32 length and the bytes of each joint name
+//   float[12] x jointCount x frameCount: columns 0 to 3 of each world
+//   matrix, x y z of each (the bottom row is always 0 0 0 1)
+//
+struct BakeBinaryHeader {
+	char magic[8];          // "BAKEDCLP"
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t jointCount;
+	uint32_t frameCount;
+	float startTime;
+	float rate;             // the last frame is at the clip's end time
+	float endTime;
+	uint32_t stringBytes;
+};
+
+static const char bakeMagic[8] = { 'B', 'A', 'K', 'E', 'D', 'C', 'L', 'P' };
+
+bool ClipBake::writeHeader(FILE *out, BakeFormat format, float rate, int nFrames) const {
+	int n = jointCount();
+	if (format == BakeCsv) {
+		std::string text = "frame,time,joint";
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 3; r++) text += ",m" + std::to_string(c) + std::to_string(r);
+		}
+		text += "\n";
+		return fwrite(text.data(), 1, text.size(), out) == text.size();
+	}
+
+	BakeBinaryHeader header;
+	memcpy(header.magic, bakeMagic, sizeof(header.magic));
+	header.version = binaryVersion;
+	header.headerSize = sizeof(BakeBinaryHeader);
+	header.jointCount = (uint32_t)n;
+	header.frameCount = (uint32_t)nFrames;
+	header.startTime = timeline.startTime();
+	header.rate = rate;
+	header.endTime = timeline.endTime();
+	header.stringBytes = 0;
+	for (int j = 0; j < n; j++) header.stringBytes += sizeof(uint32_t) + (uint32_t)names[j].size();
+
+	std::vector<char> buffer(sizeof(header) + n * sizeof(int32_t) + header.stringBytes);
+	memcpy(buffer.data(), &header, sizeof(header));
+	char *p = buffer.data() + sizeof(header);
+	for (int j = 0; j < n; j++) {
+		int32_t parent = parents[j];
+		memcpy(p, &parent, sizeof(parent));
+		p += sizeof(parent);
+	}
+	for (int j = 0; j < n; j++) {
+		uint32_t length = (uint32_t)names[j].size();
+		memcpy(p, &length, sizeof(length));
+		memcpy(p + sizeof(length), names[j].data(), length);
+		p += sizeof(length) + length;
+	}
+	return fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+}
+
+bool ClipBake::writeFrames(FILE *out, BakeFormat format, float rate, int first, int count, const std::vector<glm::mat4> &world) const {
+	int n = jointCount();
+	if (format == BakeBinary) {
+		std::vector<float> buffer((size_t)count * n * 12);
+		float *p = buffer.data();
+		for (size_t i = 0; i < (size_t)count * n; i++) {
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 3; r++) *p++ = world[i][c][r];
+			}
+		}
+		return fwrite(buffer.data(), sizeof(float), buffer.size(), out) == buffer.size();
+	}
+
+	std::string text;
+	for (int k = 0; k < count; k++) {
+		std::string prefix = std::to_string(first + k) + "," + TextParse::formatFloat(frameTime(first + k, rate)) + ",";
+		for (int j = 0; j < n; j++) {
+			const glm::mat4 &m = world[(size_t)k * n + j];
+			text += prefix;
+			text += names[j];
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 3; r++) {
+					text += ",";
+					text += TextParse::formatFloat(m[c][r]);
+				}
+			}
+			text += "\n";
+		}
+	}
+	return fwrite(text.data(), 1, text.size(), out) == text.size();
+}
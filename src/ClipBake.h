@@ -0,0 +1,74 @@
+//
+//  ClipBake.h - World space joint transforms of a clip, frame by frame
+//
+//  Plays a clip (model.anim) on a skeleton (model.txt) without a scene or a
+//  GL context: the skeleton becomes a PoseBuffer in topological order, the
+//  tracks are matched to its joints by name, and each frame is sampled and
+//  run through PoseBuffer::computeWorld().  Frames are independent, so
+//  blocks of them are evaluated in parallel, each walking forward with its
+//  own track cursors.  Joints no track drives keep their rest transform,
+//  and so do the channels a track has no keys for (a clip written by hand
+//  may only key what moves; the app always keys every channel).
+//
+//  write() streams the result in blocks so long clips don't have to fit in
+//  memory, either as binary (header, joint names and parents, then 12 floats
+//  per joint and frame) or as CSV with one row per joint and frame; the
+//  matrices are the top three rows of each column, m[c][r] with c = 0..3.
+//  CSV numbers round trip exactly, so baked files can be diffed for
+//  regression tests.  Only depends on glm.
+//
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "glm/glm.hpp"
+#include "AnimationFile.h"
+#include "Pose.h"
+#include "SkeletonFile.h"
+
+enum BakeFormat {
+	BakeBinary,
+	BakeCsv
+};
+
+class ClipBake {
+public:
+	static const uint32_t binaryVersion = 1;
+
+	// the rig and the clip mapped onto it.  Tracks for joints the skeleton
+	// doesn't have are skipped and their names added to unmatched
+	//
+	void setup(const SkeletonFile &skeleton, const AnimationFile &clip, std::vector<std::string> *unmatched = NULL);
+
+	int jointCount() const { return (int)names.size(); }
+
+	// frames at rate from the first key of the clip to the last one, the
+	// last frame exactly at it (see Timeline::bake())
+	//
+	int frameCount(float rate) const;
+	float frameTime(int f, float rate) const;
+
+	// world matrices of frames [first, first + count), joint j (in skeleton
+	// file order) of frame first + k at world[k * jointCount() + j]
+	//
+	void bake(float rate, int first, int count, std::vector<glm::mat4> &world) const;
+
+	// the whole clip, blockFrames frames at a time.  False if writing fails
+	//
+	bool write(FILE *out, BakeFormat format, float rate, int blockFrames = 256) const;
+
+private:
+	bool writeHeader(FILE *out, BakeFormat format, float rate, int nFrames) const;
+	bool writeFrames(FILE *out, BakeFormat format, float rate, int first, int count, const std::vector<glm::mat4> &world) const;
+
+	PoseBuffer rig;
+	std::vector<int> fileJoints;       // rig index of each joint in file order
+	std::vector<glm::vec3> restRotations;    // euler degrees, rig order
+	std::vector<std::string> names;    // file order
+	std::vector<int> parents;          // file order, -1 for roots
+
+	Timeline timeline;
+	std::vector<int> trackJoints;      // rig index driven by each track
+};
@@ -0,0 +1,105 @@
+//
+//  ClipBlend.cpp - Layered blending of Timeline clips
+//
+
+#include "ClipBlend.h"
+#include "QuatSimd.h"
+#include <algorithm>
+
+JointMask JointMask::subtree(const std::vector<int> &parents, int root, float weight) {
+	JointMask mask;
+	int n = (int)parents.size();
+	mask.weights.assign(n, 0.0f);
+	if (root < 0 || root >= n) return mask;
+
+	// parents come first, so one forward pass reaches the whole subtree
+	//
+	mask.weights[root] = weight;
+	std::vector<char> inside(n, 0);
+	inside[root] = 1;
+	for (int i = root + 1; i < n; i++) {
+		int p = parents[i];
+		if (p >= 0 && inside[p]) {
+			inside[i] = 1;
+			mask.weights[i] = weight;
+		}
+	}
+	return mask;
+}
+
+JointMask JointMask::inverted() const {
+	JointMask mask;
+	mask.weights.resize(weights.size());
+	for (int i = 0; i < weights.size(); i++) mask.weights[i] = 1 - weights[i];
+	return mask;
+}
+
+static glm::quat trackOrientation(const AnimTrack &track, const TrackSample &s) {
+	return track.bQuatRotation ? s.orientation : eulerToQuat(s.rotation);
+}
+
+void ClipBlender::evaluate(FrameArena &arena, int n, const glm::vec3 *restPositions, const glm::quat *restOrientations,
+	glm::vec3 *positions, glm::quat *orientations) {
+
+	if (positions != restPositions) std::copy(restPositions, restPositions + n, positions);
+	if (orientations != restOrientations) std::copy(restOrientations, restOrientations + n, orientations);
+	for (int l = 0; l < layers.size(); l++) {
+		if (layers[l].clip == NULL || layers[l].weight == 0) continue;
+		applyLayer(arena, layers[l], n, positions, orientations);
+	}
+}
+
+// Positions blend right away.  Rotations are gathered as (from, to, weight)
+// and blended in one batch: an override layer blends from the pose so far
+// to the clip, an additive layer from identity to the clip's rotation
+// relative to the reference, and the result is then applied on top.
+//
+void ClipBlender::applyLayer(FrameArena &arena, ClipLayer &layer, int n, glm::vec3 *positions, glm::quat *orientations) {
+	const Timeline &clip = *layer.clip;
+	int nTracks = clip.size();
+	if (layer.cursors.size() != nTracks) layer.cursors.resize(nTracks);
+
+	TrackSample *samples = arena.allocate<TrackSample>(nTracks);
+	clip.sample(layer.time, samples, layer.cursors.data());
+	TrackSample *reference = NULL;
+	if (layer.bAdditive) {
+		reference = arena.allocate<TrackSample>(nTracks);
+		clip.sample(layer.referenceTime, reference, NULL);
+	}
+
+	glm::quat *from = arena.allocate<glm::quat>(nTracks);
+	glm::quat *to = arena.allocate<glm::quat>(nTracks);
+	float *weights = arena.allocate<float>(nTracks);
+	int *joints = arena.allocate<int>(nTracks);
+	int k = 0;
+	for (int i = 0; i < nTracks; i++) {
+		int j = layer.trackJoints.empty() ? i : layer.trackJoints[i];
+		if (j < 0 || j >= n) continue;
+		float w = layer.weight * (layer.mask ? layer.mask->weight(j) : 1.0f);
+		if (w == 0) continue;
+
+		const AnimTrack &track = clip.tracks[i];
+		glm::quat q = trackOrientation(track, samples[i]);
+		if (layer.bAdditive) {
+			positions[j] += (samples[i].position - reference[i].position) * w;
+			from[k] = glm::quat(1, 0, 0, 0);
+			to[k] = glm::conjugate(trackOrientation(track, reference[i])) * q;
+		}
+		else {
+			positions[j] = glm::mix(positions[j], samples[i].position, w);
+			from[k] = orientations[j];
+			to[k] = q;
+		}
+		weights[k] = w;
+		joints[k] = j;
+		k++;
+	}
+
+	nlerpBatch(from, to, weights, from, k);
+	if (layer.bAdditive) {
+		for (int m = 0; m < k; m++) orientations[joints[m]] = orientations[joints[m]] * from[m];
+	}
+	else {
+		for (int m = 0; m < k; m++) orientations[joints[m]] = from[m];
+	}
+}
@@ -0,0 +1,81 @@
+//
+//  ClipBlend.h - Layered blending of Timeline clips
+//
+//  A ClipBlender is a stack of layers evaluated bottom up on top of a rest
+//  pose.  An override layer moves every joint it drives from the pose so
+//  far toward the clip's pose by the layer weight times the joint's mask
+//  weight, so a second override layer with weight a cross-fades from the
+//  first clip to the second.  An additive layer adds the difference
+//  between its clip and the clip's own reference pose, scaled by the
+//  weight (a breathing cycle or an aim offset on top of locomotion).
+//  Rotations are blended as quaternions, all joints of a layer in one
+//  nlerpBatch() (see QuatSimd.h).
+//
+//  The temporary poses of a frame come from a FrameArena, so evaluate()
+//  doesn't allocate once the arena and the layer cursors have grown (the
+//  app's --bench run checks the arena, see AppBenchmarks.h).
+//  Only depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include "FrameArena.h"
+#include "Pose.h"
+#include "Timeline.h"
+
+// per joint blend weights, e.g. upper body vs. lower body
+//
+struct JointMask {
+	std::vector<float> weights;     // one per joint, 0 to 1
+
+	// weight for root and every joint below it, 0 elsewhere.  parents as
+	// in PoseBuffer (a parent before its children)
+	//
+	static JointMask subtree(const std::vector<int> &parents, int root, float weight = 1);
+
+	// 1 - weight for every joint
+	//
+	JointMask inverted() const;
+
+	float weight(int joint) const { return joint < weights.size() ? weights[joint] : 0; }
+};
+
+struct ClipLayer {
+	const Timeline *clip = NULL;
+	std::vector<int> trackJoints;       // joint of each track (-1 for none), empty maps track i to joint i
+	float time = 0;
+	float weight = 1;
+	const JointMask *mask = NULL;       // NULL drives every joint fully
+	bool bAdditive = false;
+	float referenceTime = 0;            // additive: the clip's pose at this time adds nothing
+	std::vector<TrackCursor> cursors;   // segments of the last sample, for playback
+};
+
+class ClipBlender {
+public:
+	int addLayer(const Timeline *clip, bool bAdditive = false) {
+		layers.push_back(ClipLayer());
+		layers.back().clip = clip;
+		layers.back().bAdditive = bAdditive;
+		return (int)layers.size() - 1;
+	}
+
+	// blend all layers, in order, onto the rest pose of n joints.  The
+	// output arrays may be the rest arrays
+	//
+	void evaluate(FrameArena &arena, int n, const glm::vec3 *restPositions, const glm::quat *restOrientations,
+		glm::vec3 *positions, glm::quat *orientations);
+
+	// same with the local channels of pose buffers in the same joint order,
+	// the translations and orientations of pose are written
+	//
+	void evaluate(FrameArena &arena, const PoseBuffer &rest, PoseBuffer &pose) {
+		evaluate(arena, rest.size(), rest.translations.data(), rest.orientations.data(),
+			pose.translations.data(), pose.orientations.data());
+	}
+
+	std::vector<ClipLayer> layers;
+
+private:
+	void applyLayer(FrameArena &arena, ClipLayer &layer, int n, glm::vec3 *positions, glm::quat *orientations);
+};
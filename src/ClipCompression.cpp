@@ -0,0 +1,666 @@
+//
+//  ClipCompression.cpp - Lossy compression of Timeline clips
+//
+
+#include "ClipCompression.h"
+#include "Parallel.h"
+#include "Pose.h"
+#include "QuatSimd.h"
+#include <algorithm>
+#include <cmath>
+
+static const float quantMax = 65535.0f;
+static const float smallestThreeMax = 32767.0f;
+
+static uint16_t quantize(float v, float lo, float step) {
+	if (!(step > 0)) return 0;
+	return (uint16_t)std::min(quantMax, std::max(0.0f, std::floor((v - lo) / step + 0.5f)));
+}
+
+// rotation angle (degrees) between two unit quaternions, well conditioned
+// for the small angles the tolerances are about
+//
+static float rotationAngle(const glm::quat &a, glm::quat b) {
+	if (glm::dot(a, b) < 0) b = -b;
+	return glm::degrees(4.0f * std::atan2(glm::length(a - b), glm::length(a + b)));
+}
+
+// Largest err(t) over [t0, t1].  err is sampled at samples + 1 even steps
+// and every local maximum is then narrowed down by a golden section search
+// between its neighbours, so a peak lying between two samples is found
+// too.  Eased segments get errorSamples steps; otherwise the error is
+// linear, or for rotations nearly so, and the midpoint is enough to catch
+// a bulge
+//
+static const int errorSamples = 8;
+
+template <class Err>
+static float maxError(float t0, float t1, int samples, Err err) {
+	if (!(t1 > t0)) return err(t0);
+	float ts[errorSamples + 1], es[errorSamples + 1];
+	float e = 0;
+	for (int i = 0; i <= samples; i++) {
+		ts[i] = (i == samples ? t1 : t0 + (t1 - t0) * i / samples);
+		es[i] = err(ts[i]);
+		e = std::max(e, es[i]);
+	}
+	const float ratio = 0.618034f;
+	for (int i = 0; i <= samples; i++) {
+		float left = (i > 0 ? es[i - 1] : -1.0f);
+		float right = (i < samples ? es[i + 1] : -1.0f);
+		if (left > es[i] || right > es[i] || (left == es[i] && right == es[i])) continue;
+		float lo = ts[std::max(i - 1, 0)];
+		float hi = ts[std::min(i + 1, samples)];
+		float a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+		float ea = err(a), eb = err(b);
+		for (int k = 0; k < 12; k++) {
+			if (ea > eb) {
+				hi = b;
+				b = a;
+				eb = ea;
+				a = hi - ratio * (hi - lo);
+				ea = err(a);
+			}
+			else {
+				lo = a;
+				a = b;
+				ea = eb;
+				b = lo + ratio * (hi - lo);
+				eb = err(b);
+			}
+		}
+		e = std::max(e, std::max(ea, eb));
+	}
+	return e;
+}
+
+// Sorted breaks at which the source or the compressed curve changes
+// segment.  Between two of them both curves are a single segment, so the
+// error there is measured from the first break up to just before the next
+// (a step holds its value right up to it).  bEased(t) says whether either
+// side is eased after t
+//
+static void addKeyTimes(const std::vector<float> &times, std::vector<float> &breaks) {
+	breaks.insert(breaks.end(), times.begin(), times.end());
+}
+
+static void addKeyTimes(const QuantizedTimes &curve, std::vector<float> &breaks) {
+	for (int i = 0; i < curve.keyCount(); i++) breaks.push_back(curve.keyTime(i));
+}
+
+template <class Eased, class Err>
+static float maxErrorBetween(std::vector<float> &breaks, Eased bEased, Err err) {
+	std::sort(breaks.begin(), breaks.end());
+	breaks.erase(std::unique(breaks.begin(), breaks.end()), breaks.end());
+	float e = 0;
+	for (int i = 0; i < breaks.size(); i++) {
+		float end = (i + 1 < breaks.size() ? std::nextafter(breaks[i + 1], breaks[i]) : breaks[i]);
+		e = std::max(e, maxError(breaks[i], end, bEased(breaks[i]) ? errorSamples : 2, err));
+	}
+	return e;
+}
+
+static bool easedAt(const AnimCurve &curve, float t) {
+	return !curve.empty() && curve.interps[curve.findSegment(t)] == InterpEase;
+}
+
+static bool easedAt(const AnimQuatCurve &curve, float t) {
+	return !curve.empty() && curve.interps[AnimCurve::findSegment(curve.times, t)] == InterpEase;
+}
+
+static bool easedAt(const QuantizedTimes &curve, float t) {
+	if (curve.keyCount() == 0) return false;
+	int cursor = 0;
+	float u;
+	return curve.interps[curve.findSegment(t, cursor, u)] == InterpEase;
+}
+
+
+float ClipCompressionReport::maxPositionError() const {
+	float e = 0;
+	for (int i = 0; i < positionError.size(); i++) e = std::max(e, positionError[i]);
+	return e;
+}
+
+float ClipCompressionReport::maxRotationError() const {
+	float e = 0;
+	for (int i = 0; i < rotationError.size(); i++) e = std::max(e, rotationError[i]);
+	return e;
+}
+
+// Same search as AnimCurve::findSegment(), done on the quantized times so
+// no key time has to be decoded.  x is in the units of times, u is linear
+//
+template <class T>
+static int locateKey(const std::vector<T> &times, float x, int &cursor, float &u) {
+	int n = (int)times.size();
+	int c = cursor;
+	int i;
+	if (c >= 0 && c < n - 1 && times[c] <= x && x < times[c + 1]) i = c;
+	else if (c >= 0 && c + 2 < n && times[c + 1] <= x && x < times[c + 2]) i = c + 1;
+	else if (x <= times[0]) i = 0;
+	else if (x >= times[n - 1]) i = n - 1;
+	else i = (int)(std::upper_bound(times.begin(), times.end(), x) - times.begin()) - 1;
+	cursor = i;
+
+	if (i == n - 1 || x <= times[i]) return i;
+	u = (x - times[i]) / (times[i + 1] - times[i]);
+	return i;
+}
+
+int QuantizedTimes::findSegment(float t, int &cursor, float &u) const {
+	int n = keyCount();
+	u = 0;
+	if (n < 2) return cursor = 0;
+
+	int i = rawTimes.empty() ? locateKey(times, (t - startTime) / timeStep, cursor, u) : locateKey(rawTimes, t, cursor, u);
+	if (u == 0) return i;
+	switch (interps[i]) {
+	case InterpStep: u = 0; break;
+	case InterpEase: u = AnimCurve::ease(u); break;
+	default: break;
+	}
+	return i;
+}
+
+float CompressedCurve::sample(float t, int &cursor) const {
+	if (keyCount() == 0) return 0;
+	float u;
+	int i = findSegment(t, cursor, u);
+	float a = keyValue(i);
+	if (u == 0) return a;
+	return a + (keyValue(i + 1) - a) * u;
+}
+
+size_t QuantizedTimes::timeBytes() const {
+	return 2 * sizeof(float) + times.size() * sizeof(uint16_t) + rawTimes.size() * sizeof(float) + interps.size() * sizeof(AnimInterp);
+}
+
+size_t CompressedCurve::byteSize() const {
+	return timeBytes() + 2 * sizeof(float) + values.size() * sizeof(uint16_t) + rawValues.size() * sizeof(float);
+}
+
+void CompressedQuatCurve::segment(float t, int &cursor, glm::quat &a, glm::quat &b, float &u) const {
+	if (keyCount() == 0) {
+		a = b = glm::quat(1, 0, 0, 0);
+		u = 0;
+		return;
+	}
+	int i = findSegment(t, cursor, u);
+	a = keyValue(i);
+	b = (u == 0 ? a : keyValue(i + 1));
+}
+
+glm::quat CompressedQuatCurve::sample(float t, int &cursor, bool bSlerp) const {
+	glm::quat a, b;
+	float u;
+	segment(t, cursor, a, b, u);
+	return bSlerp ? slerpQuat(a, b, u) : nlerpQuat(a, b, u);
+}
+
+size_t CompressedQuatCurve::byteSize() const {
+	return timeBytes() + values.size() * sizeof(uint16_t) + rawValues.size() * sizeof(glm::quat);
+}
+
+// q and -q are the same rotation, so the largest component can be made
+// positive and rebuilt as sqrt(1 - the others); those are then within
+// +-1/sqrt(2) and take 15 bits each
+//
+void CompressedQuatCurve::encode(const glm::quat &q, uint16_t *out) {
+	int largest = 0;
+	for (int c = 1; c < 4; c++) {
+		if (std::fabs(q[c]) > std::fabs(q[largest])) largest = c;
+	}
+	float sign = q[largest] < 0 ? -1.0f : 1.0f;
+	float range = glm::root_two<float>();
+	int k = 0;
+	for (int c = 0; c < 4; c++) {
+		if (c == largest) continue;
+		float v = glm::clamp(sign * q[c] * range * 0.5f + 0.5f, 0.0f, 1.0f);
+		out[k++] = (uint16_t)std::floor(v * smallestThreeMax + 0.5f);
+	}
+	out[0] |= (uint16_t)((largest >> 1) << 15);
+	out[1] |= (uint16_t)((largest & 1) << 15);
+}
+
+glm::quat CompressedQuatCurve::decode(const uint16_t *in) {
+	int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+	float range = glm::root_two<float>();
+	glm::quat q;
+	float sum = 0;
+	int k = 0;
+	for (int c = 0; c < 4; c++) {
+		if (c == largest) continue;
+		float v = ((in[k++] & 0x7fff) / smallestThreeMax - 0.5f) * 2.0f / range;
+		q[c] = v;
+		sum += v * v;
+	}
+	q[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	return q;
+}
+
+TrackSample CompressedTrack::sample(float t, TrackCursor &cursor, bool bSlerp) const {
+	TrackSample s;
+	for (int a = 0; a < 3; a++) {
+		s.position[a] = channels[ChannelPosX + a].sample(t, cursor.keys[ChannelPosX + a]);
+	}
+	if (bQuatRotation) {
+		s.orientation = quatChannel.sample(t, cursor.quatKey, bSlerp);
+		return s;
+	}
+	for (int a = 0; a < 3; a++) {
+		s.rotation[a] = channels[ChannelRotX + a].sample(t, cursor.keys[ChannelRotX + a]);
+	}
+	return s;
+}
+
+size_t CompressedTrack::byteSize() const {
+	size_t bytes = sizeof(bool) + (bQuatRotation ? quatChannel.byteSize() : 0);
+	for (int c = 0; c < ChannelCount; c++) {
+		if (channels[c].keyCount() > 0) bytes += channels[c].byteSize();
+	}
+	return bytes;
+}
+
+// Time quantization of one source curve, or none with bRaw.  x() is a time
+// in what the compressed curve interpolates in: steps, or seconds when raw.
+// keys[i] is key i there.
+//
+struct TimeQuantizer {
+	float start = 0;
+	float step = 0;
+	bool bRaw;
+	std::vector<uint16_t> q;
+	std::vector<float> keys;
+
+	TimeQuantizer(const std::vector<float> &times, bool bRaw) : bRaw(bRaw) {
+		int n = (int)times.size();
+		if (n == 0) return;
+		if (bRaw) {
+			keys = times;
+			return;
+		}
+		start = times[0];
+		step = (times[n - 1] - times[0]) / quantMax;
+		q.resize(n);
+		keys.resize(n);
+		for (int i = 0; i < n; i++) keys[i] = q[i] = quantize(times[i], start, step);
+	}
+
+	float x(float t) const {
+		if (bRaw) return t;
+		return step > 0 ? (t - start) / step : 0;
+	}
+
+	// blend factor at source time t of the segment from key a to key j
+	//
+	float blend(float t, int a, int j, AnimInterp interp) const {
+		float u = glm::clamp((x(t) - keys[a]) / (keys[j] - keys[a]), 0.0f, 1.0f);
+		if (interp == InterpStep) return 0;
+		if (interp == InterpEase) return AnimCurve::ease(u);
+		return u;
+	}
+
+	void store(QuantizedTimes &dst, const std::vector<int> &keep, const std::vector<AnimInterp> &interps) const {
+		dst.startTime = start;
+		dst.timeStep = step;
+		dst.times.resize(bRaw ? 0 : keep.size());
+		dst.rawTimes.resize(bRaw ? keep.size() : 0);
+		dst.interps.resize(keep.size());
+		for (int k = 0; k < keep.size(); k++) {
+			if (bRaw) dst.rawTimes[k] = keys[keep[k]];
+			else dst.times[k] = q[keep[k]];
+			dst.interps[k] = interps[keep[k]];
+		}
+	}
+};
+
+// Greedy key removal.  From key a the segment end j moves forward while
+// fits(a, j) says the source from key a to j is still reproduced, and only over
+// keys with the same interpolation.  Keys whose quantized time collides
+// with the previous kept key can't be stored and are always skipped.  The
+// next key is kept even when it doesn't fit; compressCurve() finds those
+// cases when it checks the result.
+//
+template <class Fits>
+static std::vector<int> reduceKeys(const TimeQuantizer &tq, const std::vector<AnimInterp> &interps, Fits fits) {
+	int n = (int)tq.keys.size();
+	std::vector<int> keep;
+	if (n == 0) return keep;
+	keep.push_back(0);
+
+	int a = 0;
+	while (a < n - 1) {
+		int best = -1;
+		for (int j = a + 1; j < n; j++) {
+			if (j > a + 1 && interps[j - 1] != interps[a]) break;
+			if (tq.keys[j] == tq.keys[a]) continue;
+			if (best >= 0 && !fits(a, j)) break;
+			best = j;
+		}
+		if (best < 0) {
+			for (int j = a + 1; j < n && best < 0; j++) {
+				if (tq.keys[j] != tq.keys[a]) best = j;
+			}
+			if (best < 0) break;
+		}
+		keep.push_back(best);
+		a = best;
+	}
+	return keep;
+}
+
+// Ways to store the times of a curve, tried in order until the curve
+// holds the tolerance everywhere.  With raw times and every key kept the
+// segments are the source's own, so the last one always does once the
+// values do.
+//
+enum { Times16Bit, TimesRaw, TimesRawAllKeys, TimesModes };
+
+static std::vector<int> allKeys(int n) {
+	std::vector<int> keep(n);
+	for (int i = 0; i < n; i++) keep[i] = i;
+	return keep;
+}
+
+// A candidate segment only spans source segments of its own interpolation
+// (see reduceKeys()).  Linear and step segments are off by the most at the
+// source keys (or close to them); an eased one can be off by more inside a
+// source segment, so those are searched too.  The breaks a quantized key
+// time adds are left to the check of the whole curve
+//
+template <class Err>
+static bool segmentFits(const std::vector<float> &times, AnimInterp interp, int a, int j, float tolerance, Err err) {
+	for (int k = a; k <= j; k++) {
+		if (!(err(times[k]) <= tolerance)) return false;
+	}
+	if (interp != InterpEase) return true;
+	for (int k = a; k < j; k++) {
+		if (!(maxError(times[k], times[k + 1], errorSamples, err) <= tolerance)) return false;
+	}
+	return true;
+}
+
+static float curveError(const AnimCurve &src, const CompressedCurve &dst) {
+	std::vector<float> breaks;
+	addKeyTimes(src.times, breaks);
+	addKeyTimes(dst, breaks);
+	int srcCursor = 0, dstCursor = 0;
+	auto eased = [&](float t) { return easedAt(src, t) || easedAt(dst, t); };
+	return maxErrorBetween(breaks, eased, [&](float t) { return std::fabs(dst.sample(t, dstCursor) - src.sample(t, srcCursor)); });
+}
+
+static void compressCurve(const AnimCurve &src, float tolerance, CompressedCurve &dst) {
+	dst = CompressedCurve();
+	int n = src.keyCount();
+	if (n == 0) return;
+
+	// values are kept raw when half a step is already more than the tolerance
+	//
+	float lo = *std::min_element(src.values.begin(), src.values.end());
+	float hi = *std::max_element(src.values.begin(), src.values.end());
+	float step = (hi - lo) / quantMax;
+	std::vector<uint16_t> qv(n);
+	std::vector<float> stored(n);
+	bool bRawValues = false;
+	for (int i = 0; i < n; i++) {
+		qv[i] = quantize(src.values[i], lo, step);
+		stored[i] = lo + qv[i] * step;
+		if (!(std::fabs(stored[i] - src.values[i]) <= tolerance)) bRawValues = true;
+	}
+	if (bRawValues) stored = src.values;
+
+	for (int mode = 0; mode < TimesModes; mode++) {
+		TimeQuantizer tq(src.times, mode != Times16Bit);
+		std::vector<int> keep = (mode == TimesRawAllKeys) ? allKeys(n) : reduceKeys(tq, src.interps, [&](int a, int j) {
+			int cursor = a;
+			return segmentFits(src.times, src.interps[a], a, j, tolerance, [&](float t) {
+				float v = stored[a] + (stored[j] - stored[a]) * tq.blend(t, a, j, src.interps[a]);
+				return std::fabs(v - src.sample(t, cursor));
+			});
+		});
+
+		dst = CompressedCurve();
+		tq.store(dst, keep, src.interps);
+		dst.minValue = lo;
+		dst.valueStep = step;
+		dst.values.resize(bRawValues ? 0 : keep.size());
+		dst.rawValues.resize(bRawValues ? keep.size() : 0);
+		for (int k = 0; k < keep.size(); k++) {
+			if (bRawValues) dst.rawValues[k] = stored[keep[k]];
+			else dst.values[k] = qv[keep[k]];
+		}
+		if (curveError(src, dst) <= tolerance) return;
+		if (mode == TimesRawAllKeys && !bRawValues) {
+			bRawValues = true;
+			stored = src.values;
+			mode--;
+		}
+	}
+}
+
+static float quatCurveError(const AnimQuatCurve &src, bool bSlerp, const CompressedQuatCurve &dst) {
+	std::vector<float> breaks;
+	addKeyTimes(src.times, breaks);
+	addKeyTimes(dst, breaks);
+	int srcCursor = 0, dstCursor = 0;
+	auto eased = [&](float t) { return easedAt(src, t) || easedAt(dst, t); };
+	return maxErrorBetween(breaks, eased, [&](float t) {
+		return rotationAngle(dst.sample(t, dstCursor, bSlerp), glm::normalize(src.sample(t, srcCursor, bSlerp)));
+	});
+}
+
+static void compressQuatCurve(const AnimQuatCurve &src, float tolerance, bool bSlerp, CompressedQuatCurve &dst) {
+	dst = CompressedQuatCurve();
+	int n = src.keyCount();
+	if (n == 0) return;
+
+	std::vector<glm::quat> source(n), stored(n);
+	std::vector<uint16_t> qv(3 * n);
+	bool bRawValues = false;
+	for (int i = 0; i < n; i++) {
+		source[i] = glm::normalize(src.values[i]);
+		CompressedQuatCurve::encode(source[i], &qv[3 * i]);
+		stored[i] = CompressedQuatCurve::decode(&qv[3 * i]);
+		if (!(rotationAngle(stored[i], source[i]) <= tolerance)) bRawValues = true;
+	}
+	if (bRawValues) stored = source;
+
+	for (int mode = 0; mode < TimesModes; mode++) {
+		TimeQuantizer tq(src.times, mode != Times16Bit);
+		std::vector<int> keep = (mode == TimesRawAllKeys) ? allKeys(n) : reduceKeys(tq, src.interps, [&](int a, int j) {
+			int cursor = a;
+			return segmentFits(src.times, src.interps[a], a, j, tolerance, [&](float t) {
+				float u = tq.blend(t, a, j, src.interps[a]);
+				glm::quat q = bSlerp ? slerpQuat(stored[a], stored[j], u) : nlerpQuat(stored[a], stored[j], u);
+				return rotationAngle(q, glm::normalize(src.sample(t, cursor, bSlerp)));
+			});
+		});
+
+		dst = CompressedQuatCurve();
+		tq.store(dst, keep, src.interps);
+		dst.values.resize(bRawValues ? 0 : 3 * keep.size());
+		dst.rawValues.resize(bRawValues ? keep.size() : 0);
+		for (int k = 0; k < keep.size(); k++) {
+			if (bRawValues) dst.rawValues[k] = stored[keep[k]];
+			else std::copy(&qv[3 * keep[k]], &qv[3 * keep[k]] + 3, &dst.values[3 * k]);
+		}
+		if (quatCurveError(src, bSlerp, dst) <= tolerance) return;
+
+		// a blend of two keys that each hold the tolerance can still miss it
+		// in between, then the source keys themselves are stored
+		//
+		if (mode == TimesRawAllKeys && !bRawValues) {
+			bRawValues = true;
+			stored = source;
+			mode--;
+		}
+	}
+}
+
+static size_t rawBytes(const AnimTrack &track) {
+	size_t bytes = track.quatChannel.keyCount() * (sizeof(float) + sizeof(glm::quat) + sizeof(AnimInterp));
+	for (int c = 0; c < ChannelCount; c++) {
+		bytes += track.channels[c].keyCount() * (2 * sizeof(float) + sizeof(AnimInterp));
+	}
+	return bytes;
+}
+
+// Largest position and rotation error of a compressed track, searched the
+// same way as the curves were checked, between the key times of every
+// source and compressed curve of the track.
+//
+static void measureError(const AnimTrack &src, const CompressedTrack &dst, bool bSlerp, float &positionError, float &rotationError) {
+	std::vector<float> breaks;
+	addKeyTimes(src.quatChannel.times, breaks);
+	addKeyTimes(dst.quatChannel, breaks);
+	for (int c = 0; c < ChannelCount; c++) {
+		addKeyTimes(src.channels[c].times, breaks);
+		addKeyTimes(dst.channels[c], breaks);
+	}
+
+	TrackCursor srcCursor, dstCursor;
+	auto positionEased = [&](float t) {
+		for (int c = ChannelPosX; c <= ChannelPosZ; c++) {
+			if (easedAt(src.channels[c], t) || easedAt(dst.channels[c], t)) return true;
+		}
+		return false;
+	};
+	auto rotationEased = [&](float t) {
+		for (int c = ChannelRotX; c <= ChannelRotZ; c++) {
+			if (easedAt(src.channels[c], t) || easedAt(dst.channels[c], t)) return true;
+		}
+		return easedAt(src.quatChannel, t) || easedAt(dst.quatChannel, t);
+	};
+	positionError = maxErrorBetween(breaks, positionEased, [&](float t) {
+		return glm::length(src.sample(t, srcCursor).position - dst.sample(t, dstCursor, bSlerp).position);
+	});
+	rotationError = maxErrorBetween(breaks, rotationEased, [&](float t) {
+		TrackSample a = src.sample(t, srcCursor);
+		TrackSample b = dst.sample(t, dstCursor, bSlerp);
+		glm::quat qa = src.bQuatRotation ? src.quatChannel.sample(t, bSlerp) : eulerToQuat(a.rotation);
+		glm::quat qb = dst.bQuatRotation ? b.orientation : eulerToQuat(b.rotation);
+		return rotationAngle(glm::normalize(qa), qb);
+	});
+}
+
+// Tolerances are split over the curves so that they hold for the joint:
+// three position errors of d add up to at most sqrt(3) d, and three euler
+// angle errors to at most their sum.
+//
+void CompressedClip::compress(const Timeline &timeline, const ClipCompressionSettings &settings, ClipCompressionReport *report) {
+	int n = timeline.size();
+	bSlerp = timeline.bSlerp;
+	tracks.assign(n, CompressedTrack());
+	float positionTolerance = settings.positionTolerance / std::sqrt(3.0f);
+	float eulerTolerance = settings.rotationTolerance / 3;
+
+	std::vector<float> positionError(n, 0), rotationError(n, 0);
+	parallelFor(0, n, 1, [&](int b, int e) {
+		for (int i = b; i < e; i++) {
+			const AnimTrack &src = timeline.tracks[i];
+			CompressedTrack &dst = tracks[i];
+			for (int a = 0; a < 3; a++) {
+				compressCurve(src.channels[ChannelPosX + a], positionTolerance, dst.channels[ChannelPosX + a]);
+				compressCurve(src.channels[ChannelRotX + a], eulerTolerance, dst.channels[ChannelRotX + a]);
+			}
+			dst.bQuatRotation = src.bQuatRotation;
+			compressQuatCurve(src.quatChannel, settings.rotationTolerance, bSlerp, dst.quatChannel);
+			if (report) measureError(src, dst, bSlerp, positionError[i], rotationError[i]);
+		}
+	});
+
+	if (!report) return;
+	*report = ClipCompressionReport();
+	report->positionError = positionError;
+	report->rotationError = rotationError;
+	report->compressedBytes = byteSize();
+	for (int i = 0; i < n; i++) {
+		const AnimTrack &src = timeline.tracks[i];
+		report->rawBytes += rawBytes(src);
+		report->rawKeys += src.quatChannel.keyCount();
+		report->keptKeys += tracks[i].quatChannel.keyCount();
+		for (int c = 0; c < ChannelCount; c++) {
+			report->rawKeys += src.channels[c].keyCount();
+			report->keptKeys += tracks[i].channels[c].keyCount();
+		}
+	}
+}
+
+size_t CompressedClip::byteSize() const {
+	size_t bytes = 0;
+	for (int i = 0; i < tracks.size(); i++) bytes += tracks[i].byteSize();
+	return bytes;
+}
+
+// gather, one batched blend, scatter - as in Timeline::sampleFrame()
+//
+float CompressedClip::startTime() const {
+	bool bAny = false;
+	float t = 0;
+	for (int i = 0; i < tracks.size(); i++) {
+		for (int c = 0; c <= ChannelCount; c++) {
+			const QuantizedTimes &curve = (c == ChannelCount ? (const QuantizedTimes &)tracks[i].quatChannel : tracks[i].channels[c]);
+			if (curve.keyCount() == 0) continue;
+			t = bAny ? std::min(t, curve.keyTime(0)) : curve.keyTime(0);
+			bAny = true;
+		}
+	}
+	return t;
+}
+
+float CompressedClip::endTime() const {
+	bool bAny = false;
+	float t = 0;
+	for (int i = 0; i < tracks.size(); i++) {
+		for (int c = 0; c <= ChannelCount; c++) {
+			const QuantizedTimes &curve = (c == ChannelCount ? (const QuantizedTimes &)tracks[i].quatChannel : tracks[i].channels[c]);
+			if (curve.keyCount() == 0) continue;
+			float end = curve.keyTime(curve.keyCount() - 1);
+			t = bAny ? std::max(t, end) : end;
+			bAny = true;
+		}
+	}
+	return t;
+}
+
+void CompressedClip::sample(float t, std::vector<TrackSample> &out, std::vector<TrackCursor> &cursors) const {
+	out.resize(tracks.size());
+	cursors.resize(tracks.size());
+	sample(t, out.data(), cursors.data());
+}
+
+void CompressedClip::sample(float t, TrackSample *out, TrackCursor *cursors) const {
+	static thread_local std::vector<int> batchTracks;
+	static thread_local std::vector<glm::quat> from, to, result;
+	static thread_local std::vector<float> blend;
+	batchTracks.clear();
+	from.clear();
+	to.clear();
+	blend.clear();
+
+	for (int i = 0; i < tracks.size(); i++) {
+		const CompressedTrack &track = tracks[i];
+		if (!track.bQuatRotation) {
+			out[i] = track.sample(t, cursors[i], bSlerp);
+			continue;
+		}
+		for (int a = 0; a < 3; a++) {
+			out[i].position[a] = track.channels[ChannelPosX + a].sample(t, cursors[i].keys[ChannelPosX + a]);
+		}
+		glm::quat qa, qb;
+		float u;
+		track.quatChannel.segment(t, cursors[i].quatKey, qa, qb, u);
+		batchTracks.push_back(i);
+		from.push_back(qa);
+		to.push_back(qb);
+		blend.push_back(u);
+	}
+
+	int n = (int)batchTracks.size();
+	if (n == 0) return;
+	result.resize(n);
+	if (bSlerp) slerpBatch(from.data(), to.data(), blend.data(), result.data(), n);
+	else nlerpBatch(from.data(), to.data(), blend.data(), result.data(), n);
+	for (int k = 0; k < n; k++) out[batchTracks[k]].orientation = result[k];
+}
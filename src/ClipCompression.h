@@ -0,0 +1,136 @@
+//
+//  ClipCompression.h - Lossy compression of Timeline clips
+//
+//  Every curve is quantized first: key times and values become 16 bit
+//  steps of the curve's own time and value range, quaternion keys are
+//  stored smallest-three (the largest component is dropped and rebuilt
+//  from the other three, 15 bits each).  Keys are then removed greedily:
+//  from each kept key the segment is stretched over as many following
+//  keys as the quantized end points still reproduce within tolerance at
+//  every original key time, its own end points included, and for eased
+//  segments everywhere in between.
+//
+//  The result is then compared with the source between every two key
+//  times of either, with the peak inside each stretch searched for, not
+//  only at the keys.  Where 16 bits can't hold the tolerance - values
+//  whose step is coarser than it, or times too coarse for a steep curve -
+//  the curve keeps raw floats instead, times first, then every key, then
+//  the source values.  So the tolerance bounds the error of what is
+//  actually stored at any time, quantization included.
+//
+//  A CompressedClip samples like a Timeline, decoding the two keys around
+//  t of each curve on the fly.  Only depends on glm.
+//
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Timeline.h"
+
+struct ClipCompressionSettings {
+	float positionTolerance = 0.001f;   // max distance of a joint from its source position
+	float rotationTolerance = 0.1f;     // max angle (degrees) between source and compressed rotation
+};
+
+// sizes, and the largest error of every track over the whole clip (see above)
+//
+struct ClipCompressionReport {
+	size_t rawBytes = 0;
+	size_t compressedBytes = 0;
+	int rawKeys = 0;
+	int keptKeys = 0;
+	std::vector<float> positionError;    // per track
+	std::vector<float> rotationError;    // per track, degrees
+
+	float ratio() const { return compressedBytes ? (float)rawBytes / compressedBytes : 0; }
+	float maxPositionError() const;
+	float maxRotationError() const;
+};
+
+// quantized key times shared by both curve types: time = startTime + q * timeStep,
+// or the source times in rawTimes where 16 bit steps would break the tolerance
+//
+struct QuantizedTimes {
+	float startTime = 0;
+	float timeStep = 0;
+	std::vector<uint16_t> times;
+	std::vector<float> rawTimes;
+	std::vector<AnimInterp> interps;
+
+	int keyCount() const { return (int)interps.size(); }
+	float keyTime(int i) const { return rawTimes.empty() ? startTime + times[i] * timeStep : rawTimes[i]; }
+	size_t timeBytes() const;
+
+	// segment holding t (cursor as in AnimCurve) and the blend factor in it
+	//
+	int findSegment(float t, int &cursor, float &u) const;
+};
+
+class CompressedCurve : public QuantizedTimes {
+public:
+	float sample(float t, int &cursor) const;
+	float keyValue(int i) const { return rawValues.empty() ? minValue + values[i] * valueStep : rawValues[i]; }
+	size_t byteSize() const;
+
+	// value = minValue + q * valueStep, or rawValues where the step is
+	// coarser than the tolerance
+	//
+	float minValue = 0;
+	float valueStep = 0;
+	std::vector<uint16_t> values;
+	std::vector<float> rawValues;
+};
+
+class CompressedQuatCurve : public QuantizedTimes {
+public:
+	glm::quat sample(float t, int &cursor, bool bSlerp) const;
+	glm::quat keyValue(int i) const { return rawValues.empty() ? decode(&values[3 * i]) : rawValues[i]; }
+
+	// the keys around t and the blend factor, for batched blending
+	//
+	void segment(float t, int &cursor, glm::quat &a, glm::quat &b, float &u) const;
+
+	size_t byteSize() const;
+
+	// smallest-three in 48 bits: the top bits of the first two words say
+	// which component was dropped
+	//
+	static void encode(const glm::quat &q, uint16_t *out);
+	static glm::quat decode(const uint16_t *in);
+
+	std::vector<uint16_t> values;   // three per key
+	std::vector<glm::quat> rawValues;  // instead, where 15 bits break the tolerance
+};
+
+struct CompressedTrack {
+	CompressedCurve channels[ChannelCount];
+	bool bQuatRotation = false;
+	CompressedQuatCurve quatChannel;
+
+	TrackSample sample(float t, TrackCursor &cursor, bool bSlerp) const;
+	size_t byteSize() const;
+};
+
+class CompressedClip {
+public:
+
+	// compress every track of the timeline, report may be NULL
+	//
+	void compress(const Timeline &timeline, const ClipCompressionSettings &settings, ClipCompressionReport *report = NULL);
+
+	// same as Timeline::sample(), quaternion tracks are blended in one batch
+	//
+	void sample(float t, std::vector<TrackSample> &out, std::vector<TrackCursor> &cursors) const;
+	void sample(float t, TrackSample *out, TrackCursor *cursors) const;
+
+	// time span covered by the kept keys, 0 to 0 when there are none
+	//
+	float startTime() const;
+	float endTime() const;
+
+	int size() const { return (int)tracks.size(); }
+	size_t byteSize() const;
+
+	std::vector<CompressedTrack> tracks;
+	bool bSlerp = true;
+};
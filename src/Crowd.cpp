@@ -0,0 +1,114 @@
+//
+//  Crowd.cpp - Many animated instances of one skeleton
+//
+
+#include "Crowd.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+void Crowd::setRig(const PoseBuffer &rest) {
+	rig = rest;
+	fileJoints.clear();
+	clear();
+}
+
+void Crowd::setRig(const SkeletonFile &file) {
+	int n = (int)file.joints.size();
+	std::vector<int> parentOf(n);
+	for (int i = 0; i < n; i++) parentOf[i] = file.joints[i].parent;
+	std::vector<int> order = PoseBuffer::sortTopological(parentOf);
+
+	PoseBuffer rest;
+	rest.reserve((int)order.size());
+	std::vector<int> mapping(n, -1);
+	for (int k = 0; k < order.size(); k++) {
+		const JointDesc &joint = file.joints[order[k]];
+		mapping[order[k]] = k;
+		rest.addJoint(joint.parent < 0 ? -1 : mapping[joint.parent], joint.translation, joint.rotation);
+	}
+	setRig(rest);
+	fileJoints = mapping;
+}
+
+void Crowd::setClip(const Timeline *clip, const std::vector<int> &trackJoints) {
+	this->clip = clip;
+	compressedClip = NULL;
+	this->trackJoints = trackJoints;
+	cursors.assign((size_t)size() * clipTracks(), TrackCursor());
+}
+
+void Crowd::setClip(const CompressedClip *clip, const std::vector<int> &trackJoints) {
+	this->clip = NULL;
+	compressedClip = clip;
+	this->trackJoints = trackJoints;
+	cursors.assign((size_t)size() * clipTracks(), TrackCursor());
+}
+
+int Crowd::addInstance(const glm::mat4 &root, float time, float speed) {
+	int n = jointCount();
+	roots.push_back(root);
+	times.push_back(time);
+	speeds.push_back(speed);
+	translations.insert(translations.end(), rig.translations.begin(), rig.translations.end());
+	orientations.insert(orientations.end(), rig.orientations.begin(), rig.orientations.end());
+	worlds.resize(worlds.size() + n, glm::mat4(1.0));
+	cursors.resize(cursors.size() + clipTracks());
+	return size() - 1;
+}
+
+void Crowd::clear() {
+	roots.clear();
+	times.clear();
+	speeds.clear();
+	translations.clear();
+	orientations.clear();
+	worlds.clear();
+	cursors.clear();
+}
+
+// Joints the clip doesn't drive keep whatever they were set to (the rest
+// pose unless changed from outside).
+//
+void Crowd::evaluateInstance(int k, float dt, float start, float length, std::vector<TrackSample> &samples) {
+	int n = jointCount();
+	glm::vec3 *t = &translations[(size_t)k * n];
+	glm::quat *r = &orientations[(size_t)k * n];
+
+	int nTracks = clipTracks();
+	if (nTracks > 0) {
+		float time = times[k] + dt * speeds[k];
+		if (length > 0) time = start + std::fmod(std::fmod(time - start, length) + length, length);
+		times[k] = time;
+
+		samples.resize(nTracks);
+		if (compressedClip) compressedClip->sample(time, samples.data(), &cursors[(size_t)k * nTracks]);
+		else clip->sample(time, samples.data(), &cursors[(size_t)k * nTracks]);
+		for (int i = 0; i < nTracks; i++) {
+			int j = trackJoints.empty() ? i : trackJoints[i];
+			if (j < 0 || j >= n) continue;
+			bool bQuat = compressedClip ? compressedClip->tracks[i].bQuatRotation : clip->tracks[i].bQuatRotation;
+			t[j] = samples[i].position;
+			r[j] = bQuat ? samples[i].orientation : eulerToQuat(samples[i].rotation);
+		}
+	}
+
+	PoseBuffer::computeWorld(n, rig.parents.data(), t, r, rig.scales.data(), rig.pivots.data(),
+		&worlds[(size_t)k * n], roots[k]);
+}
+
+void Crowd::update(float dt) {
+	float start = 0, length = 0;
+	if (compressedClip) {
+		start = compressedClip->startTime();
+		length = compressedClip->endTime() - start;
+	}
+	else if (clip) {
+		start = clip->startTime();
+		length = clip->endTime() - start;
+	}
+	parallelFor(0, size(), grain, [&](int b, int e) {
+		static thread_local std::vector<TrackSample> samples;
+		for (int k = b; k < e; k++) evaluateInstance(k, dt, start, length, samples);
+	});
+}
@@ -0,0 +1,81 @@
+//
+//  Crowd.h - Many animated instances of one skeleton
+//
+//  Every instance shares the rig (joint hierarchy and rest pose, e.g. from
+//  model.txt) and the clip, and has its own clip time, playback speed,
+//  root transform and pose.  The poses of all instances live in a few
+//  big arrays, instance k at [k * jointCount(), (k + 1) * jointCount()).
+//
+//  update() samples the clip and runs the local to world pass of every
+//  instance on the work stealing pool (see ThreadPool.h), a few instances
+//  per task, so it scales with the cores.  The clip can also be a
+//  CompressedClip (see ClipCompression.h), so the clips of a big crowd
+//  take a fraction of the memory while they stay resident.  Only depends
+//  on glm.
+//
+#pragma once
+
+#include <vector>
+#include "ClipCompression.h"
+#include "Pose.h"
+#include "SkeletonFile.h"
+#include "Timeline.h"
+
+class Crowd {
+public:
+
+	// the shared skeleton.  A skeleton file is put in parent first order,
+	// fileJoints[i] is the rig joint of file joint i (-1 for joints in a
+	// parent loop, which are left out).  Removes all instances
+	//
+	void setRig(const PoseBuffer &rest);
+	void setRig(const SkeletonFile &file);
+
+	// clip played by every instance, track i driving rig joint trackJoints[i]
+	// (-1 for none, empty maps track i to joint i).  The clip loops
+	//
+	void setClip(const Timeline *clip, const std::vector<int> &trackJoints = std::vector<int>());
+	void setClip(const CompressedClip *clip, const std::vector<int> &trackJoints = std::vector<int>());
+
+	int addInstance(const glm::mat4 &root, float time = 0, float speed = 1);
+	void clear();
+
+	int size() const { return (int)times.size(); }
+	int jointCount() const { return rig.size(); }
+
+	// advance every instance by dt seconds, sample and evaluate its pose
+	//
+	void update(float dt);
+
+	// world matrices of an instance (valid after update())
+	//
+	const glm::mat4 *world(int instance) const { return &worlds[(size_t)instance * jointCount()]; }
+
+	PoseBuffer rig;
+	std::vector<int> fileJoints;
+
+	const Timeline *clip = NULL;
+	const CompressedClip *compressedClip = NULL;   // played instead of clip when set
+	std::vector<int> trackJoints;
+
+	// per instance
+	//
+	std::vector<glm::mat4> roots;
+	std::vector<float> times;
+	std::vector<float> speeds;
+
+	// per instance and joint (or track, for the cursors)
+	//
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> orientations;
+	std::vector<glm::mat4> worlds;
+	std::vector<TrackCursor> cursors;
+
+	// instances per task
+	//
+	int grain = 8;
+
+private:
+	int clipTracks() const { return compressedClip ? compressedClip->size() : (clip ? clip->size() : 0); }
+	void evaluateInstance(int k, float dt, float start, float length, std::vector<TrackSample> &samples);
+};
@@ -0,0 +1,54 @@
+//
+//  FrameArena.cpp - Bump allocator for per frame scratch memory
+//
+
+#include "FrameArena.h"
+#include <stdint.h>
+
+void *FrameArena::allocateBytes(size_t bytes, size_t align) {
+	if (!blocks.empty()) {
+		const Block &b = blocks.back();
+		uintptr_t base = (uintptr_t)b.data;
+		uintptr_t p = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+		if (p + bytes <= base + b.size) {
+			used += (p + bytes) - (base + offset);
+			offset = (size_t)(p + bytes - base);
+			return (void *)p;
+		}
+	}
+
+	// chain a block that at least doubles what we have, the next reset
+	// merges them
+	//
+	size_t size = blockSize;
+	if (!blocks.empty()) size = blocks.back().size * 2;
+	if (size < bytes + align) size = bytes + align;
+	Block b = { new char[size], size };
+	blocks.push_back(b);
+	offset = 0;
+	return allocateBytes(bytes, align);
+}
+
+void FrameArena::reset() {
+	if (blocks.size() > 1) {
+		size_t total = capacity();
+		release();
+		Block b = { new char[total], total };
+		blocks.push_back(b);
+	}
+	offset = 0;
+	used = 0;
+}
+
+void FrameArena::release() {
+	for (int i = 0; i < blocks.size(); i++) delete[] blocks[i].data;
+	blocks.clear();
+	offset = 0;
+	used = 0;
+}
+
+size_t FrameArena::capacity() const {
+	size_t total = 0;
+	for (int i = 0; i < blocks.size(); i++) total += blocks[i].size;
+	return total;
+}
@@ -0,0 +1,55 @@
+//
+//  FrameArena.h - Bump allocator for per frame scratch memory
+//
+//  allocate() hands out pieces of a large block by moving an offset;
+//  reset() at the end of the frame gives everything back at once.  When a
+//  frame needs more than the block holds, a further block is chained on,
+//  and the next reset() merges them into a single block big enough for
+//  the whole frame, so after the first few frames nothing is allocated any
+//  more.  Only for trivially destructible types, nothing is destructed.
+//  Not thread safe, use one arena per thread.
+//
+#pragma once
+
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+class FrameArena {
+public:
+	explicit FrameArena(size_t blockSize = 1 << 16) : blockSize(blockSize) {}
+	~FrameArena() { release(); }
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	// n uninitialized elements, aligned for SIMD loads (16 bytes at least)
+	//
+	template <class T>
+	T *allocate(size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+		return (T *)allocateBytes(n * sizeof(T), alignof(T) < 16 ? 16 : alignof(T));
+	}
+
+	// everything allocated since the last reset is invalid afterwards
+	//
+	void reset();
+
+	// free all blocks
+	//
+	void release();
+
+	size_t bytesUsed() const { return used; }
+	size_t capacity() const;
+
+private:
+	void *allocateBytes(size_t bytes, size_t align);
+
+	struct Block {
+		char *data;
+		size_t size;
+	};
+	std::vector<Block> blocks;    // allocations come from the last one
+	size_t offset = 0;            // into the last block
+	size_t used = 0;
+	size_t blockSize;
+};
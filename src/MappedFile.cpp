@@ -0,0 +1,103 @@
+//
+//  MappedFile.cpp - Read only memory mapped file
+//
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+	close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = NULL;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+
+	// an empty file can't be mapped, but is still a valid (empty) file
+	//
+	if (length > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		ptr = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (ptr == NULL) {
+			close();
+			return false;
+		}
+	}
+	bOpen = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (ptr) UnmapViewOfFile(ptr);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	ptr = NULL;
+	mapping = NULL;
+	file = NULL;
+	length = 0;
+	bOpen = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+	close();
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close();
+		return false;
+	}
+	length = (size_t)st.st_size;
+
+	// an empty file can't be mapped, but is still a valid (empty) file
+	//
+	if (length > 0) {
+		void *p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			close();
+			return false;
+		}
+		ptr = (const char *)p;
+		madvise(p, length, MADV_SEQUENTIAL);
+	}
+	bOpen = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (ptr) munmap((void *)ptr, length);
+	if (fd >= 0) ::close(fd);
+	ptr = NULL;
+	fd = -1;
+	length = 0;
+	bOpen = false;
+}
+
+#endif
@@ -0,0 +1,38 @@
+//
+//  MappedFile.h - Read only memory mapped file
+//
+//  The whole file is mapped into the address space; pages are loaded by the
+//  OS on first touch and shared with any other process mapping the same file.
+//
+#pragma once
+
+#include <string>
+#include <stddef.h>
+
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	bool open(const std::string &path);
+	void close();
+
+	bool isOpen() const { return bOpen; }
+	const char *data() const { return ptr; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile &);              // not copyable
+	MappedFile &operator=(const MappedFile &);
+
+	const char *ptr = NULL;
+	size_t length = 0;
+	bool bOpen = false;
+
+#ifdef _WIN32
+	void *file = NULL;
+	void *mapping = NULL;
+#else
+	int fd = -1;
+#endif
+};
@@ -0,0 +1,114 @@
+//
+//  MeshBvh.cpp - Ray queries against indexed triangle meshes
+//
+
+#include "MeshBvh.h"
+#include "Parallel.h"
+
+void MeshBvh::clear() {
+	bvh.clear();
+	v0.clear();
+	e1.clear();
+	e2.clear();
+	normals.clear();
+	indices.clear();
+}
+
+void MeshBvh::build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &idx,
+	const std::vector<glm::vec3> &vertexNormals) {
+
+	std::vector<glm::vec3> mins, maxs;
+	setup(positions, idx, vertexNormals, mins, maxs);
+	bvh.buildSAH(mins, maxs);
+}
+
+void MeshBvh::build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &idx,
+	const std::vector<glm::vec3> &vertexNormals, const BvhNode *nodes, int nodeCount, const int *items) {
+
+	std::vector<glm::vec3> mins, maxs;
+	setup(positions, idx, vertexNormals, mins, maxs);
+	if (!bvh.assign(nodes, nodeCount, items, mins, maxs)) bvh.buildSAH(mins, maxs);
+}
+
+// triangles and bounds, and the normals kept for hit normals
+//
+void MeshBvh::setup(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &idx,
+	const std::vector<glm::vec3> &vertexNormals, std::vector<glm::vec3> &mins, std::vector<glm::vec3> &maxs) {
+
+	clear();
+	int nTris = (int)idx.size() / 3;
+	setTriangles(positions, idx, mins, maxs);
+
+	if (vertexNormals.size() == positions.size()) {
+		normals = vertexNormals;
+		indices.assign(idx.begin(), idx.begin() + 3 * nTris);
+	}
+}
+
+void MeshBvh::refit(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &idx,
+	const std::vector<glm::vec3> &vertexNormals) {
+
+	std::vector<glm::vec3> mins, maxs;
+	setTriangles(positions, idx, mins, maxs);
+	bvh.refit(mins, maxs);
+	if (vertexNormals.size() == positions.size() && vertexNormals.size() == normals.size()) normals = vertexNormals;
+}
+
+// per triangle vertex/edges and bounds
+//
+void MeshBvh::setTriangles(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &idx,
+	std::vector<glm::vec3> &mins, std::vector<glm::vec3> &maxs) {
+
+	int nTris = (int)idx.size() / 3;
+	v0.resize(nTris);
+	e1.resize(nTris);
+	e2.resize(nTris);
+	mins.resize(nTris);
+	maxs.resize(nTris);
+
+	parallelFor(0, nTris, 1 << 14, [&](int b, int e) {
+		for (int f = b; f < e; f++) {
+			const glm::vec3 &p0 = positions[idx[3 * f]];
+			const glm::vec3 &p1 = positions[idx[3 * f + 1]];
+			const glm::vec3 &p2 = positions[idx[3 * f + 2]];
+			v0[f] = p0;
+			e1[f] = p1 - p0;
+			e2[f] = p2 - p0;
+			mins[f] = glm::min(p0, glm::min(p1, p2));
+			maxs[f] = glm::max(p0, glm::max(p1, p2));
+		}
+	});
+}
+
+bool MeshBvh::closestHit(const glm::vec3 &o, const glm::vec3 &d, MeshHit &hit, float tMax) const {
+	float tBest = tMax;
+	float bu = 0, bv = 0;
+	int face = bvh.closestHit(o, d, tBest, [&](int f, float &tCur) {
+		float t, u, v;
+		if (!intersectTriangle(o, d, v0[f], e1[f], e2[f], tCur, t, u, v)) return false;
+		tCur = t;
+		bu = u;
+		bv = v;
+		return true;
+	});
+	if (face < 0) return false;
+
+	hit.t = tBest;
+	hit.u = bu;
+	hit.v = bv;
+	hit.face = face;
+	hit.point = o + d * tBest;
+	if (!normals.empty()) {
+		hit.normal = glm::normalize(normals[indices[3 * face]] * (1 - bu - bv) +
+			normals[indices[3 * face + 1]] * bu + normals[indices[3 * face + 2]] * bv);
+	}
+	else hit.normal = glm::normalize(glm::cross(e1[face], e2[face]));
+	return true;
+}
+
+bool MeshBvh::anyHit(const glm::vec3 &o, const glm::vec3 &d, float tMax) const {
+	return bvh.anyHit(o, d, tMax, [&](int f, float tLimit) {
+		float t, u, v;
+		return intersectTriangle(o, d, v0[f], e1[f], e2[f], tLimit, t, u, v);
+	}) >= 0;
+}
@@ -0,0 +1,93 @@
+//
+//  MeshBvh.h - Ray queries against indexed triangle meshes
+//
+//  Builds an SAH BVH (see Bvh.h) over the triangles of a mesh and answers
+//  closest hit and any hit queries.  Triangles are stored as a vertex and
+//  two edges so the Moller-Trumbore test needs no extra loads.  Only
+//  depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "Bvh.h"
+
+struct MeshHit {
+	float t = 0;          // ray parameter, point = o + t * d
+	float u = 0, v = 0;   // barycentrics of the hit: p = (1 - u - v) * p0 + u * p1 + v * p2
+	int face = -1;        // triangle index
+	glm::vec3 point;
+	glm::vec3 normal;     // interpolated vertex normal, or the face normal if the mesh has none
+};
+
+class MeshBvh {
+public:
+
+	// indices hold three entries per triangle.  normals are optional
+	// (one per vertex) and only used to interpolate hit normals
+	//
+	void build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+		const std::vector<glm::vec3> &normals = std::vector<glm::vec3>());
+
+	// same, with a tree built earlier for the same triangles (see MeshCache).
+	// falls back to building one if the tree doesn't match
+	//
+	void build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+		const std::vector<glm::vec3> &normals, const BvhNode *nodes, int nodeCount, const int *items);
+
+	// move the triangles to new vertex positions (same vertices and indices
+	// as the build, e.g. a skinned pose) and refit the tree around them.  The
+	// topology is kept, so this is much cheaper than a build but traces more
+	// slowly the further the mesh gets from the pose it was built in
+	//
+	void refit(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+		const std::vector<glm::vec3> &normals = std::vector<glm::vec3>());
+
+	void clear();
+	bool empty() const { return bvh.empty(); }
+	int triangleCount() const { return (int)v0.size(); }
+
+	// closest triangle hit in (0, tMax)
+	//
+	bool closestHit(const glm::vec3 &o, const glm::vec3 &d, MeshHit &hit, float tMax = 1e30f) const;
+
+	// true if any triangle is hit in (0, tMax)
+	//
+	bool anyHit(const glm::vec3 &o, const glm::vec3 &d, float tMax = 1e30f) const;
+
+	// Moller-Trumbore ray/triangle test
+	//
+	static bool intersectTriangle(const glm::vec3 &o, const glm::vec3 &d,
+		const glm::vec3 &p0, const glm::vec3 &e1, const glm::vec3 &e2, float tMax, float &t, float &u, float &v) {
+
+		glm::vec3 pv = glm::cross(d, e2);
+		float det = glm::dot(e1, pv);
+		if (det > -1e-12f && det < 1e-12f) return false;    // parallel to the triangle
+		float inv = 1.0f / det;
+		glm::vec3 tv = o - p0;
+		u = glm::dot(tv, pv) * inv;
+		if (u < 0 || u > 1) return false;
+		glm::vec3 qv = glm::cross(tv, e1);
+		v = glm::dot(d, qv) * inv;
+		if (v < 0 || u + v > 1) return false;
+		t = glm::dot(e2, qv) * inv;
+		return (t > 0 && t < tMax);
+	}
+
+	Bvh bvh;
+
+	// per triangle
+	//
+	std::vector<glm::vec3> v0, e1, e2;
+
+	// kept to interpolate normals
+	//
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> indices;
+
+private:
+	void setup(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+		const std::vector<glm::vec3> &normals, std::vector<glm::vec3> &mins, std::vector<glm::vec3> &maxs);
+	void setTriangles(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices,
+		std::vector<glm::vec3> &mins, std::vector<glm::vec3> &maxs);
+};
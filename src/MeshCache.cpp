@@ -0,0 +1,255 @@
+//
+//  MeshCache.cpp - Binary mesh cache written next to a source model
+//
+
+#include "MeshCache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+
+static const char cacheMagic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+static const uint64_t sectionAlign = 64;
+
+static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::vec2) == 8, "packed glm vectors expected");
+static_assert(sizeof(BvhNode) == 32, "BvhNode layout is part of the file format");
+static_assert(sizeof(MeshCacheLod) == 8, "MeshCacheLod layout is part of the file format");
+
+// more levels than any settings would make; anything past it is damage
+//
+static const uint32_t maxLods = 64;
+
+static uint64_t alignUp(uint64_t n) { return (n + sectionAlign - 1) & ~(sectionAlign - 1); }
+
+std::string MeshCache::cachePath(const std::string &sourcePath) {
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::stamp(const std::string &path, uint64_t &size, int64_t &time) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0) return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+#endif
+	size = (uint64_t)st.st_size;
+	time = (int64_t)st.st_mtime;
+	return true;
+}
+
+// FNV-1a, 64 bit
+//
+bool MeshCache::hash(const std::string &path, uint64_t &h) {
+	MappedFile source;
+	if (!source.open(path)) return false;
+	h = 14695981039346656037ULL;
+	const unsigned char *p = (const unsigned char *)source.data();
+	for (size_t i = 0; i < source.size(); i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return true;
+}
+
+// write bytes followed by zero padding up to the next section
+//
+static bool writeSection(FILE *f, const void *data, uint64_t bytes) {
+	static const char zeros[sectionAlign] = { 0 };
+	if (bytes && fwrite(data, 1, bytes, f) != bytes) return false;
+	uint64_t pad = alignUp(bytes) - bytes;
+	return pad == 0 || fwrite(zeros, 1, pad, f) == pad;
+}
+
+bool MeshCache::write(const std::string &sourcePath, const MeshData &mesh, const Bvh *bvh, const MeshLod *lod) {
+	MeshCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, cacheMagic, sizeof(h.magic));
+	h.version = version;
+	h.headerSize = sizeof(MeshCacheHeader);
+	if (!stamp(sourcePath, h.sourceSize, h.sourceTime) || !hash(sourcePath, h.sourceHash)) return false;
+
+	bool bNormals = mesh.normals.size() == mesh.positions.size() && !mesh.normals.empty();
+	bool bTexCoords = mesh.texCoords.size() == mesh.positions.size() && !mesh.texCoords.empty();
+	bool bBvh = bvh && !bvh->empty() && bvh->size() == mesh.triangleCount();
+	bool bLod = lod && !lod->levels.empty() && lod->levels.size() <= maxLods;
+
+	h.vertexCount = (uint32_t)mesh.positions.size();
+	h.indexCount = (uint32_t)mesh.indices.size();
+	h.nodeCount = bBvh ? (uint32_t)bvh->nodes.size() : 0;
+	h.lodCount = bLod ? (uint32_t)lod->levels.size() : 0;
+	glm::vec3 min(0, 0, 0), max(0, 0, 0);
+	mesh.getBounds(min, max);
+	for (int a = 0; a < 3; a++) {
+		h.boundsMin[a] = min[a];
+		h.boundsMax[a] = max[a];
+		h.lodCenter[a] = lod ? lod->center[a] : 0;
+	}
+	h.lodRadius = lod ? lod->radius : 0;
+
+	std::vector<MeshCacheLod> lodTable(h.lodCount);
+	uint64_t lodIndexCount = 0;
+	for (uint32_t i = 0; i < h.lodCount; i++) {
+		lodTable[i].indexCount = (uint32_t)lod->levels[i].indices.size();
+		lodTable[i].error = lod->levels[i].error;
+		lodIndexCount += lodTable[i].indexCount;
+	}
+
+	uint64_t offset = alignUp(sizeof(MeshCacheHeader));
+	h.positions = offset;
+	offset += alignUp(h.vertexCount * sizeof(glm::vec3));
+	if (bNormals) {
+		h.normals = offset;
+		offset += alignUp(h.vertexCount * sizeof(glm::vec3));
+	}
+	if (bTexCoords) {
+		h.texCoords = offset;
+		offset += alignUp(h.vertexCount * sizeof(glm::vec2));
+	}
+	h.indices = offset;
+	offset += alignUp(h.indexCount * sizeof(unsigned int));
+	if (bBvh) {
+		h.nodes = offset;
+		offset += alignUp(h.nodeCount * sizeof(BvhNode));
+		h.items = offset;
+		offset += alignUp(h.indexCount / 3 * sizeof(int));
+	}
+	if (bLod) {
+		h.lods = offset;
+		offset += alignUp(h.lodCount * sizeof(MeshCacheLod));
+		h.lodIndices = offset;
+	}
+
+	std::string path = cachePath(sourcePath);
+	std::string tmpPath = path + ".tmp";
+	FILE *f = fopen(tmpPath.c_str(), "wb");
+	if (!f) return false;
+
+	bool bOk = writeSection(f, &h, sizeof(h)) &&
+		writeSection(f, mesh.positions.data(), h.vertexCount * sizeof(glm::vec3)) &&
+		(!bNormals || writeSection(f, mesh.normals.data(), h.vertexCount * sizeof(glm::vec3))) &&
+		(!bTexCoords || writeSection(f, mesh.texCoords.data(), h.vertexCount * sizeof(glm::vec2))) &&
+		writeSection(f, mesh.indices.data(), h.indexCount * sizeof(unsigned int)) &&
+		(!bBvh || writeSection(f, bvh->nodes.data(), h.nodeCount * sizeof(BvhNode))) &&
+		(!bBvh || writeSection(f, bvh->items.data(), bvh->items.size() * sizeof(int))) &&
+		(!bLod || writeSection(f, lodTable.data(), h.lodCount * sizeof(MeshCacheLod)));
+	for (uint32_t i = 0; i < h.lodCount && bOk; i++) {
+		const std::vector<unsigned int> &levelIndices = lod->levels[i].indices;
+		bOk = levelIndices.empty() || fwrite(levelIndices.data(), sizeof(unsigned int), levelIndices.size(), f) == levelIndices.size();
+	}
+	bOk = (fclose(f) == 0) && bOk;
+
+	// rename() won't replace an existing file on Windows
+	//
+	if (bOk) {
+		remove(path.c_str());
+		bOk = rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+	if (!bOk) remove(tmpPath.c_str());
+	return bOk;
+}
+
+// true if [offset, offset + bytes) lies inside the file
+//
+static bool inFile(uint64_t offset, uint64_t bytes, uint64_t fileSize, bool bRequired) {
+	if (offset == 0) return !bRequired;
+	return offset % sectionAlign == 0 && offset <= fileSize && bytes <= fileSize - offset;
+}
+
+bool MeshCache::open(const std::string &sourcePath) {
+	close();
+	uint64_t size;
+	int64_t time;
+	if (!stamp(sourcePath, size, time)) return false;
+	if (!file.open(cachePath(sourcePath))) return false;
+
+	const MeshCacheHeader *h = (const MeshCacheHeader *)file.data();
+	uint64_t fileSize = file.size();
+	bool bValid = fileSize >= sizeof(MeshCacheHeader) &&
+		memcmp(h->magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+		h->version == version && h->headerSize == sizeof(MeshCacheHeader);
+
+	// the source has changed unless its size matches and either its time or
+	// (after a touch or a copy) its contents match
+	//
+	if (bValid) bValid = h->sourceSize == size;
+	if (bValid && h->sourceTime != time) {
+		uint64_t sourceHash;
+		bValid = hash(sourcePath, sourceHash) && sourceHash == h->sourceHash;
+	}
+
+	// sections inside the file; a broken cache is treated like a stale one
+	//
+	if (bValid) {
+		uint64_t nTris = h->indexCount / 3;
+		bValid = h->indexCount % 3 == 0 &&
+			inFile(h->positions, h->vertexCount * (uint64_t)sizeof(glm::vec3), fileSize, true) &&
+			inFile(h->normals, h->vertexCount * (uint64_t)sizeof(glm::vec3), fileSize, false) &&
+			inFile(h->texCoords, h->vertexCount * (uint64_t)sizeof(glm::vec2), fileSize, false) &&
+			inFile(h->indices, h->indexCount * (uint64_t)sizeof(unsigned int), fileSize, true) &&
+			(h->nodeCount == 0 || (h->nodeCount <= 2 * nTris - 1 &&
+				inFile(h->nodes, h->nodeCount * (uint64_t)sizeof(BvhNode), fileSize, true) &&
+				inFile(h->items, nTris * sizeof(int), fileSize, true)));
+	}
+	if (bValid) {
+		const unsigned int *idx = (const unsigned int *)(file.data() + h->indices);
+		for (uint32_t i = 0; i < h->indexCount && bValid; i++) bValid = idx[i] < h->vertexCount;
+	}
+
+	// levels of detail: whole triangles, finite errors, every index in range
+	//
+	if (bValid && h->lodCount > 0) {
+		bValid = h->lodCount <= maxLods && inFile(h->lods, h->lodCount * sizeof(MeshCacheLod), fileSize, true) &&
+			std::isfinite(h->lodRadius);
+		const MeshCacheLod *table = (const MeshCacheLod *)(file.data() + h->lods);
+		uint64_t lodIndexCount = 0;
+		for (uint32_t i = 0; i < h->lodCount && bValid; i++) {
+			bValid = table[i].indexCount % 3 == 0 && std::isfinite(table[i].error);
+			lodIndexCount += table[i].indexCount;
+		}
+		bValid = bValid && inFile(h->lodIndices, lodIndexCount * sizeof(unsigned int), fileSize, true);
+		if (bValid) {
+			const unsigned int *idx = (const unsigned int *)(file.data() + h->lodIndices);
+			for (uint64_t i = 0; i < lodIndexCount && bValid; i++) bValid = idx[i] < h->vertexCount;
+		}
+	}
+
+	if (!bValid) {
+		file.close();
+		return false;
+	}
+	header = h;
+	return true;
+}
+
+bool MeshCache::getBounds(glm::vec3 &min, glm::vec3 &max) const {
+	if (header->vertexCount == 0) return false;
+	min = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+	max = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+	return true;
+}
+
+void MeshCache::getLod(MeshLod &lod) const {
+	lod.center = glm::vec3(header->lodCenter[0], header->lodCenter[1], header->lodCenter[2]);
+	lod.radius = header->lodRadius;
+	lod.levels.assign(header->lodCount, LodLevel());
+	for (int i = 0; i < lod.levels.size(); i++) lod.levels[i].error = lodTable()[i].error;
+}
+
+const unsigned int *MeshCache::lodIndices(int level) const {
+	const unsigned int *p = (const unsigned int *)section(header->lodIndices);
+	for (int i = 0; i < level; i++) p += lodTable()[i].indexCount;
+	return p;
+}
+
+void MeshCache::copyTo(MeshData &mesh) const {
+	int n = vertexCount();
+	mesh.positions.assign(positions(), positions() + n);
+	if (normals()) mesh.normals.assign(normals(), normals() + n);
+	else mesh.normals.clear();
+	if (texCoords()) mesh.texCoords.assign(texCoords(), texCoords() + n);
+	else mesh.texCoords.clear();
+	mesh.indices.assign(indices(), indices() + indexCount());
+}
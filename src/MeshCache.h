@@ -0,0 +1,119 @@
+//
+//  MeshCache.h - Binary mesh cache written next to a source model
+//
+//  Layout (little endian, every section aligned to 64 bytes):
+//
+//    MeshCacheHeader
+//    positions    vertexCount x 3 floats
+//    normals      vertexCount x 3 floats     (optional)
+//    texCoords    vertexCount x 2 floats     (optional)
+//    indices      indexCount unsigned ints
+//    bvh nodes    nodeCount BvhNodes         (optional)
+//    bvh items    triangleCount ints         (with the nodes)
+//    lod table    lodCount MeshCacheLods     (optional)
+//    lod indices  every level's indices      (with the table, level after level)
+//
+//  A cache is opened by mapping it, so the arrays are used in place and the
+//  pages are shared by every process that has the same asset open.  It
+//  records the size, modification time and a 64 bit FNV-1a hash of the
+//  source file; it is stale when the size differs, or when the time differs
+//  and the contents hash differently.  Only depends on glm.
+//
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include "MappedFile.h"
+#include "MeshData.h"
+#include "MeshLod.h"
+#include "Bvh.h"
+
+struct MeshCacheHeader {
+	char magic[8];           // "MESHCACH"
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint64_t sourceSize;
+	int64_t sourceTime;      // seconds since the epoch
+	uint64_t sourceHash;
+
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t nodeCount;      // 0 when there is no bvh
+	uint32_t lodCount;       // levels of detail past the full mesh
+
+	float boundsMin[3];
+	float boundsMax[3];
+	float lodCenter[3];      // MeshLod bounding sphere
+	float lodRadius;
+
+	// byte offsets from the start of the file, 0 for absent sections
+	uint64_t positions, normals, texCoords, indices, nodes, items, lods, lodIndices;
+};
+
+struct MeshCacheLod {
+	uint32_t indexCount;
+	float error;
+};
+
+class MeshCache {
+public:
+	static const uint32_t version = 2;
+
+	// where the cache of a source file lives: "model.obj" -> "model.obj.meshcache"
+	//
+	static std::string cachePath(const std::string &sourcePath);
+
+	// write the cache of sourcePath.  The file is written under a temporary
+	// name and renamed, so a reader never sees a partial cache.  bvh and lod
+	// are optional
+	//
+	static bool write(const std::string &sourcePath, const MeshData &mesh, const Bvh *bvh = NULL, const MeshLod *lod = NULL);
+
+	// map the cache of sourcePath; false if it is missing, damaged or stale
+	//
+	bool open(const std::string &sourcePath);
+	void close() { file.close(); header = NULL; }
+	bool isOpen() const { return header != NULL; }
+
+	// views into the mapping, valid while the cache is open
+	//
+	int vertexCount() const { return header->vertexCount; }
+	int indexCount() const { return header->indexCount; }
+	const glm::vec3 *positions() const { return (const glm::vec3 *)section(header->positions); }
+	const glm::vec3 *normals() const { return (const glm::vec3 *)section(header->normals); }
+	const glm::vec2 *texCoords() const { return (const glm::vec2 *)section(header->texCoords); }
+	const unsigned int *indices() const { return (const unsigned int *)section(header->indices); }
+
+	bool hasBvh() const { return header->nodeCount > 0; }
+	int nodeCount() const { return header->nodeCount; }
+	const BvhNode *nodes() const { return (const BvhNode *)section(header->nodes); }
+	const int *items() const { return (const int *)section(header->items); }
+
+	// levels of detail past the full mesh.  getLod() fills in the errors and
+	// the bounding sphere, for MeshLod::select(); the index lists are left
+	// empty and stay in the mapping, see lodIndices()
+	//
+	int lodCount() const { return header->lodCount; }
+	void getLod(MeshLod &lod) const;
+	const unsigned int *lodIndices(int level) const;
+	int lodIndexCount(int level) const { return lodTable()[level].indexCount; }
+
+	bool getBounds(glm::vec3 &min, glm::vec3 &max) const;
+
+	// copy the geometry out into plain arrays
+	//
+	void copyTo(MeshData &mesh) const;
+
+	// size, modification time and hash of a file; false if it can't be read
+	//
+	static bool stamp(const std::string &path, uint64_t &size, int64_t &time);
+	static bool hash(const std::string &path, uint64_t &h);
+
+private:
+	const char *section(uint64_t offset) const { return offset ? file.data() + offset : NULL; }
+	const MeshCacheLod *lodTable() const { return (const MeshCacheLod *)section(header->lods); }
+
+	MappedFile file;
+	const MeshCacheHeader *header = NULL;
+};
@@ -0,0 +1,52 @@
+//
+//  MeshData.cpp - Indexed triangle mesh in plain arrays
+//
+
+#include "MeshData.h"
+#include "Parallel.h"
+
+void MeshData::clear() {
+	positions.clear();
+	normals.clear();
+	texCoords.clear();
+	indices.clear();
+}
+
+void MeshData::computeNormals() {
+	int nTris = triangleCount();
+	std::vector<glm::vec3> faceNormals(nTris);
+	parallelFor(0, nTris, 1 << 14, [&](int b, int e) {
+		for (int f = b; f < e; f++) {
+			const glm::vec3 &p0 = positions[indices[3 * f]];
+			glm::vec3 n = glm::cross(positions[indices[3 * f + 1]] - p0, positions[indices[3 * f + 2]] - p0);
+			float len = glm::length(n);
+			faceNormals[f] = (len > 0 ? n / len : glm::vec3(0, 0, 0));
+		}
+	});
+
+	// scatter is cheap next to the cross products, keep it serial
+	//
+	normals.assign(positions.size(), glm::vec3(0, 0, 0));
+	for (int f = 0; f < nTris; f++) {
+		normals[indices[3 * f]] += faceNormals[f];
+		normals[indices[3 * f + 1]] += faceNormals[f];
+		normals[indices[3 * f + 2]] += faceNormals[f];
+	}
+
+	parallelFor(0, (int)normals.size(), 1 << 14, [&](int b, int e) {
+		for (int i = b; i < e; i++) {
+			float len = glm::length(normals[i]);
+			if (len > 0) normals[i] /= len;
+		}
+	});
+}
+
+bool MeshData::getBounds(glm::vec3 &min, glm::vec3 &max) const {
+	if (positions.empty()) return false;
+	min = max = positions[0];
+	for (int i = 1; i < positions.size(); i++) {
+		min = glm::min(min, positions[i]);
+		max = glm::max(max, positions[i]);
+	}
+	return true;
+}
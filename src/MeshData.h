@@ -0,0 +1,32 @@
+//
+//  MeshData.h - Indexed triangle mesh in plain arrays
+//
+//  The geometry side of a loaded model, independent of how it is drawn.
+//  Only depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+struct MeshData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;      // empty, or one per position
+	std::vector<glm::vec2> texCoords;    // empty, or one per position
+	std::vector<unsigned int> indices;   // three per triangle
+
+	int vertexCount() const { return (int)positions.size(); }
+	int triangleCount() const { return (int)indices.size() / 3; }
+	bool empty() const { return indices.empty(); }
+
+	void clear();
+
+	// smooth vertex normals: the average of the normals of the faces sharing
+	// a vertex (what assimp's GenSmoothNormals step produces)
+	//
+	void computeNormals();
+
+	// bounds of all positions, false if the mesh has none
+	//
+	bool getBounds(glm::vec3 &min, glm::vec3 &max) const;
+};
@@ -0,0 +1,455 @@
+//
+//  MeshLod.cpp - Levels of detail by quadric edge collapse
+//
+
+#include "MeshLod.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+// Planes summed per position.  error() is the area weighted mean squared
+// distance of a point to them, in squared mesh units
+//
+struct Quadric {
+	double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0, w = 0;
+
+	// the plane through p with unit normal n
+	//
+	void addPlane(const glm::vec3 &n, const glm::vec3 &p, double weight) {
+		double a = n.x, b = n.y, c = n.z;
+		double d = -(a * p.x + b * p.y + c * p.z);
+		a2 += weight * a * a;
+		b2 += weight * b * b;
+		c2 += weight * c * c;
+		ab += weight * a * b;
+		ac += weight * a * c;
+		bc += weight * b * c;
+		ad += weight * a * d;
+		bd += weight * b * d;
+		cd += weight * c * d;
+		d2 += weight * d * d;
+		w += weight;
+	}
+
+	void add(const Quadric &q) {
+		a2 += q.a2; b2 += q.b2; c2 += q.c2;
+		ab += q.ab; ac += q.ac; bc += q.bc;
+		ad += q.ad; bd += q.bd; cd += q.cd;
+		d2 += q.d2; w += q.w;
+	}
+
+	double error(const glm::vec3 &p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double r = a2 * x * x + b2 * y * y + c2 * z * z + 2 * (ab * x * y + ac * x * z + bc * y * z) +
+			2 * (ad * x + bd * y + cd * z) + d2;
+		return w > 0 ? std::fabs(r) / w : 0;
+	}
+};
+
+// What a position may collapse onto.  Manifold: any neighbour.  Border
+// (open edges, one vertex): a neighbour along the border.  Seam (two
+// vertices, closed): a neighbour along the seam.  Locked: stays
+//
+enum VertexKind : unsigned char { Manifold, Border, Seam, Locked };
+
+// open edges pull their vertices along the edge harder than faces do
+//
+static const double edgeWeight = 10.0;
+
+// The working state of a chain of levels.  Vertices at the same position
+// are handled together through their representative, the lowest numbered
+// of them ("rep"), which carries the quadric and the adjacency.
+//
+class Simplifier {
+public:
+	Simplifier(const MeshData &mesh, const SkinWeights *weights, const LodSettings &settings, float radius);
+
+	// collapse until at most target triangles are left, or nothing can go
+	//
+	void simplify(int target);
+
+	std::vector<unsigned int> indices;
+	double error = 0;            // largest squared error of a collapse so far
+
+private:
+	void weld();
+	void buildAdjacency();
+	void classify();
+	void computeQuadrics();
+
+	int edgeCount(unsigned a, unsigned b) const;
+	int wedgeEdgeCount(unsigned a, unsigned b) const;
+	bool findCollapse(unsigned u, unsigned &target, double &cost, double &geometric) const;
+	bool mapWedges(unsigned u, unsigned v, const std::vector<unsigned> &remap, unsigned *mapped) const;
+	bool flips(unsigned u, unsigned v, const std::vector<unsigned> &remap) const;
+	double skinDistance(unsigned u, unsigned v) const;
+
+	const glm::vec3 *positions;
+	int n;
+	const SkinWeights *skin;
+	double skinScale2;
+	bool bLockBorders;
+
+	std::vector<unsigned> rep;
+	std::vector<unsigned> nextWedge;     // ring of the vertices at one position
+	std::vector<unsigned char> kind;     // per rep
+	std::vector<Quadric> quadrics;       // per rep
+	std::vector<int> adjStart;           // triangles around rep r: adjTris[adjStart[r]] .. adjTris[adjStart[r + 1] - 1]
+	std::vector<int> adjTris;
+};
+
+Simplifier::Simplifier(const MeshData &mesh, const SkinWeights *weights, const LodSettings &settings, float radius) {
+	positions = mesh.positions.data();
+	n = mesh.vertexCount();
+	skin = (weights && weights->vertexCount() == n) ? weights : NULL;
+	skinScale2 = (double)settings.skinError * radius * settings.skinError * radius;
+	bLockBorders = settings.bLockBorders;
+
+	weld();
+
+	// triangles without area at their positions never come back
+	//
+	indices.reserve(mesh.indices.size());
+	for (int t = 0; t < mesh.triangleCount(); t++) {
+		unsigned a = mesh.indices[3 * t], b = mesh.indices[3 * t + 1], c = mesh.indices[3 * t + 2];
+		if (rep[a] == rep[b] || rep[b] == rep[c] || rep[c] == rep[a]) continue;
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	buildAdjacency();
+	classify();
+	computeQuadrics();
+}
+
+// equal positions found by sorting
+//
+void Simplifier::weld() {
+	std::vector<unsigned> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+		const glm::vec3 &p = positions[a], &q = positions[b];
+		if (p.x != q.x) return p.x < q.x;
+		if (p.y != q.y) return p.y < q.y;
+		if (p.z != q.z) return p.z < q.z;
+		return a < b;
+	});
+
+	rep.resize(n);
+	nextWedge.resize(n);
+	for (int i = 0; i < n; ) {
+		int j = i + 1;
+		while (j < n && positions[order[j]] == positions[order[i]]) j++;
+		for (int k = i; k < j; k++) {
+			rep[order[k]] = order[i];
+			nextWedge[order[k]] = order[k + 1 < j ? k + 1 : i];
+		}
+		i = j;
+	}
+}
+
+void Simplifier::buildAdjacency() {
+	adjStart.assign(n + 1, 0);
+	for (int i = 0; i < indices.size(); i++) adjStart[rep[indices[i]] + 1]++;
+	for (int i = 0; i < n; i++) adjStart[i + 1] += adjStart[i];
+	adjTris.resize(indices.size());
+	std::vector<int> cursor(adjStart.begin(), adjStart.end() - 1);
+	for (int i = 0; i < indices.size(); i++) adjTris[cursor[rep[indices[i]]]++] = i / 3;
+}
+
+// directed edge a -> b between reps, over the triangles around a
+//
+int Simplifier::edgeCount(unsigned a, unsigned b) const {
+	int count = 0;
+	for (int i = adjStart[a]; i < adjStart[a + 1]; i++) {
+		const unsigned *tri = &indices[3 * adjTris[i]];
+		for (int k = 0; k < 3; k++) {
+			if (rep[tri[k]] == a && rep[tri[(k + 1) % 3]] == b) count++;
+		}
+	}
+	return count;
+}
+
+// directed edge a -> b between vertices
+//
+int Simplifier::wedgeEdgeCount(unsigned a, unsigned b) const {
+	int count = 0;
+	unsigned r = rep[a];
+	for (int i = adjStart[r]; i < adjStart[r + 1]; i++) {
+		const unsigned *tri = &indices[3 * adjTris[i]];
+		for (int k = 0; k < 3; k++) {
+			if (tri[k] == a && tri[(k + 1) % 3] == b) count++;
+		}
+	}
+	return count;
+}
+
+// A position whose edges are each shared by two triangles in opposite
+// directions is closed; an edge seen twice in one direction makes it
+// non manifold, and those are locked
+//
+void Simplifier::classify() {
+	kind.assign(n, Locked);
+	parallelFor(0, n, 4096, [&](int b, int e) {
+		for (int r = b; r < e; r++) {
+			if (rep[r] != r) continue;
+			int wedges = 1;
+			for (unsigned w = nextWedge[r]; w != r; w = nextWedge[w]) wedges++;
+
+			bool bBorder = false, bComplex = false;
+			for (int i = adjStart[r]; i < adjStart[r + 1]; i++) {
+				const unsigned *tri = &indices[3 * adjTris[i]];
+				int k = rep[tri[0]] == r ? 0 : (rep[tri[1]] == r ? 1 : 2);
+				unsigned next = rep[tri[(k + 1) % 3]], prev = rep[tri[(k + 2) % 3]];
+				if (edgeCount(r, next) > 1) bComplex = true;
+				if (edgeCount(next, r) == 0 || edgeCount(r, prev) == 0) bBorder = true;
+			}
+
+			if (bComplex) kind[r] = Locked;
+			else if (wedges == 1) kind[r] = !bBorder ? Manifold : (bLockBorders ? Locked : Border);
+			else if (wedges == 2 && !bBorder) kind[r] = Seam;
+			else kind[r] = Locked;
+		}
+	});
+}
+
+// Face planes weighted by area, and for every edge that is open between
+// vertices (a border, or a seam seen from one side) a plane through it
+// upright on the face
+//
+void Simplifier::computeQuadrics() {
+	quadrics.assign(n, Quadric());
+	parallelFor(0, n, 4096, [&](int b, int e) {
+		for (int r = b; r < e; r++) {
+			if (rep[r] != r) continue;
+			Quadric &q = quadrics[r];
+			for (int i = adjStart[r]; i < adjStart[r + 1]; i++) {
+				const unsigned *tri = &indices[3 * adjTris[i]];
+				const glm::vec3 &p0 = positions[tri[0]], &p1 = positions[tri[1]], &p2 = positions[tri[2]];
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area2 = glm::length(normal);
+				if (area2 == 0) continue;
+				normal /= area2;
+				q.addPlane(normal, p0, area2 * 0.5);
+
+				int k = rep[tri[0]] == r ? 0 : (rep[tri[1]] == r ? 1 : 2);
+				unsigned edges[2][2] = { { tri[k], tri[(k + 1) % 3] }, { tri[(k + 2) % 3], tri[k] } };
+				for (int j = 0; j < 2; j++) {
+					unsigned from = edges[j][0], to = edges[j][1];
+					if (wedgeEdgeCount(to, from) > 0) continue;
+					glm::vec3 edge = positions[to] - positions[from];
+					glm::vec3 upright = glm::cross(edge, normal);
+					float len = glm::length(upright);
+					if (len > 0) q.addPlane(upright / len, positions[from], edgeWeight * glm::dot(edge, edge));
+				}
+			}
+		}
+	});
+}
+
+// half the summed difference of two vertices' weights, 0 (same) to 1
+//
+double Simplifier::skinDistance(unsigned u, unsigned v) const {
+	int k = skin->influences;
+	const uint16_t *ju = &skin->joints[(size_t)u * k], *jv = &skin->joints[(size_t)v * k];
+	const float *wu = &skin->weights[(size_t)u * k], *wv = &skin->weights[(size_t)v * k];
+	double sum = 0;
+	for (int i = 0; i < k && wu[i] > 0; i++) {
+		float other = 0;
+		for (int j = 0; j < k && wv[j] > 0; j++) {
+			if (jv[j] == ju[i]) other = wv[j];
+		}
+		sum += std::fabs(wu[i] - other);
+	}
+	for (int j = 0; j < k && wv[j] > 0; j++) {
+		bool bShared = false;
+		for (int i = 0; i < k && wu[i] > 0; i++) bShared = bShared || ju[i] == jv[j];
+		if (!bShared) sum += wv[j];
+	}
+	return sum * 0.5;
+}
+
+// the cheapest neighbour u may move onto, by the rules of VertexKind
+//
+bool Simplifier::findCollapse(unsigned u, unsigned &target, double &cost, double &geometric) const {
+	if (kind[u] == Locked) return false;
+	cost = DBL_MAX;
+	for (int i = adjStart[u]; i < adjStart[u + 1]; i++) {
+		const unsigned *tri = &indices[3 * adjTris[i]];
+		int k = rep[tri[0]] == u ? 0 : (rep[tri[1]] == u ? 1 : 2);
+		for (int side = 1; side <= 2; side++) {
+			unsigned w = tri[(k + side) % 3];
+			unsigned v = rep[w];
+			if (kind[u] == Border) {
+				bool bBorderEdge = (edgeCount(u, v) == 0) != (edgeCount(v, u) == 0);
+				if (!bBorderEdge || (kind[v] != Border && kind[v] != Locked)) continue;
+			}
+			else if (kind[u] == Seam) {
+				bool bOpen = side == 1 ? wedgeEdgeCount(w, tri[k]) == 0 : wedgeEdgeCount(tri[k], w) == 0;
+				if (!bOpen || (kind[v] != Seam && kind[v] != Locked)) continue;
+			}
+			double g = quadrics[u].error(positions[v]);
+			double c = skin ? g + skinDistance(u, v) * skinDistance(u, v) * skinScale2 : g;
+			if (c < cost) {
+				cost = c;
+				geometric = g;
+				target = v;
+			}
+		}
+	}
+	return cost < DBL_MAX;
+}
+
+// the vertex of v each vertex of u goes to: the one sharing a triangle
+// with it, so every copy of a seam stays on its side
+//
+bool Simplifier::mapWedges(unsigned u, unsigned v, const std::vector<unsigned> &remap, unsigned *mapped) const {
+	int count = 0;
+	unsigned w = u;
+	do {
+		bool bFound = false;
+		for (int i = adjStart[u]; i < adjStart[u + 1] && !bFound; i++) {
+			const unsigned *tri = &indices[3 * adjTris[i]];
+			if (tri[0] != w && tri[1] != w && tri[2] != w) continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned c = remap[tri[k]];
+				if (rep[c] == v) {
+					mapped[count] = c;
+					bFound = true;
+					break;
+				}
+			}
+		}
+		if (!bFound) return false;
+		count++;
+		w = nextWedge[w];
+	} while (w != u && count < 2);
+	return w == u;
+}
+
+// would moving u onto v turn a remaining triangle over
+//
+bool Simplifier::flips(unsigned u, unsigned v, const std::vector<unsigned> &remap) const {
+	for (int i = adjStart[u]; i < adjStart[u + 1]; i++) {
+		const unsigned *tri = &indices[3 * adjTris[i]];
+		unsigned c[3] = { remap[tri[0]], remap[tri[1]], remap[tri[2]] };
+		unsigned r[3] = { rep[c[0]], rep[c[1]], rep[c[2]] };
+		if (r[0] == v || r[1] == v || r[2] == v) continue;
+		if (r[0] == r[1] || r[1] == r[2] || r[2] == r[0]) continue;
+
+		glm::vec3 p[3] = { positions[c[0]], positions[c[1]], positions[c[2]] };
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		for (int k = 0; k < 3; k++) {
+			if (r[k] == u) p[k] = positions[v];
+		}
+		glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+		if (glm::dot(before, after) <= 0) return true;
+	}
+	return false;
+}
+
+// Every pass applies at most the collapses still needed, cheapest first.
+// A collapse blocked by an earlier one in the pass (they share a position)
+// waits for the next pass, so the pass stops once the cost is well past
+// what the needed collapses were expected to cost
+//
+void Simplifier::simplify(int target) {
+	std::vector<unsigned> targets(n), order, remap(n);
+	std::vector<double> costs(n), geometric(n);
+	std::vector<char> touched(n);
+
+	while ((int)indices.size() / 3 > target) {
+		buildAdjacency();
+		parallelFor(0, n, 1024, [&](int b, int e) {
+			for (int u = b; u < e; u++) {
+				if (rep[u] != u || adjStart[u] == adjStart[u + 1] || !findCollapse(u, targets[u], costs[u], geometric[u])) {
+					costs[u] = DBL_MAX;
+				}
+			}
+		});
+		order.clear();
+		for (int u = 0; u < n; u++) {
+			if (costs[u] < DBL_MAX) order.push_back(u);
+		}
+		if (order.empty()) break;
+		std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return costs[a] < costs[b]; });
+
+		int goal = ((int)indices.size() / 3 - target) / 2 + 1;
+		double limit = goal < order.size() ? costs[order[goal]] * 1.5 : DBL_MAX;
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), 0);
+		int done = 0;
+		for (int i = 0; i < order.size() && done < goal; i++) {
+			unsigned u = order[i], v = targets[u];
+			if (costs[u] > limit) break;
+			if (touched[u] || touched[v]) continue;
+
+			unsigned mapped[2];
+			if (!mapWedges(u, v, remap, mapped) || flips(u, v, remap)) continue;
+			unsigned w = u;
+			for (int k = 0; k == 0 || w != u; k++, w = nextWedge[w]) remap[w] = mapped[k];
+			quadrics[v].add(quadrics[u]);
+			error = std::max(error, geometric[u]);
+			touched[u] = touched[v] = 1;
+			done++;
+		}
+		if (done == 0) break;
+
+		// collapsed triangles drop out
+		//
+		size_t out = 0;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			unsigned a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (rep[a] == rep[b] || rep[b] == rep[c] || rep[c] == rep[a]) continue;
+			indices[out++] = a;
+			indices[out++] = b;
+			indices[out++] = c;
+		}
+		indices.resize(out);
+	}
+}
+
+void MeshLod::build(const MeshData &mesh, const SkinWeights *weights, const LodSettings &settings) {
+	levels.clear();
+	glm::vec3 min, max;
+	if (!mesh.getBounds(min, max)) return;
+	center = (min + max) * 0.5f;
+	radius = 0;
+	for (int i = 0; i < mesh.vertexCount(); i++) radius = std::max(radius, glm::length(mesh.positions[i] - center));
+	if (mesh.empty()) return;
+
+	Simplifier simplifier(mesh, weights, settings, radius);
+	int full = mesh.triangleCount();
+	int last = full;
+	for (int i = 0; i < settings.ratios.size(); i++) {
+		int target = (int)(full * settings.ratios[i]);
+		if (target < settings.minTriangles) break;
+		simplifier.simplify(target);
+
+		// a level barely smaller than the last isn't worth a draw of its own
+		//
+		int triangles = (int)simplifier.indices.size() / 3;
+		if (triangles > last * 0.9) break;
+		LodLevel level;
+		level.indices = simplifier.indices;
+		level.error = (float)std::sqrt(simplifier.error);
+		levels.push_back(level);
+		last = triangles;
+	}
+}
+
+int MeshLod::select(float pixelsPerUnit, float maxPixelError) const {
+	for (int i = (int)levels.size(); i > 0; i--) {
+		if (levels[i - 1].error * pixelsPerUnit <= maxPixelError) return i;
+	}
+	return 0;
+}
+
+float MeshLod::pixelsPerUnit(float distance, float fovY, float viewportHeight) {
+	if (distance <= 0) return FLT_MAX;
+	return viewportHeight / (2 * distance * std::tan(glm::radians(fovY) * 0.5f));
+}
@@ -0,0 +1,88 @@
+//
+//  MeshLod.h - Levels of detail by quadric edge collapse
+//
+//  build() simplifies a mesh to a few fractions of its triangles (50, 25
+//  and 10% by default) with the quadric error metric of Garland and
+//  Heckbert.  The collapses are half edge collapses: a vertex moves onto
+//  one of its neighbours, so every level is just an index list into the
+//  mesh's own vertices.  The levels share the vertex buffer, skinning
+//  deforms them all at once and the kept vertices keep their UVs, normals
+//  and skin weights exactly.
+//
+//  Vertices split at a UV or normal seam (one position, several vertices)
+//  only collapse along the seam onto another vertex of it, every copy to
+//  the copy on its own side, so seams keep their shape and textures don't
+//  tear.  Vertices of open borders only collapse along the border.  Given
+//  skin weights, collapsing onto a vertex weighted to other joints costs
+//  extra, which keeps the joint boundaries where the mesh bends.
+//
+//  Each pass finds the cheapest collapse of every vertex in parallel on the
+//  work stealing pool, then applies the cheapest ones that don't share a
+//  vertex and don't flip a triangle.  The next level carries on from the
+//  previous one.  select() picks the coarsest level whose error, seen from
+//  the camera, stays under a pixel.  Only depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "MeshData.h"
+#include "Skinning.h"
+
+struct LodSettings {
+	// triangle counts of the levels, relative to the full mesh, decreasing
+	//
+	std::vector<float> ratios = { 0.5f, 0.25f, 0.1f };
+
+	// no level gets fewer triangles than this; coarser ones are left out
+	//
+	int minTriangles = 64;
+
+	// how far, relative to the mesh radius, a collapse onto a vertex with
+	// completely different skin weights counts as moving the surface
+	//
+	float skinError = 0.05f;
+
+	// keep open borders as they are
+	//
+	bool bLockBorders = false;
+};
+
+struct LodLevel {
+	std::vector<unsigned int> indices;      // into the mesh's vertices, three per triangle (empty from MeshCache::getLod())
+	float error = 0;                        // estimated furthest the surface moved, in mesh units
+
+	int triangleCount() const { return (int)indices.size() / 3; }
+};
+
+class MeshLod {
+public:
+
+	// weights may be NULL.  Levels that couldn't be simplified any further
+	// than the one before are left out
+	//
+	void build(const MeshData &mesh, const SkinWeights *weights, const LodSettings &settings = LodSettings());
+
+	// number of levels including the full mesh (level 0)
+	//
+	int size() const { return (int)levels.size() + 1; }
+
+	// the level to draw when one mesh unit covers pixelsPerUnit pixels: the
+	// coarsest one whose error stays within maxPixelError pixels
+	//
+	int select(float pixelsPerUnit, float maxPixelError = 1.0f) const;
+
+	// pixels covered by one unit at distance from a perspective camera with
+	// a vertical field of view (degrees) over viewportHeight pixels
+	//
+	static float pixelsPerUnit(float distance, float fovY, float viewportHeight);
+
+	// levels 1 and on, each coarser than the one before
+	//
+	std::vector<LodLevel> levels;
+
+	// bounding sphere of the mesh
+	//
+	glm::vec3 center = glm::vec3(0, 0, 0);
+	float radius = 0;
+};
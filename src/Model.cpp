@@ -0,0 +1,236 @@
+//
+//  Model.cpp - Drawable triangle mesh loaded from a model file
+//
+
+#include "Model.h"
+#include "ObjLoader.h"
+#include "MeshBvh.h"
+#include "Trace.h"
+#include "ofxAssimpModelLoader.h"
+
+bool Model::isObj(const string &path) {
+	return ofToLower(ofFilePath::getFileExt(path)) == "obj";
+}
+
+// levels of detail of freshly loaded geometry, on the loading thread
+//
+static std::shared_ptr<MeshLod> buildLevels(const MeshData &data) {
+	std::shared_ptr<MeshLod> lod = std::make_shared<MeshLod>();
+	lod->build(data, NULL);
+	return lod;
+}
+
+ModelSource Model::loadSource(const string &path, string *error) {
+	TRACE_ZONE("Model::loadSource");
+	ModelSource source;
+	source.path = path;
+	std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+	if (cache->open(path)) {
+		source.cache = cache;
+		source.lod = std::make_shared<MeshLod>();
+		cache->getLod(*source.lod);
+		return source;
+	}
+
+	std::shared_ptr<MeshData> data = std::make_shared<MeshData>();
+	ObjLoader loader;
+	if (!loader.load(path, *data)) {
+		if (error) *error = loader.error;
+		return source;
+	}
+
+	// the picking BVH and the levels of detail are built now, on this
+	// thread, so they can go in the cache and later loads just map them.  If
+	// the cache can't be written (read only folder) the parsed arrays are
+	// used as they are
+	//
+	source.lod = buildLevels(*data);
+	MeshBvh bvh;
+	bvh.build(data->positions, data->indices, data->normals);
+	if (MeshCache::write(path, *data, &bvh.bvh, source.lod.get()) && cache->open(path)) source.cache = cache;
+	else source.data = data;
+	return source;
+}
+
+/**
+* OBJ files go through loadSource().  Other formats are loaded through
+* assimp and the meshes of the scene are gathered into one indexed list.
+*/
+bool Model::loadModel(const string &path) {
+	if (isObj(path)) {
+		string error;
+		ModelSource loaded = loadSource(path, &error);
+		if (!loaded.isValid()) {
+			ofLogError("Model") << path << ": " << error;
+			return false;
+		}
+		setup(loaded);
+		return true;
+	}
+
+	ofxAssimpModelLoader assimp;
+	if (!assimp.loadModel(path)) return false;
+
+	std::shared_ptr<MeshData> loaded = std::make_shared<MeshData>();
+	bool bNormals = true, bTexCoords = true;
+	for (int i = 0; i < assimp.getMeshCount(); i++) {
+		ofMesh m = assimp.getMesh(i);
+		unsigned int base = loaded->positions.size();
+		loaded->positions.insert(loaded->positions.end(), m.getVertices().begin(), m.getVertices().end());
+		bNormals = bNormals && m.getNormals().size() == m.getVertices().size();
+		if (bNormals) loaded->normals.insert(loaded->normals.end(), m.getNormals().begin(), m.getNormals().end());
+		bTexCoords = bTexCoords && m.getTexCoords().size() == m.getVertices().size();
+		if (bTexCoords) loaded->texCoords.insert(loaded->texCoords.end(), m.getTexCoords().begin(), m.getTexCoords().end());
+
+		// unindexed meshes are plain triangle lists
+		if (m.getNumIndices() > 0) {
+			for (int k = 0; k < m.getNumIndices(); k++) loaded->indices.push_back(base + m.getIndices()[k]);
+		}
+		else {
+			for (int k = 0; k < m.getNumVertices(); k++) loaded->indices.push_back(base + k);
+		}
+	}
+	if (!bTexCoords) loaded->texCoords.clear();
+	if (!bNormals) loaded->computeNormals();
+
+	ModelSource source;
+	source.data = loaded;
+	source.lod = buildLevels(*loaded);
+	source.path = path;
+	setup(source);
+	return true;
+}
+
+/**
+* The VBO is filled straight from the mapped cache when there is one, so the
+* geometry and its levels of detail aren't copied on the CPU side at all.
+*/
+void Model::setup(const ModelSource &s) {
+	source = s;
+	vbo.clear();
+	if (source.cache) {
+		const MeshCache &c = *source.cache;
+		vbo.setVertexData(c.positions(), c.vertexCount(), GL_STATIC_DRAW);
+		if (c.normals()) vbo.setNormalData(c.normals(), c.vertexCount(), GL_STATIC_DRAW);
+		if (c.texCoords()) vbo.setTexCoordData(c.texCoords(), c.vertexCount(), GL_STATIC_DRAW);
+		uploadIndices(c.indices(), c.indexCount(), &c);
+	}
+	else if (source.data) {
+		const MeshData &d = *source.data;
+		vbo.setVertexData(d.positions.data(), d.vertexCount(), GL_STATIC_DRAW);
+		if (!d.normals.empty()) vbo.setNormalData(d.normals.data(), d.vertexCount(), GL_STATIC_DRAW);
+		if (!d.texCoords.empty()) vbo.setTexCoordData(d.texCoords.data(), d.vertexCount(), GL_STATIC_DRAW);
+		uploadIndices(d.indices.data(), (int)d.indices.size(), NULL);
+	}
+	else {
+		indexCount = 0;
+		lodFirst.clear();
+		lodIndexCount.clear();
+	}
+}
+
+/**
+* The full index list followed by the list of every level, in one buffer.
+* The levels' lists come from the cache when it is given, otherwise from the
+* levels themselves; each part goes into the buffer from where it is.
+*/
+void Model::uploadIndices(const unsigned int *indices, int count, const MeshCache *cache) {
+	indexCount = count;
+	lodFirst.assign(1, 0);
+	lodIndexCount.assign(1, count);
+	lodLevel = 0;
+	int levels = cache ? cache->lodCount() : (source.lod ? (int)source.lod->levels.size() : 0);
+	if (levels == 0) {
+		vbo.setIndexData(indices, count, GL_STATIC_DRAW);
+		return;
+	}
+	vector<const unsigned int *> parts(1, indices);
+	int total = count;
+	for (int i = 0; i < levels; i++) {
+		parts.push_back(cache ? cache->lodIndices(i) : source.lod->levels[i].indices.data());
+		lodFirst.push_back(total);
+		lodIndexCount.push_back(cache ? cache->lodIndexCount(i) : (int)source.lod->levels[i].indices.size());
+		total += lodIndexCount.back();
+	}
+	vbo.setIndexData(NULL, total, GL_STATIC_DRAW);
+	for (int i = 0; i < parts.size(); i++) {
+		vbo.getIndexBuffer().updateData(lodFirst[i] * sizeof(unsigned int), lodIndexCount[i] * sizeof(unsigned int), parts[i]);
+	}
+}
+
+void Model::buildLod(const SkinWeights *weights) {
+	if (indexCount == 0) return;
+	const MeshData &data = getData();
+	std::shared_ptr<MeshLod> lod = std::make_shared<MeshLod>();
+	lod->build(data, weights);
+	source.lod = lod;
+	uploadIndices(data.indices.data(), (int)data.indices.size(), NULL);
+}
+
+/**
+* The bounding sphere of the mesh is placed and scaled by the model matrix;
+* the level is picked for its point nearest the camera.
+*/
+int Model::pickLod(const glm::vec3 &eye, float fovY, float viewportHeight) const {
+	if (!source.lod || lodCount() < 2) return 0;
+	const MeshLod &lod = *source.lod;
+	glm::mat4 m = getModelMatrix();
+	float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+	glm::vec3 center = m * glm::vec4(lod.center, 1.0);
+	float distance = glm::distance(eye, center) - lod.radius * scale;
+	return lod.select(MeshLod::pixelsPerUnit(distance, fovY, viewportHeight) * scale);
+}
+
+void Model::updateVertices(const glm::vec3 *positions, const glm::vec3 *normals, int n) {
+	if (indexCount == 0) return;
+	vbo.updateVertexData(positions, n);
+	if (normals && vbo.getUsingNormals()) vbo.updateNormalData(normals, n);
+}
+
+const MeshData &Model::getData() {
+	if (!source.data) {
+		source.data = std::make_shared<MeshData>();
+		if (source.cache) source.cache->copyTo(*source.data);
+	}
+	return *source.data;
+}
+
+void Model::setRotation(int which, float angle, float x, float y, float z) {
+	if (which + 1 > rotAngle.size()) {
+		rotAngle.resize(which + 1, 0);
+		rotAxis.resize(which + 1, glm::vec3(0, 0, 0));
+	}
+	rotAngle[which] = angle;
+	rotAxis[which] = glm::vec3(x, y, z);
+}
+
+/**
+* Same composition as ofxAssimpModelLoader (with scale normalization off):
+* translate, flip 180 degrees about z, the numbered rotations in order, scale.
+*/
+glm::mat4 Model::getModelMatrix() const {
+	glm::mat4 m = glm::translate(glm::mat4(1.0), position);
+	m = glm::rotate(m, glm::radians(180.0f), glm::vec3(0, 0, 1));
+	for (int i = 0; i < rotAngle.size(); i++) {
+		if (rotAxis[i] != glm::vec3(0, 0, 0)) m = glm::rotate(m, glm::radians(rotAngle[i]), rotAxis[i]);
+	}
+	return glm::scale(m, scale);
+}
+
+void Model::drawWireframe() {
+	if (indexCount == 0) return;
+	ofPushMatrix();
+	ofMultMatrix(getModelMatrix());
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	vbo.drawElements(GL_TRIANGLES, lodIndexCount[lodLevel], lodFirst[lodLevel]);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	ofPopMatrix();
+}
+
+void Model::drawFaces() {
+	if (indexCount == 0) return;
+	ofPushMatrix();
+	ofMultMatrix(getModelMatrix());
+	vbo.drawElements(GL_TRIANGLES, lodIndexCount[lodLevel], lodFirst[lodLevel]);
+	ofPopMatrix();
+}
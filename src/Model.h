@@ -0,0 +1,103 @@
+//
+//  Model.h - Drawable triangle mesh loaded from a model file
+//
+//  The transform interface (and the model matrix it produces) is the one of
+//  ofxAssimpModelLoader, so models behave exactly as they did when they were
+//  loaded through assimp.  OBJ files are read with the multithreaded
+//  ObjLoader and a MeshCache is written next to them, so later loads map the
+//  cache and upload straight from it; everything else still goes through
+//  assimp.  Simplified levels of the mesh (see MeshLod.h) are built with
+//  the geometry, stored in its cache and drawn from the same vertex buffer.
+//
+#pragma once
+
+#include "ofMain.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "MeshLod.h"
+#include <memory>
+
+// Geometry of a model as it comes off the loading thread: the mapped cache
+// when there is one, otherwise the parsed arrays.  Both null on failure.
+// path is the file it was loaded from (caches of derived data go next to it)
+//
+struct ModelSource {
+	std::shared_ptr<MeshCache> cache;
+	std::shared_ptr<MeshData> data;
+	std::shared_ptr<MeshLod> lod;
+	string path;
+	bool isValid() const { return cache || data; }
+};
+
+class Model {
+public:
+	// load and upload in one go (main thread only)
+	//
+	bool loadModel(const string &path);
+
+	// geometry only, no GL calls, so it can run on a worker thread.
+	// Only OBJ files can be read this way.  Uses the cache when it is up to
+	// date, otherwise parses the file and writes the cache
+	//
+	static bool isObj(const string &path);
+	static ModelSource loadSource(const string &path, string *error = NULL);
+
+	// upload loaded geometry to the VBO (main thread only)
+	//
+	void setup(const ModelSource &source);
+
+	// replace the vertex positions (and normals, when not NULL and the model
+	// has them) in the VBO, e.g. with skinned ones.  Same vertex count and
+	// order as the loaded geometry, which getData() keeps returning
+	//
+	void updateVertices(const glm::vec3 *positions, const glm::vec3 *normals, int n);
+
+	// Levels of detail, level 0 being the full mesh.  buildLod() simplifies
+	// the geometry again, e.g. once it has skin weights to keep (main thread)
+	//
+	void buildLod(const SkinWeights *weights = NULL);
+	const MeshLod *getLod() const { return source.lod.get(); }
+	int lodCount() const { return (int)lodFirst.size(); }
+	int getLodLevel() const { return lodLevel; }
+	void setLodLevel(int level) { lodLevel = std::max(0, std::min(level, lodCount() - 1)); }
+
+	// the level that looks like the full mesh from a perspective camera at
+	// eye, with a vertical field of view (degrees) over viewportHeight pixels
+	//
+	int pickLod(const glm::vec3 &eye, float fovY, float viewportHeight) const;
+
+	void setPosition(float x, float y, float z) { position = glm::vec3(x, y, z); }
+	void setScale(float x, float y, float z) { scale = glm::vec3(x, y, z); }
+	void setRotation(int which, float angle, float x, float y, float z);
+
+	glm::mat4 getModelMatrix() const;
+
+	// the geometry as arrays, copied out of the cache on first use
+	//
+	const MeshData &getData();
+
+	// the mapped cache the model was loaded from, or NULL
+	//
+	const MeshCache *getCache() const { return source.cache.get(); }
+
+	const string &getPath() const { return source.path; }
+
+	void drawWireframe();
+	void drawFaces();
+
+private:
+	void uploadIndices(const unsigned int *indices, int count, const MeshCache *cache);
+
+	ModelSource source;
+	ofVbo vbo;
+	int indexCount = 0;
+
+	// the levels follow the full index list in the index buffer
+	vector<int> lodFirst, lodIndexCount;
+	int lodLevel = 0;
+
+	glm::vec3 position = glm::vec3(0, 0, 0);
+	glm::vec3 scale = glm::vec3(1, 1, 1);
+	vector<float> rotAngle;
+	vector<glm::vec3> rotAxis;
+};
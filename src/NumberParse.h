@@ -0,0 +1,120 @@
+//
+//  NumberParse.h - Fast number parsing over unterminated text
+//
+//  Parses numbers straight out of a mapped or loaded buffer: no copies, no
+//  locale, and no need for a terminating NUL.  Each function reads the
+//  longest number at p and returns the end of it, or NULL if p doesn't
+//  start with one; checking what follows is up to the caller.
+//
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+namespace NumberParse {
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// strtod fallback for anything the fast path doesn't handle (nan, inf, hex)
+//
+inline const char *parseFloatSlow(const char *p, const char *end, float &out) {
+	char buf[64];
+	size_t n = 0;
+	while (p + n < end && n < sizeof(buf) - 1) {
+		char c = p[n];
+		if (!(isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '.' || c == '+' || c == '-')) break;
+		n++;
+	}
+	if (n == 0) return NULL;
+	memcpy(buf, p, n);
+	buf[n] = 0;
+	char *stop;
+	out = (float)strtod(buf, &stop);
+	return (stop == buf) ? NULL : p + (stop - buf);
+}
+
+// decimal float: up to 19 significant digits are gathered into an integer
+// mantissa, which is then scaled by an exact power of ten when it can be
+//
+inline const char *parseFloat(const char *p, const char *end, float &out) {
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *start = p;
+	bool bNegative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		bNegative = (*p == '-');
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool bDigits = false;
+	for (; p < end && isDigit(*p); p++) {
+		bDigits = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && isDigit(*p); p++) {
+			bDigits = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (!bDigits) return parseFloatSlow(start, end, out);
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool bNegExp = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			bNegExp = (*q == '-');
+			q++;
+		}
+		if (q < end && isDigit(*q)) {
+			int e = 0;
+			for (; q < end && isDigit(*q); q++) {
+				if (e < 10000) e = e * 10 + (*q - '0');
+			}
+			exponent += bNegExp ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double)mantissa;
+	if (mantissa != 0 && exponent != 0) {
+		if (exponent > 0 && exponent <= 22) value *= pow10[exponent];
+		else if (exponent < 0 && exponent >= -22) value /= pow10[-exponent];
+		else value *= pow(10.0, exponent);
+	}
+	out = (float)(bNegative ? -value : value);
+	return p;
+}
+
+inline const char *parseInt(const char *p, const char *end, int &out) {
+	bool bNegative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		bNegative = (*p == '-');
+		p++;
+	}
+	if (p == end || !isDigit(*p)) return NULL;
+	int64_t v = 0;
+	for (; p < end && isDigit(*p); p++) {
+		v = v * 10 + (*p - '0');
+		if (v > INT32_MAX) return NULL;
+	}
+	out = (int)(bNegative ? -v : v);
+	return p;
+}
+
+}
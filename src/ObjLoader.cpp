@@ -0,0 +1,365 @@
+//
+//  ObjLoader.cpp - Multithreaded Wavefront OBJ reader
+//
+
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "NumberParse.h"
+
+#include <cstring>
+
+namespace {
+
+// one face corner, 0 based indices into the v/vt/vn arrays, -1 when absent
+//
+struct ObjCorner {
+	int v, vt, vn;
+};
+
+struct ObjChunk {
+	const char *begin, *end;
+
+	// counts from the first pass
+	int nLines = 0, nV = 0, nVt = 0, nVn = 0, nTris = 0;
+
+	// offsets into the shared arrays (prefix sums of the counts)
+	int lineBase = 0, vBase = 0, vtBase = 0, vnBase = 0, triBase = 0;
+
+	bool bTexCoords = false, bNormals = false;
+
+	// first error in the chunk, line is 0 when there is none
+	int errLine = 0, errColumn = 0;
+	const char *errMessage = NULL;
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// end of a token: whitespace, end of line or start of a comment
+//
+inline bool isDelim(const char *p, const char *end) { return p == end || isSpace(*p) || *p == '#'; }
+
+inline const char *skipSpace(const char *p, const char *end) {
+	while (p < end && isSpace(*p)) p++;
+	return p;
+}
+
+inline const char *skipToken(const char *p, const char *end) {
+	while (p < end && !isDelim(p, end)) p++;
+	return p;
+}
+
+// record type of the line starting at p (already past leading white space)
+//
+enum ObjRecord { RecordOther, RecordV, RecordVt, RecordVn, RecordF };
+
+inline ObjRecord recordType(const char *&p, const char *end) {
+	if (p == end) return RecordOther;
+	if (*p == 'v') {
+		if (p + 1 == end || isSpace(p[1])) { p += 1; return RecordV; }
+		if (p + 2 <= end && (p + 2 == end || isSpace(p[2]))) {
+			if (p[1] == 't') { p += 2; return RecordVt; }
+			if (p[1] == 'n') { p += 2; return RecordVn; }
+		}
+	}
+	else if (*p == 'f') {
+		if (p + 1 == end || isSpace(p[1])) { p += 1; return RecordF; }
+	}
+	return RecordOther;
+}
+
+// a number has to be followed by white space, the end of the line or a comment
+//
+inline const char *parseFloat(const char *p, const char *end, float &out) {
+	p = NumberParse::parseFloat(p, end, out);
+	return (p && isDelim(p, end)) ? p : NULL;
+}
+
+inline const char *parseInt(const char *p, const char *end, int &out) {
+	return NumberParse::parseInt(p, end, out);
+}
+
+// OBJ indices are 1 based, or relative to the end of the list so far when
+// negative.  count is the number of elements defined before this line,
+// total the number in the whole file (forward references are accepted).
+//
+inline bool resolveIndex(int index, int count, int total, int &out) {
+	if (index > 0) out = index - 1;
+	else if (index < 0) out = count + index;
+	else return false;
+	return out >= 0 && out < total;
+}
+
+// first pass: count lines and records of a chunk
+//
+void countChunk(ObjChunk &c) {
+	const char *p = c.begin;
+	while (p < c.end) {
+		const char *eol = (const char *)memchr(p, '\n', c.end - p);
+		if (!eol) eol = c.end;
+		c.nLines++;
+
+		const char *q = skipSpace(p, eol);
+		switch (recordType(q, eol)) {
+		case RecordV:  c.nV++;  break;
+		case RecordVt: c.nVt++; break;
+		case RecordVn: c.nVn++; break;
+		case RecordF: {
+			int corners = 0;
+			for (q = skipSpace(q, eol); q < eol && *q != '#'; q = skipSpace(q, eol)) {
+				q = skipToken(q, eol);
+				corners++;
+			}
+			if (corners >= 3) c.nTris += corners - 2;
+			break;
+		}
+		default: break;
+		}
+		p = eol + 1;
+	}
+}
+
+struct ObjArrays {
+	glm::vec3 *v;
+	glm::vec2 *vt;
+	glm::vec3 *vn;
+	ObjCorner *corners;
+	int totalV, totalVt, totalVn;
+};
+
+// second pass: parse the records of a chunk into their slots
+//
+void parseChunk(ObjChunk &c, const ObjArrays &a) {
+	int line = c.lineBase;
+	int nV = 0, nVt = 0, nVn = 0, nTris = 0;
+	const char *p = c.begin;
+	const char *lineStart = p;
+	const char *where = p;
+	const char *message = NULL;
+
+	while (p < c.end) {
+		const char *eol = (const char *)memchr(p, '\n', c.end - p);
+		if (!eol) eol = c.end;
+		lineStart = p;
+		line++;
+
+		const char *q = skipSpace(p, eol);
+		switch (recordType(q, eol)) {
+		case RecordV: {
+			glm::vec3 &v = a.v[c.vBase + nV++];
+			for (int k = 0; k < 3 && !message; k++) {
+				where = q = skipSpace(q, eol);
+				if (!(q = parseFloat(q, eol, v[k]))) message = "expected a number";
+			}
+			break;
+		}
+		case RecordVt: {
+			glm::vec2 &vt = a.vt[c.vtBase + nVt++];
+			where = q = skipSpace(q, eol);
+			if (!(q = parseFloat(q, eol, vt.x))) message = "expected a number";
+			else {
+				// v is optional
+				where = q = skipSpace(q, eol);
+				vt.y = 0;
+				if (!isDelim(q, eol) && !(q = parseFloat(q, eol, vt.y))) message = "expected a number";
+			}
+			break;
+		}
+		case RecordVn: {
+			glm::vec3 &vn = a.vn[c.vnBase + nVn++];
+			for (int k = 0; k < 3 && !message; k++) {
+				where = q = skipSpace(q, eol);
+				if (!(q = parseFloat(q, eol, vn[k]))) message = "expected a number";
+			}
+			break;
+		}
+		case RecordF: {
+			ObjCorner first, prev;
+			int n = 0;
+			for (q = skipSpace(q, eol); q < eol && *q != '#' && !message; q = skipSpace(q, eol)) {
+				ObjCorner corner = { -1, -1, -1 };
+				int index;
+
+				// v, v/vt, v//vn or v/vt/vn
+				where = q;
+				if (!(q = parseInt(q, eol, index))) { message = "expected a vertex index"; break; }
+				if (!resolveIndex(index, c.vBase + nV, a.totalV, corner.v)) { message = "vertex index out of range"; break; }
+				if (q < eol && *q == '/') {
+					q++;
+					if (q < eol && *q != '/') {
+						where = q;
+						if (!(q = parseInt(q, eol, index))) { message = "expected a texture coordinate index"; break; }
+						if (!resolveIndex(index, c.vtBase + nVt, a.totalVt, corner.vt)) { message = "texture coordinate index out of range"; break; }
+						c.bTexCoords = true;
+					}
+					if (q < eol && *q == '/') {
+						where = ++q;
+						if (!(q = parseInt(q, eol, index))) { message = "expected a normal index"; break; }
+						if (!resolveIndex(index, c.vnBase + nVn, a.totalVn, corner.vn)) { message = "normal index out of range"; break; }
+						c.bNormals = true;
+					}
+				}
+				if (!isDelim(q, eol)) { where = q; message = "unexpected character in face"; break; }
+
+				// fan triangulation
+				if (n == 0) first = corner;
+				else if (n >= 2) {
+					ObjCorner *tri = a.corners + 3 * (c.triBase + nTris++);
+					tri[0] = first;
+					tri[1] = prev;
+					tri[2] = corner;
+				}
+				prev = corner;
+				n++;
+			}
+			if (!message && n < 3) {
+				where = q;
+				message = "face needs at least three vertices";
+			}
+			break;
+		}
+		default: break;
+		}
+
+		if (message) {
+			c.errLine = line;
+			c.errColumn = (int)(where - lineStart) + 1;
+			c.errMessage = message;
+			return;
+		}
+		p = eol + 1;
+	}
+}
+
+}
+
+bool ObjLoader::load(const std::string &path, MeshData &mesh) {
+	MappedFile file;
+	if (!file.open(path)) {
+		error = "can't open " + path;
+		return false;
+	}
+	return parse(file.data(), file.size(), mesh);
+}
+
+bool ObjLoader::parse(const char *data, size_t size, MeshData &mesh) {
+	mesh.clear();
+	error.clear();
+
+	// cut the file into chunks that end on a newline
+	//
+	int nChunks = (int)std::min<size_t>(size / std::max<size_t>(chunkSize, 1) + 1, hardwareThreads() * 8);
+	std::vector<ObjChunk> chunks;
+	const char *end = data + size;
+	const char *p = data;
+	for (int i = 1; i <= nChunks && p < end; i++) {
+		const char *e = (i == nChunks) ? end : std::max(p, data + size * i / nChunks);
+		if (e < end) {
+			const char *nl = (const char *)memchr(e, '\n', end - e);
+			e = nl ? nl + 1 : end;
+		}
+		ObjChunk c;
+		c.begin = p;
+		c.end = e;
+		chunks.push_back(c);
+		p = e;
+	}
+
+	parallelFor(0, (int)chunks.size(), 1, [&](int b, int e) {
+		for (int i = b; i < e; i++) countChunk(chunks[i]);
+	});
+
+	ObjChunk total;
+	for (int i = 0; i < chunks.size(); i++) {
+		ObjChunk &c = chunks[i];
+		c.lineBase = total.nLines;
+		c.vBase = total.nV;
+		c.vtBase = total.nVt;
+		c.vnBase = total.nVn;
+		c.triBase = total.nTris;
+		total.nLines += c.nLines;
+		total.nV += c.nV;
+		total.nVt += c.nVt;
+		total.nVn += c.nVn;
+		total.nTris += c.nTris;
+	}
+
+	std::vector<glm::vec3> vn(total.nVn);
+	std::vector<glm::vec2> vt(total.nVt);
+	std::vector<ObjCorner> corners(3 * (size_t)total.nTris);
+	mesh.positions.resize(total.nV);
+
+	ObjArrays arrays = { mesh.positions.data(), vt.data(), vn.data(), corners.data(), total.nV, total.nVt, total.nVn };
+	parallelFor(0, (int)chunks.size(), 1, [&](int b, int e) {
+		for (int i = b; i < e; i++) parseChunk(chunks[i], arrays);
+	});
+
+	bool bTexCoords = false, bNormals = false;
+	for (int i = 0; i < chunks.size(); i++) {
+		ObjChunk &c = chunks[i];
+		if (c.errMessage) {
+			error = "line " + std::to_string(c.errLine) + ", column " + std::to_string(c.errColumn) + ": " + c.errMessage;
+			mesh.clear();
+			return false;
+		}
+		bTexCoords = bTexCoords || c.bTexCoords;
+		bNormals = bNormals || c.bNormals;
+	}
+
+	// merge the corners into one indexed vertex buffer.  In the common case
+	// every corner uses the same index for all its attributes (or has only a
+	// position) and the position index can be used as is.
+	//
+	int nCorners = (int)corners.size();
+	bool bShared = true;
+	for (int i = 0; i < nCorners && bShared; i++) {
+		const ObjCorner &c = corners[i];
+		bShared = (!bTexCoords || c.vt == c.v) && (!bNormals || c.vn == c.v);
+	}
+
+	mesh.indices.resize(nCorners);
+	if (bShared) {
+		parallelFor(0, nCorners, 1 << 16, [&](int b, int e) {
+			for (int i = b; i < e; i++) mesh.indices[i] = corners[i].v;
+		});
+		if (bTexCoords) {
+			mesh.texCoords.assign(total.nV, glm::vec2(0, 0));
+			std::copy(vt.begin(), vt.begin() + std::min(total.nV, total.nVt), mesh.texCoords.begin());
+		}
+		if (bNormals) {
+			mesh.normals.assign(total.nV, glm::vec3(0, 0, 0));
+			std::copy(vn.begin(), vn.begin() + std::min(total.nV, total.nVn), mesh.normals.begin());
+		}
+	}
+	else {
+		// one output vertex per distinct (v, vt, vn), found through a
+		// linked list of the vertices already made from each position
+		//
+		std::vector<glm::vec3> positions;
+		std::vector<int> head(total.nV, -1), next;
+		std::vector<ObjCorner> keys;
+		positions.reserve(total.nV);
+		next.reserve(total.nV);
+		keys.reserve(total.nV);
+
+		for (int i = 0; i < nCorners; i++) {
+			const ObjCorner &c = corners[i];
+			int k = head[c.v];
+			while (k >= 0 && (keys[k].vt != c.vt || keys[k].vn != c.vn)) k = next[k];
+			if (k < 0) {
+				k = (int)keys.size();
+				keys.push_back(c);
+				next.push_back(head[c.v]);
+				head[c.v] = k;
+				positions.push_back(mesh.positions[c.v]);
+				if (bTexCoords) mesh.texCoords.push_back(c.vt >= 0 ? vt[c.vt] : glm::vec2(0, 0));
+				if (bNormals) mesh.normals.push_back(c.vn >= 0 ? vn[c.vn] : glm::vec3(0, 0, 0));
+			}
+			mesh.indices[i] = k;
+		}
+		mesh.positions.swap(positions);
+	}
+
+	if (!bNormals) mesh.computeNormals();
+	return true;
+}
@@ -0,0 +1,30 @@
+//
+//  ObjLoader.h - Multithreaded Wavefront OBJ reader
+//
+//  The file is memory mapped and cut into chunks on line boundaries.  A first
+//  parallel pass counts the records of every chunk, prefix sums over the
+//  counts give each chunk its place in the shared arrays, and a second
+//  parallel pass parses v/vt/vn/f records straight into place.  Faces are
+//  fan triangulated; corners are then merged into one indexed vertex buffer
+//  (shared when every corner uses the same index for v/vt/vn, deduplicated
+//  otherwise).  Smooth normals are generated when the file has none.
+//
+//  Other records (o, g, s, usemtl, mtllib, l, p ...) are skipped.  Only
+//  depends on glm, so it can run on any thread.
+//
+#pragma once
+
+#include <string>
+#include "MeshData.h"
+
+class ObjLoader {
+public:
+	bool load(const std::string &path, MeshData &mesh);
+	bool parse(const char *data, size_t size, MeshData &mesh);
+
+	// "line L, column C: message" after a failed load or parse
+	std::string error;
+
+	// target bytes per parse task, files smaller than this parse on one thread
+	size_t chunkSize = 1 << 18;
+};
@@ -0,0 +1,116 @@
+//
+//  ObjectPool.h - Typed object pool with generational handles
+//
+//  Objects live in slots inside fixed size chunks, so they never move and
+//  raw pointers to them stay good while they are alive.  A handle is a slot
+//  index and the generation the slot had when the object was created; once
+//  the object is released the slot gets a new generation with its next
+//  object, and get() on the old handle returns NULL instead of somebody
+//  else's object.
+//
+//  Releasing doesn't destroy: the object stays constructed in its free slot
+//  and is assigned over when the slot is handed out again, so a scene that
+//  is loaded, cleared and loaded again reuses the same memory.  That also
+//  makes clear(), which releases everything, O(1).  Destructors run when the
+//  pool goes.  T must be move assignable.  Not thread safe.
+//
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct PoolHandle {
+	uint32_t index = 0;
+	uint32_t generation = 0;     // 0 never belongs to an object
+
+	bool isNull() const { return generation == 0; }
+	bool operator==(const PoolHandle &h) const { return index == h.index && generation == h.generation; }
+	bool operator!=(const PoolHandle &h) const { return !(*this == h); }
+};
+
+template <class T>
+class ObjectPool {
+public:
+	enum { chunkSize = 1024 };
+
+	ObjectPool() {}
+	~ObjectPool() {
+		for (uint32_t i = 0; i < constructed; i++) object(i)->~T();
+		for (int c = 0; c < chunks.size(); c++) ::operator delete(chunks[c]);
+	}
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	// T(args...) in a free slot
+	//
+	template <class... Args>
+	PoolHandle create(Args &&... args) {
+		uint32_t index;
+		if (!freeSlots.empty()) {
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else index = used++;
+
+		if (index < constructed) *object(index) = T(std::forward<Args>(args)...);
+		else {
+			if (index / chunkSize == chunks.size()) chunks.push_back((Slot *)::operator new(sizeof(Slot) * chunkSize));
+			new (object(index)) T(std::forward<Args>(args)...);
+			constructed++;
+		}
+
+		if (++nextGeneration == 0) nextGeneration = 1;
+		PoolHandle h;
+		h.index = index;
+		h.generation = slot(index).generation = nextGeneration;
+		live++;
+		return h;
+	}
+
+	// the object, or NULL once it was released
+	//
+	T *get(PoolHandle h) const {
+		if (h.isNull() || h.index >= used || slot(h.index).generation != h.generation) return NULL;
+		return object(h.index);
+	}
+
+	void release(PoolHandle h) {
+		if (!get(h)) return;
+		slot(h.index).generation = 0;
+		freeSlots.push_back(h.index);
+		live--;
+	}
+
+	// release every object: the handles all go stale, since the slots are
+	// only looked at below the high water mark, which goes back to 0
+	//
+	void clear() {
+		used = 0;
+		live = 0;
+		freeSlots.clear();
+	}
+
+	// objects alive, and slots holding constructed objects
+	//
+	int size() const { return live; }
+	int capacity() const { return (int)constructed; }
+
+private:
+	struct Slot {
+		alignas(T) unsigned char storage[sizeof(T)];
+		uint32_t generation;
+	};
+
+	Slot &slot(uint32_t i) const { return chunks[i / chunkSize][i % chunkSize]; }
+	T *object(uint32_t i) const { return (T *)slot(i).storage; }
+
+	std::vector<Slot *> chunks;
+	std::vector<uint32_t> freeSlots;     // released slots below used
+	uint32_t used = 0;                   // slots handed out since the last clear()
+	uint32_t constructed = 0;            // slots holding an object
+	uint32_t nextGeneration = 0;
+	int live = 0;
+};
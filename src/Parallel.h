@@ -0,0 +1,52 @@
+//
+//  Parallel.h - Minimal fork/join helpers
+//
+//  parallelFor splits an index range into chunks and runs them on the
+//  shared work stealing pool (see ThreadPool.h); parallelInvoke runs two
+//  tasks side by side (used for recursive builds).  Both block until all
+//  the work is done, and both may be nested: a waiting thread works on
+//  pending tasks meanwhile.
+//
+#pragma once
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+// fn(begin, end) is called on disjoint sub ranges of at least grain indices.
+// A few chunks per thread let stealing even out chunks of uneven cost
+//
+template <class RangeFunc>
+void parallelFor(int begin, int end, int grain, RangeFunc fn) {
+	int n = end - begin;
+	if (n <= 0) return;
+	grain = std::max(grain, 1);
+	ThreadPool &pool = ThreadPool::instance();
+	int chunks = std::min(pool.concurrency() * 4, n / grain);
+	if (chunks <= 1 || pool.concurrency() == 1) {
+		fn(begin, end);
+		return;
+	}
+
+	int step = (n + chunks - 1) / chunks;
+	TaskGroup group;
+	for (int b = begin + step; b < end; b += step) {
+		int e = std::min(end, b + step);
+		pool.submit(group, [=, &fn] { fn(b, e); });
+	}
+	fn(begin, std::min(end, begin + step));
+	pool.wait(group);
+}
+
+template <class A, class B>
+void parallelInvoke(A a, B b) {
+	ThreadPool &pool = ThreadPool::instance();
+	if (pool.concurrency() == 1) {
+		a();
+		b();
+		return;
+	}
+	TaskGroup group;
+	pool.submit(group, [&a] { a(); });
+	b();
+	pool.wait(group);
+}
@@ -0,0 +1,92 @@
+//
+//  Pose.cpp - Flat skeleton pose stored as a structure of arrays
+//
+
+#include "Pose.h"
+
+void PoseBuffer::clear() {
+	parents.clear();
+	translations.clear();
+	orientations.clear();
+	scales.clear();
+	pivots.clear();
+	world.clear();
+}
+
+void PoseBuffer::reserve(int n) {
+	parents.reserve(n);
+	translations.reserve(n);
+	orientations.reserve(n);
+	scales.reserve(n);
+	pivots.reserve(n);
+	world.reserve(n);
+}
+
+int PoseBuffer::addJoint(int parent, const glm::vec3 &position, const glm::vec3 &rotation,
+	const glm::vec3 &scale, const glm::vec3 &pivot) {
+
+	return addJoint(parent, position, eulerToQuat(rotation), scale, pivot);
+}
+
+int PoseBuffer::addJoint(int parent, const glm::vec3 &position, const glm::quat &orientation,
+	const glm::vec3 &scale, const glm::vec3 &pivot) {
+
+	parents.push_back(parent < size() ? parent : -1);
+	translations.push_back(position);
+	orientations.push_back(orientation);
+	scales.push_back(scale);
+	pivots.push_back(pivot);
+	world.push_back(glm::mat4(1.0));
+	return size() - 1;
+}
+
+// Parents always precede their children, so by the time we reach joint i
+// the world matrix of its parent is already final.
+//
+void PoseBuffer::computeWorld() {
+	computeWorld(size(), parents.data(), translations.data(), orientations.data(), scales.data(), pivots.data(), world.data());
+}
+
+void PoseBuffer::computeWorld(int n, const int *parents, const glm::vec3 *translations, const glm::quat *orientations,
+	const glm::vec3 *scales, const glm::vec3 *pivots, glm::mat4 *world, const glm::mat4 &root) {
+
+	for (int i = 0; i < n; i++) {
+		glm::mat4 local = composeLocalMatrix(translations[i], orientations[i], scales[i], pivots[i]);
+		if (parents[i] < 0) world[i] = root * local;
+		else world[i] = world[parents[i]] * local;
+	}
+}
+
+// Breadth first walk from the roots over a child adjacency list built with a
+// counting sort (so it is linear in the number of joints).
+//
+std::vector<int> PoseBuffer::sortTopological(const std::vector<int> &parentOf) {
+	int n = (int)parentOf.size();
+
+	std::vector<int> childStart(n + 1, 0);
+	for (int i = 0; i < n; i++) {
+		int p = parentOf[i];
+		if (p >= 0 && p < n) childStart[p + 1]++;
+	}
+	for (int i = 0; i < n; i++) childStart[i + 1] += childStart[i];
+
+	std::vector<int> children(childStart[n]);
+	std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+	for (int i = 0; i < n; i++) {
+		int p = parentOf[i];
+		if (p >= 0 && p < n) children[fill[p]++] = i;
+	}
+
+	std::vector<int> order;
+	order.reserve(n);
+	for (int i = 0; i < n; i++) {
+		if (parentOf[i] < 0) order.push_back(i);
+	}
+	for (int head = 0; head < (int)order.size(); head++) {
+		int j = order[head];
+		for (int c = childStart[j]; c < childStart[j + 1]; c++) {
+			order.push_back(children[c]);
+		}
+	}
+	return order;
+}
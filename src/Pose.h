@@ -0,0 +1,111 @@
+//
+//  Pose.h - Flat skeleton pose stored as a structure of arrays
+//
+//  Joints are kept in topological order (a parent always has a smaller
+//  index than its children) so the local to world pass is a single linear
+//  loop over contiguous arrays - no recursion, no virtual calls, no
+//  pointer chasing.  Only depends on glm, so it can be used without a
+//  GL context.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtx/euler_angles.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+// Euler degrees (x pitch, y yaw, z roll, applied yaw * pitch * roll like
+// eulerAngleYXZ) to a unit quaternion and back.  Euler angles are what the
+// UI and the skeleton files use; the quaternion is what gets interpolated.
+//
+inline glm::quat eulerToQuat(const glm::vec3 &rotation) {
+	return glm::angleAxis(glm::radians(rotation.y), glm::vec3(0, 1, 0)) *
+		glm::angleAxis(glm::radians(rotation.x), glm::vec3(1, 0, 0)) *
+		glm::angleAxis(glm::radians(rotation.z), glm::vec3(0, 0, 1));
+}
+
+inline glm::vec3 quatToEuler(const glm::quat &q) {
+	float yaw, pitch, roll;
+	glm::extractEulerAngleYXZ(glm::mat4_cast(q), yaw, pitch, roll);
+	return glm::degrees(glm::vec3(pitch, yaw, roll));
+}
+
+// Compose a local matrix from translate/rotate(euler degrees, yaw pitch roll)/scale
+// and a rotate pivot.  This is the same composition as SceneObject::getLocalMatrix().
+//
+inline glm::mat4 composeLocalMatrix(const glm::vec3 &position, const glm::vec3 &rotation,
+	const glm::vec3 &scale, const glm::vec3 &pivot) {
+
+	glm::mat4 s = glm::scale(glm::mat4(1.0), scale);
+	glm::mat4 r = glm::eulerAngleYXZ(glm::radians(rotation.y), glm::radians(rotation.x), glm::radians(rotation.z));
+	glm::mat4 t = glm::translate(glm::mat4(1.0), position);
+	glm::mat4 pre = glm::translate(glm::mat4(1.0), -pivot);
+	glm::mat4 post = glm::translate(glm::mat4(1.0), pivot);
+	return (t * post * r * pre * s);
+}
+
+// same with the rotation given as a unit quaternion.  No trig and no
+// matrix products: t * post * r * pre * s is r * s with a translation of
+// position + pivot - r * pivot
+//
+inline glm::mat4 composeLocalMatrix(const glm::vec3 &position, const glm::quat &orientation,
+	const glm::vec3 &scale, const glm::vec3 &pivot) {
+
+	glm::mat3 r = glm::mat3_cast(orientation);
+	glm::mat4 m;
+	m[0] = glm::vec4(r[0] * scale.x, 0);
+	m[1] = glm::vec4(r[1] * scale.y, 0);
+	m[2] = glm::vec4(r[2] * scale.z, 0);
+	m[3] = glm::vec4(position + pivot - r * pivot, 1);
+	return m;
+}
+
+class PoseBuffer {
+public:
+
+	// number of joints
+	//
+	int size() const { return (int)parents.size(); }
+
+	void clear();
+	void reserve(int n);
+
+	// append a joint, parent must already be in the buffer (or -1 for a root).
+	// The rotation is given in euler degrees or as a quaternion.
+	// returns the index of the new joint
+	//
+	int addJoint(int parent, const glm::vec3 &position, const glm::vec3 &rotation,
+		const glm::vec3 &scale = glm::vec3(1, 1, 1), const glm::vec3 &pivot = glm::vec3(0, 0, 0));
+	int addJoint(int parent, const glm::vec3 &position, const glm::quat &orientation,
+		const glm::vec3 &scale = glm::vec3(1, 1, 1), const glm::vec3 &pivot = glm::vec3(0, 0, 0));
+
+	// local to world for every joint, in one pass
+	//
+	void computeWorld();
+
+	// the same pass over outside arrays, for poses that share the parents,
+	// scales and pivots of a rig.  Roots are placed by root
+	//
+	static void computeWorld(int n, const int *parents, const glm::vec3 *translations, const glm::quat *orientations,
+		const glm::vec3 *scales, const glm::vec3 *pivots, glm::mat4 *world, const glm::mat4 &root = glm::mat4(1.0));
+
+	// world space position of a joint (valid after computeWorld())
+	//
+	glm::vec3 getWorldPosition(int i) const { return glm::vec3(world[i][3]); }
+
+	// Returns an ordering of the joints described by parentOf (any order,
+	// -1 for roots) in which every parent comes before its children.
+	// Joints that are part of a cycle or point at a missing parent are left out.
+	//
+	static std::vector<int> sortTopological(const std::vector<int> &parentOf);
+
+	// joint data (all arrays have size() elements)
+	//
+	std::vector<int> parents;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> orientations;   // unit quaternions (see eulerToQuat())
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> pivots;
+	std::vector<glm::mat4> world;
+};
@@ -22,6 +22,125 @@ glm::mat4 SceneObject::rotateToVector(glm::vec3 v1, glm::vec3 v2) {
 	return glm::toMat4(q);
 }
 
+// Collect the complete trees that the given objects belong to.  Each tree is
+// walked breadth first from its root, so parents land before their children.
+//
+void ScenePose::build(const vector<SceneObject *> &objects) {
+	pose.clear();
+	nodes.clear();
+	index.clear();
+	pose.reserve(objects.size());
+
+	for (int i = 0; i < objects.size(); i++) {
+		SceneObject *root = objects[i];
+		while (root->parent) root = root->parent;
+		if (index.count(root)) continue;
+
+		int head = nodes.size();
+		index[root] = nodes.size();
+		nodes.push_back(root);
+		pose.addJoint(-1, root->position, root->getOrientation(), root->scale, root->pivot);
+
+		for (; head < nodes.size(); head++) {
+			SceneObject *node = nodes[head];
+			for (int c = 0; c < node->childList.size(); c++) {
+				SceneObject *child = node->childList[c];
+				if (index.count(child)) continue;
+				index[child] = nodes.size();
+				nodes.push_back(child);
+				pose.addJoint(head, child->position, child->getOrientation(), child->scale, child->pivot);
+			}
+		}
+	}
+}
+
+void ScenePose::pull() {
+	for (int i = 0; i < nodes.size(); i++) {
+		pose.translations[i] = nodes[i]->position;
+		pose.orientations[i] = nodes[i]->getOrientation();
+		pose.scales[i] = nodes[i]->scale;
+		pose.pivots[i] = nodes[i]->pivot;
+	}
+}
+
+// Every tree is pushed as a whole, so the cached matrices stay consistent
+// without any dirty propagation.
+//
+void ScenePose::push() {
+	for (int i = 0; i < nodes.size(); i++) {
+		SceneObject *node = nodes[i];
+		node->position = pose.translations[i];
+		node->orientation = pose.orientations[i];
+		node->bQuatRotation = true;
+		node->bEulerStale = true;
+		node->scale = pose.scales[i];
+		node->pivot = pose.pivots[i];
+		node->bLocalDirty = true;
+		node->setCachedWorld(pose.world[i]);
+	}
+}
+
+void ScenePose::pushWorld() {
+	for (int i = 0; i < nodes.size(); i++) nodes[i]->setCachedWorld(pose.world[i]);
+}
+
+// Build the BVH over the world bounds of every selectable object that has bounds
+//
+void ScenePicker::build(const vector<SceneObject *> &scene) {
+
+	// objects dropped from the scene may already be gone, so the old queue is
+	// cleared without looking at its entries
+	//
+	objects.clear();
+	moved.clear();
+	vector<glm::vec3> mins, maxs;
+	for (int i = 0; i < scene.size(); i++) {
+		glm::vec3 min, max;
+		if (!scene[i]->isSelectable || !scene[i]->getWorldBounds(min, max)) continue;
+		scene[i]->moveQueue = &moved;
+		scene[i]->pickItem = objects.size();
+		scene[i]->bMoveQueued = false;
+		objects.push_back(scene[i]);
+		mins.push_back(min);
+		maxs.push_back(max);
+	}
+	bvh.build(mins, maxs);
+}
+
+// an object that was built into an earlier BVH (made unselectable since) can
+// still queue itself, so the leaf is only refit if it still belongs to it
+//
+void ScenePicker::refit() {
+	for (int i = 0; i < moved.size(); i++) {
+		SceneObject *obj = moved[i];
+		obj->bMoveQueued = false;
+		int item = obj->pickItem;
+		if (item < 0 || item >= objects.size() || objects[item] != obj) continue;
+
+		glm::vec3 min, max;
+		obj->getWorldBounds(min, max);
+		bvh.refit(item, min, max);
+	}
+	moved.clear();
+}
+
+SceneObject *ScenePicker::pick(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, float &dist) {
+	float dd = glm::dot(ray.d, ray.d);
+	dist = std::numeric_limits<float>::max();
+
+	int hit = bvh.closestHit(ray.p, ray.d, dist, [&](int item, float &tBest) {
+		glm::vec3 p, n;
+		if (!objects[item]->intersect(ray, p, n)) return false;
+		float t = glm::dot(p - ray.p, ray.d) / dd;
+		if (t < 0 || t >= tBest) return false;
+		tBest = t;
+		point = p;
+		normal = n;
+		return true;
+	});
+	return (hit < 0 ? NULL : objects[hit]);
+}
+
 // Draw a Unit cube (size = 2) transformed 
 //
 void Cone::draw() {
@@ -48,13 +167,13 @@ void Cone::draw() {
 //  Cone::intersect - test intersection with bounding box.  Note that
 //  intersection test is done in object space with an axis aligned box (AAB), 
 //  the input ray is provided in world space, so we need to transform the ray to object space.
-//  this method does NOT return a normal.
+//  this method returns the world space hit point but does NOT return a normal.
 //
 bool Cone::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
 
 	// transform Ray to object space.  
 	//
-	glm::mat4 mInv = glm::inverse(getMatrix());
+	const glm::mat4 &mInv = getInverseMatrix();
 	glm::vec4 p = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
 	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
 	glm::vec3 d = glm::normalize(p1 - p);
@@ -67,8 +186,13 @@ bool Cone::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
 
 	// we will test for intersection in object space (object is a "unit" cube edge is len=2)
 	//
+	// only hits in front of the ray origin count
+	//
 	Box box = Box(Vector3(-radius, -radius, 0), Vector3(radius, radius, height));
-	return (box.intersect(boxRay, -1000, 1000));
+	float t;
+	if (!box.intersect(boxRay, 0, 1000, t)) return false;
+	point = getMatrix() * glm::vec4(glm::vec3(p) + d * t, 1.0);
+	return true;
 }
 
 
@@ -99,6 +223,91 @@ void Mesh::draw()
 {
 	mesh.drawWireframe();
 }
+
+/**
+* Bind the model to joints in their current pose with the model matrix it
+* has now, which it keeps from then on.  The levels of detail are simplified
+* again so they keep the joint boundaries of the weights.
+*/
+void Mesh::bindSkin(const vector<SceneObject *> &joints, const SkinWeights &weights)
+{
+	skinJoints = joints;
+	skin.weights = weights;
+	vector<glm::mat4> world(joints.size());
+	for (int j = 0; j < joints.size(); j++) world[j] = joints[j]->getMatrix();
+	skin.bind(mesh.getModelMatrix(), world.data(), (int)world.size());
+	mesh.buildLod(&skin.weights);
+	bSkinStale = true;
+}
+
+/**
+* Deform the bind geometry with the joints' current world matrices and
+* upload the result.  The BVH is refit to it on the next ray query.  Nothing
+* is done while no joint has moved since the last deform.
+*/
+void Mesh::updateSkin()
+{
+	if (!isSkinned()) return;
+	jointWorld.resize(skinJoints.size());
+	jointVersions.resize(skinJoints.size());
+	bool bMoved = bSkinStale;
+	for (int j = 0; j < skinJoints.size(); j++)
+	{
+		jointWorld[j] = skinJoints[j]->getMatrix();
+		if (jointVersions[j] != skinJoints[j]->worldVersion) bMoved = true;
+		jointVersions[j] = skinJoints[j]->worldVersion;
+	}
+	if (!bMoved) return;
+	bSkinStale = false;
+	skin.deform(mesh.getData(), jointWorld.data(), skinned);
+	mesh.updateVertices(skinned.positions.data(), skinned.normals.empty() ? NULL : skinned.normals.data(), (int)skinned.positions.size());
+	bBvhPoseStale = true;
+}
+
+/**
+* Build the triangle BVH over the model's geometry (in model space).
+* Models loaded from a cache come with the tree already built.
+*/
+void Mesh::buildBvh()
+{
+	const MeshData &data = mesh.getData();
+	const MeshCache *cache = mesh.getCache();
+	if (cache && cache->hasBvh())
+	{
+		bvh.build(data.positions, data.indices, data.normals, cache->nodes(), cache->nodeCount(), cache->items());
+	}
+	else
+	{
+		bvh.build(data.positions, data.indices, data.normals);
+	}
+}
+
+/**
+* Closest triangle hit.  The ray is brought into model space through the
+* model matrix; point and normal are returned in world space.  A skinned
+* mesh is hit where it is drawn: the BVH is refit to the skinned vertices
+* first if they changed since the last query.
+*/
+bool Mesh::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal)
+{
+	if (bvh.empty()) buildBvh();
+	if (bBvhPoseStale)
+	{
+		bvh.refit(skinned.positions, mesh.getData().indices, skinned.normals);
+		bBvhPoseStale = false;
+	}
+
+	glm::mat4 m = mesh.getModelMatrix();
+	glm::mat4 mInv = glm::inverse(m);
+	glm::vec3 p = mInv * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = mInv * glm::vec4(ray.d, 0.0);
+
+	MeshHit hit;
+	if (!bvh.closestHit(p, d, hit)) return false;
+	point = m * glm::vec4(hit.point, 1.0);
+	normal = glm::normalize(glm::transpose(glm::mat3(mInv)) * hit.normal);
+	return true;
+}
 void Joint::draw()
 {
 	//   get the current transformation matrix for this object
@@ -180,24 +389,31 @@ bool Sphere::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
 
 	// transform Ray to object space.  
 	//
-	glm::mat4 mInv = glm::inverse(getMatrix());
+	const glm::mat4 &mInv = getInverseMatrix();
 	glm::vec4 p = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
 	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
 	glm::vec3 d = glm::normalize(p1 - p);
 
-	return (glm::intersectRaySphere(glm::vec3(p), d, glm::vec3(0, 0, 0), radius, point, normal));
+	if (!glm::intersectRaySphere(glm::vec3(p), d, glm::vec3(0, 0, 0), radius, point, normal)) return false;
+
+	// hit is in object space, bring it back to world space
+	//
+	const glm::mat4 &m = getMatrix();
+	point = m * glm::vec4(point, 1.0);
+	normal = glm::normalize(glm::transpose(glm::mat3(mInv)) * normal);
+	return true;
 }
 
 //  Cube::intersect - test intersection with the unit Cube.  Note that
 //  intersection test is done in object space with an axis aligned box (AAB), 
 //  the input ray is provided in world space, so we need to transform the ray to object space.
-//  this method does NOT return a normal.
+//  this method returns the world space hit point but does NOT return a normal.
 //
 bool Cube::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
 
 	// transform Ray to object space.  
 	//
-	glm::mat4 mInv = glm::inverse(getMatrix());
+	const glm::mat4 &mInv = getInverseMatrix();
 	glm::vec4 p = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
 	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
 	glm::vec3 d = glm::normalize(p1 - p);
@@ -210,8 +426,13 @@ bool Cube::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
 
 	// we will test for intersection in object space (object is a "unit" cube edge is len=2)
 	//
+	// only hits in front of the ray origin count
+	//
 	Box box = Box(Vector3(-width/2.0, -height/2.0, -depth/2.0), Vector3(width/2.0, height/2.0, depth/2.0));
-	return (box.intersect(boxRay, -1000, 1000));
+	float t;
+	if (!box.intersect(boxRay, 0, 1000, t)) return false;
+	point = getMatrix() * glm::vec4(glm::vec3(p) + d * t, 1.0);
+	return true;
 
 }
 
@@ -12,9 +12,15 @@
 
 #include "ofMain.h"
 #include "box.h"
+#include "Pose.h"
+#include "Bvh.h"
+#include "MeshBvh.h"
 #include "glm/gtx/euler_angles.hpp"
 #include "glm/gtx/intersect.hpp"
-#include "ofxAssimpModelLoader.h"
+#include "Model.h"
+#include "Skinning.h"
+#include "ObjectPool.h"
+#include <unordered_map>
 
 //  General Purpose Ray class 
 //
@@ -35,11 +41,37 @@ public:
 class SceneObject {
 public: 
 	virtual void draw() = 0;    // pure virtual funcs - must be overloaded
+
+	// ray is in world space, point (and normal, where supported) are returned in world space
+	//
 	virtual bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) { return false; }
 
+	// object space bounding box used by the picking BVH.
+	// return false if the object has no extent that can be picked
+	//
+	virtual bool getLocalBounds(glm::vec3 &min, glm::vec3 &max) { return false; }
+
+	// world space axis aligned box around the (transformed) local bounds
+	//
+	bool getWorldBounds(glm::vec3 &min, glm::vec3 &max) {
+		glm::vec3 lmin, lmax;
+		if (!getLocalBounds(lmin, lmax)) return false;
+
+		// transform center and half extent instead of all eight corners
+		//
+		const glm::mat4 &m = getMatrix();
+		glm::vec3 c = m * glm::vec4((lmin + lmax) * 0.5f, 1.0);
+		glm::vec3 e = (lmax - lmin) * 0.5f;
+		glm::vec3 we = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+		min = c - we;
+		max = c + we;
+		return true;
+	}
+
 	// commonly used transformations
 	//
 	glm::mat4 getRotateMatrix() {
+		if (bQuatRotation) return glm::mat4_cast(orientation);
 		return (glm::eulerAngleYXZ(glm::radians(rotation.y), glm::radians(rotation.x), glm::radians(rotation.z)));   // yaw, pitch, roll 
 	}
 	glm::mat4 getTranslateMatrix() {
@@ -52,33 +84,42 @@ public:
 
 	glm::mat4 getLocalMatrix() {
 
-		// get the local transformations + pivot
-		//
-		glm::mat4 scale = getScaleMatrix();
-		glm::mat4 rotate = getRotateMatrix();
-		glm::mat4 trans = getTranslateMatrix();
-
-		// handle pivot point  (rotate around a point that is not the object's center)
+		// local matrix is cached and only rebuilt after one of the
+		// position/rotation/scale/pivot setters has been called
 		//
-		glm::mat4 pre = glm::translate(glm::mat4(1.0), glm::vec3(-pivot.x, -pivot.y, -pivot.z));
-		glm::mat4 post = glm::translate(glm::mat4(1.0), glm::vec3(pivot.x, pivot.y, pivot.z));
-
-	
-
-	    return (trans * post * rotate * pre * scale);
-
+		if (bLocalDirty) {
+			if (bQuatRotation) localMatrix = composeLocalMatrix(position, orientation, scale, pivot);
+			else localMatrix = composeLocalMatrix(position, rotation, scale, pivot);   // trans * post * rotate * pre * scale
+			bLocalDirty = false;
+		}
+		return localMatrix;
 	}
 
-	glm::mat4 getMatrix() {
+	const glm::mat4 &getMatrix() {
 
 		// if we have a parent (we are not the root),
-		// concatenate parent's transform (this is recursive)
+		// concatenate parent's transform (this is recursive, but the
+		// parent chain is only walked when something above us changed)
 		// 
-		if (parent) {
-			glm::mat4 M = parent->getMatrix();
-			return (M * getLocalMatrix());
+		if (bWorldDirty) {
+			if (parent) worldMatrix = parent->getMatrix() * getLocalMatrix();
+			else worldMatrix = getLocalMatrix();  // priority order is SRT
+			bWorldDirty = false;
+			bInverseDirty = true;
+			worldVersion++;
+		}
+		return worldMatrix;
+	}
+
+	// inverse of the world matrix, used to bring rays into object space
+	//
+	const glm::mat4 &getInverseMatrix() {
+		getMatrix();
+		if (bInverseDirty) {
+			inverseMatrix = glm::inverse(worldMatrix);
+			bInverseDirty = false;
 		}
-		else return getLocalMatrix();  // priority order is SRT
+		return inverseMatrix;
 	}
 
 	// get current Position in World Space
@@ -90,7 +131,73 @@ public:
 	// set position (pos is in world space)
 	//
 	void setPosition(glm::vec3 pos) {
-		position = glm::inverse(getMatrix()) * glm::vec4(pos, 1.0);
+		setLocalPosition(getInverseMatrix() * glm::vec4(pos, 1.0));
+	}
+
+	// setters for the local channels.  Always go through these (or call
+	// markDirty() after writing the fields directly) so the cached matrices
+	// of this object and everything below it get rebuilt.
+	//
+	void setLocalPosition(glm::vec3 p) { position = p; markDirty(); }
+	void setRotation(glm::vec3 r) { rotation = r; bQuatRotation = false; bEulerStale = false; markDirty(); }
+	void setScale(glm::vec3 s) { scale = s; markDirty(); }
+	void setPivot(glm::vec3 p) { pivot = p; markDirty(); }
+
+	// rotation as a unit quaternion.  Setting it puts the object in quaternion
+	// mode (setRotation() switches back); the euler angles are then only a view
+	// that getRotation() derives on demand, so animated joints never go
+	// through euler angles and their trig
+	//
+	void setOrientation(const glm::quat &q) { orientation = q; bQuatRotation = true; bEulerStale = true; markDirty(); }
+	glm::quat getOrientation() const { return bQuatRotation ? orientation : eulerToQuat(rotation); }
+
+	// euler degrees (yaw, pitch, roll order), whichever mode the object is in
+	//
+	const glm::vec3 &getRotation() {
+		if (bEulerStale) {
+			rotation = quatToEuler(orientation);
+			bEulerStale = false;
+		}
+		return rotation;
+	}
+
+	// invalidate the local matrix and the world matrix of the whole subtree
+	//
+	void markDirty() {
+		bLocalDirty = true;
+		markWorldDirty();
+	}
+
+	// take a world matrix that was evaluated elsewhere (see ScenePose::push()).
+	// the caller has to keep the whole subtree consistent.
+	//
+	void setCachedWorld(const glm::mat4 &m) {
+		worldMatrix = m;
+		bWorldDirty = false;
+		bInverseDirty = true;
+		worldVersion++;
+		queueMove();
+	}
+
+	// a dirty node always has dirty descendants (a world matrix is only
+	// rebuilt after its parent's), so we can stop at the first dirty one
+	//
+	void markWorldDirty() {
+		if (bWorldDirty) return;
+		bWorldDirty = true;
+		queueMove();
+		for (int i = 0; i < childList.size(); i++) {
+			childList[i]->markWorldDirty();
+		}
+	}
+
+	// hand the object to the picker it was last built into (see ScenePicker::refit()),
+	// once until the picker has refit it
+	//
+	void queueMove() {
+		if (!moveQueue || bMoveQueued) return;
+		bMoveQueued = true;
+		moveQueue->push_back(this);
 	}
 
 	// return a rotation  matrix that rotates one vector to another
@@ -102,6 +209,14 @@ public:
 	void addChild(SceneObject *child) {
 		childList.push_back(child);
 		child->parent = this;
+		child->markWorldDirty();
+	}
+
+	// detach from the parent (the child list of the parent is left to the caller)
+	//
+	void clearParent() {
+		parent = NULL;
+		markWorldDirty();
 	}
 
 	SceneObject *parent = NULL;        // if parent = NULL, then this obj is the ROOT
@@ -110,12 +225,31 @@ public:
 	// position/orientation 
 	//
 	glm::vec3 position = glm::vec3(0, 0, 0);   // translate
-	glm::vec3 rotation = glm::vec3(0, 0, 0);   // rotate
+	glm::vec3 rotation = glm::vec3(0, 0, 0);   // rotate (read through getRotation())
+	glm::quat orientation = glm::quat(1, 0, 0, 0);   // rotate, used instead of rotation in quaternion mode
+	bool bQuatRotation = false;
+	bool bEulerStale = false;
 	glm::vec3 scale = glm::vec3(1, 1, 1);      // scale
 
 	// rotate pivot
 	//
 	glm::vec3 pivot = glm::vec3(0, 0, 0);
+
+	// cached transforms (see getLocalMatrix(), getMatrix(), getInverseMatrix())
+	//
+	glm::mat4 localMatrix = glm::mat4(1.0);
+	glm::mat4 worldMatrix = glm::mat4(1.0);
+	glm::mat4 inverseMatrix = glm::mat4(1.0);
+	bool bLocalDirty = true;
+	bool bWorldDirty = true;
+	bool bInverseDirty = true;
+	unsigned int worldVersion = 0;     // bumped every time the world matrix changes
+
+	// leaf of the object in the picker BVH and the picker's queue of moved objects
+	//
+	vector<SceneObject *> *moveQueue = NULL;
+	int pickItem = -1;
+	bool bMoveQueued = false;
 	 
 	// material properties (we will ultimately replace this with a Material class - TBD)
 	//
@@ -126,6 +260,76 @@ public:
 	//
 	bool isSelectable = true;
 	string name = "SceneObject";
+
+	// slot in the pool the object came from, null if it wasn't pooled
+	//
+	PoolHandle handle;
+};
+
+//  Flat pose of one or more SceneObject hierarchies (see Pose.h).
+//  nodes[i] is the scene object stored at index i of the pose buffer.
+//
+class ScenePose {
+public:
+	// collect the full trees of the given objects in parent-first order
+	//
+	void build(const vector<SceneObject *> &objects);
+
+	// copy the local channels from the scene objects into the buffer
+	//
+	void pull();
+
+	// write channels and evaluated world matrices back to the scene objects.
+	// rotations are written as quaternions (see SceneObject::setOrientation())
+	//
+	void push();
+
+	// write only the evaluated world matrices back
+	//
+	void pushWorld();
+
+	// pull, one linear local to world pass, pushWorld.  The local channels
+	// are untouched, so euler nodes keep their angles as they were entered
+	//
+	void evaluate() {
+		pull();
+		pose.computeWorld();
+		pushWorld();
+	}
+
+	// pose index of an object, -1 if it is not part of this pose
+	//
+	int indexOf(SceneObject *obj) const {
+		auto it = index.find(obj);
+		return (it == index.end() ? -1 : it->second);
+	}
+
+	PoseBuffer pose;
+	vector<SceneObject *> nodes;
+	unordered_map<SceneObject *, int> index;
+};
+
+//  World space BVH over the selectable objects of the scene (see Bvh.h).
+//  Leaves are refit from the objects' world bounds when their transforms change.
+//
+class ScenePicker {
+public:
+	void build(const vector<SceneObject *> &scene);
+
+	// refit the leaves of the objects whose world matrix changed since the last
+	// call.  Objects queue themselves when they are marked dirty or given a new
+	// world matrix, so the cost follows the number of moved objects
+	//
+	void refit();
+
+	// closest object hit by the ray.  point/normal are the world space hit,
+	// dist the ray parameter of the hit (point = ray.p + dist * ray.d)
+	//
+	SceneObject *pick(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, float &dist);
+
+	Bvh bvh;
+	vector<SceneObject *> objects;
+	vector<SceneObject *> moved;
 };
 
 class Cone : public SceneObject {
@@ -141,6 +345,11 @@ public:
 	}
 	void draw();
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal);
+	bool getLocalBounds(glm::vec3 &min, glm::vec3 &max) {
+		min = glm::vec3(-radius, -radius, 0);
+		max = glm::vec3(radius, radius, height);
+		return true;
+	}
 
 	float radius = 1.0;
 	float height = 2.0;
@@ -159,6 +368,11 @@ public:
 	}
 	void draw();
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal);
+	bool getLocalBounds(glm::vec3 &min, glm::vec3 &max) {
+		max = glm::vec3(width, height, depth) * 0.5f;
+		min = -max;
+		return true;
+	}
 
 	float width = 2.0;
 	float height = 2.0;
@@ -172,6 +386,11 @@ public:
 	Sphere(glm::vec3 p, float r, ofColor diffuse = ofColor::lightGray) { position = p; radius = r; diffuseColor = diffuse; }
 	Sphere() {}
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal);
+	bool getLocalBounds(glm::vec3 &min, glm::vec3 &max) {
+		min = glm::vec3(-radius);
+		max = glm::vec3(radius);
+		return true;
+	}
 	void draw();
 
 	float radius = 1.0;
@@ -195,16 +414,36 @@ public:
 //  Custom Mesh Class
 class Mesh : public SceneObject {
 public:
-	ofxAssimpModelLoader mesh;
+	Model mesh;
 	string name;
 
-	Mesh(ofxAssimpModelLoader model, string n)
+	// triangle BVH in model space, built on the first ray query.  Skinned
+	// meshes refit it to the drawn pose when a ray comes after a new pose
+	MeshBvh bvh;
+	bool bBvhPoseStale = false;
+
+	// skin weights refer to skinJoints; a mesh without weights follows its
+	// joint rigidly.  jointVersions are the joints' world versions at the last
+	// deform; bSkinStale forces the next one after a rebind or a mode switch
+	Skin skin;
+	vector<SceneObject *> skinJoints;
+	SkinnedVertices skinned;
+	vector<glm::mat4> jointWorld;
+	vector<unsigned int> jointVersions;
+	bool bSkinStale = true;
+
+	Mesh(Model model, string n)
 	{
 		mesh = model;
 		name = n;
 	}
-	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) { return false;  }
+	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal);
+	void buildBvh();
 	void draw();
+
+	bool isSkinned() const { return !skin.weights.empty(); }
+	void bindSkin(const vector<SceneObject *> &joints, const SkinWeights &weights);
+	void updateSkin();
 };
 
 
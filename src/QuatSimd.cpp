@@ -0,0 +1,255 @@
+//
+//  QuatSimd.cpp - Batched quaternion interpolation
+//
+
+#include "QuatSimd.h"
+#include <cmath>
+
+#if QUAT_LANES > 1
+#include <immintrin.h>
+#endif
+
+// no fused multiply-adds: the compiler contracts the scalar tail and the
+// vector lanes differently, and then a quaternion's result would depend on
+// where in the batch it lands
+//
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+// the kernels only ever see a quaternion as four packed floats; the order of
+// the components doesn't matter for a dot product or a weighted sum
+//
+static_assert(sizeof(glm::quat) == 4 * sizeof(float), "glm::quat must be four packed floats");
+
+// Lane abstractions, every kernel below is written once against these.
+// load() reads width quaternions and transposes them into x/y/z/w vectors,
+// store() does the reverse.
+//
+struct ScalarQuatLanes {
+	enum { width = 1 };
+	typedef float V;
+	static void load(const float *p, V &x, V &y, V &z, V &w) { x = p[0]; y = p[1]; z = p[2]; w = p[3]; }
+	static void store(float *p, V x, V y, V z, V w) { p[0] = x; p[1] = y; p[2] = z; p[3] = w; }
+	static V loadT(const float *p) { return *p; }
+	static V set1(float f) { return f; }
+	static V add(V a, V b) { return a + b; }
+	static V sub(V a, V b) { return a - b; }
+	static V mul(V a, V b) { return a * b; }
+	static V div(V a, V b) { return a / b; }
+	static V sqrt(V a) { return std::sqrt(a); }
+	static V min(V a, V b) { return a < b ? a : b; }
+	static V max(V a, V b) { return a > b ? a : b; }
+	static V abs(V a) { return std::fabs(a); }
+	static V flipSign(V a, V s) { return std::signbit(s) ? -a : a; }   // a with its sign flipped where s is negative
+	static V selectGt(V a, V b, V x, V y) { return a > b ? x : y; }    // a > b ? x : y
+};
+
+#if QUAT_LANES >= 4
+struct SSEQuatLanes {
+	enum { width = 4 };
+	typedef __m128 V;
+	static void load(const float *p, V &x, V &y, V &z, V &w) {
+		x = _mm_loadu_ps(p);
+		y = _mm_loadu_ps(p + 4);
+		z = _mm_loadu_ps(p + 8);
+		w = _mm_loadu_ps(p + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+	}
+	static void store(float *p, V x, V y, V z, V w) {
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(p, x);
+		_mm_storeu_ps(p + 4, y);
+		_mm_storeu_ps(p + 8, z);
+		_mm_storeu_ps(p + 12, w);
+	}
+	static V loadT(const float *p) { return _mm_loadu_ps(p); }
+	static V set1(float f) { return _mm_set1_ps(f); }
+	static V add(V a, V b) { return _mm_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm_div_ps(a, b); }
+	static V sqrt(V a) { return _mm_sqrt_ps(a); }
+	static V min(V a, V b) { return _mm_min_ps(a, b); }
+	static V max(V a, V b) { return _mm_max_ps(a, b); }
+	static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	static V flipSign(V a, V s) { return _mm_xor_ps(a, _mm_and_ps(s, _mm_set1_ps(-0.0f))); }
+	static V selectGt(V a, V b, V x, V y) {
+		V m = _mm_cmpgt_ps(a, b);
+		return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+	}
+};
+#endif
+
+#if QUAT_LANES >= 8
+
+// 4x4 transpose inside each 128 bit half
+//
+static inline void transposeHalves(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3) {
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+	__m256 t1 = _mm256_unpacklo_ps(r2, r3);
+	__m256 t2 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+	r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// quaternions i and i + 4 share a register, so after the in-lane transpose
+// lane j holds quaternion j and t can be loaded as it is
+//
+static inline __m256 loadPair(const float *p) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 16), 1);
+}
+
+static inline void storePair(float *p, __m256 v) {
+	_mm_storeu_ps(p, _mm256_castps256_ps128(v));
+	_mm_storeu_ps(p + 16, _mm256_extractf128_ps(v, 1));
+}
+
+struct AVXQuatLanes {
+	enum { width = 8 };
+	typedef __m256 V;
+	static void load(const float *p, V &x, V &y, V &z, V &w) {
+		x = loadPair(p);
+		y = loadPair(p + 4);
+		z = loadPair(p + 8);
+		w = loadPair(p + 12);
+		transposeHalves(x, y, z, w);
+	}
+	static void store(float *p, V x, V y, V z, V w) {
+		transposeHalves(x, y, z, w);
+		storePair(p, x);
+		storePair(p + 4, y);
+		storePair(p + 8, z);
+		storePair(p + 12, w);
+	}
+	static V loadT(const float *p) { return _mm256_loadu_ps(p); }
+	static V set1(float f) { return _mm256_set1_ps(f); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+	static V min(V a, V b) { return _mm256_min_ps(a, b); }
+	static V max(V a, V b) { return _mm256_max_ps(a, b); }
+	static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	static V flipSign(V a, V s) { return _mm256_xor_ps(a, _mm256_and_ps(s, _mm256_set1_ps(-0.0f))); }
+	static V selectGt(V a, V b, V x, V y) { return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+};
+#endif
+
+#if QUAT_LANES == 8
+typedef AVXQuatLanes QuatLanes;
+#elif QUAT_LANES == 4
+typedef SSEQuatLanes QuatLanes;
+#else
+typedef ScalarQuatLanes QuatLanes;
+#endif
+
+// acos on [0, 1], Abramowitz & Stegun 4.4.46 (error below 2e-8)
+//
+template <class L>
+static inline typename L::V acosPoly(typename L::V x) {
+	typedef typename L::V V;
+	V p = L::set1(-0.0012624911f);
+	p = L::add(L::mul(p, x), L::set1(0.0066700901f));
+	p = L::add(L::mul(p, x), L::set1(-0.0170881256f));
+	p = L::add(L::mul(p, x), L::set1(0.0308918810f));
+	p = L::add(L::mul(p, x), L::set1(-0.0501743046f));
+	p = L::add(L::mul(p, x), L::set1(0.0889789874f));
+	p = L::add(L::mul(p, x), L::set1(-0.2145988016f));
+	p = L::add(L::mul(p, x), L::set1(1.5707963050f));
+	return L::mul(L::sqrt(L::sub(L::set1(1.0f), x)), p);
+}
+
+// sin on [0, pi/2], Taylor series to x^11 (error below 6e-8)
+//
+template <class L>
+static inline typename L::V sinPoly(typename L::V x) {
+	typedef typename L::V V;
+	V x2 = L::mul(x, x);
+	V p = L::set1(-1.0f / 39916800.0f);
+	p = L::add(L::mul(p, x2), L::set1(1.0f / 362880.0f));
+	p = L::add(L::mul(p, x2), L::set1(-1.0f / 5040.0f));
+	p = L::add(L::mul(p, x2), L::set1(1.0f / 120.0f));
+	p = L::add(L::mul(p, x2), L::set1(-1.0f / 6.0f));
+	p = L::add(L::mul(p, x2), L::set1(1.0f));
+	return L::mul(p, x);
+}
+
+// L::width pairs: shortest arc, weights (plain or spherical), weighted sum, normalize
+//
+template <class L, bool bSlerp>
+static inline void blendLanes(const float *a, const float *b, const float *t, float *out) {
+	typedef typename L::V V;
+	V ax, ay, az, aw, bx, by, bz, bw;
+	L::load(a, ax, ay, az, aw);
+	L::load(b, bx, by, bz, bw);
+	V u = L::loadT(t);
+
+	V d = L::add(L::add(L::mul(ax, bx), L::mul(ay, by)), L::add(L::mul(az, bz), L::mul(aw, bw)));
+	bx = L::flipSign(bx, d);
+	by = L::flipSign(by, d);
+	bz = L::flipSign(bz, d);
+	bw = L::flipSign(bw, d);
+	d = L::min(L::abs(d), L::set1(1.0f));
+
+	V wb = u;
+	V wa = L::sub(L::set1(1.0f), u);
+	if (bSlerp) {
+		V theta = acosPoly<L>(d);
+		V sinTheta = L::max(L::sqrt(L::sub(L::set1(1.0f), L::mul(d, d))), L::set1(1e-6f));
+		V sa = L::div(sinPoly<L>(L::mul(wa, theta)), sinTheta);
+		V sb = L::div(sinPoly<L>(L::mul(wb, theta)), sinTheta);
+		V nearlyEqual = L::set1(0.9995f);
+		wa = L::selectGt(d, nearlyEqual, wa, sa);
+		wb = L::selectGt(d, nearlyEqual, wb, sb);
+	}
+
+	V rx = L::add(L::mul(wa, ax), L::mul(wb, bx));
+	V ry = L::add(L::mul(wa, ay), L::mul(wb, by));
+	V rz = L::add(L::mul(wa, az), L::mul(wb, bz));
+	V rw = L::add(L::mul(wa, aw), L::mul(wb, bw));
+	V len = L::sqrt(L::add(L::add(L::mul(rx, rx), L::mul(ry, ry)), L::add(L::mul(rz, rz), L::mul(rw, rw))));
+	L::store(out, L::div(rx, len), L::div(ry, len), L::div(rz, len), L::div(rw, len));
+}
+
+template <bool bSlerp>
+static void blendBatch(const glm::quat *a, const glm::quat *b, const float *t, glm::quat *out, int n) {
+	const float *pa = (const float *)a;
+	const float *pb = (const float *)b;
+	float *po = (float *)out;
+	int i = 0;
+	for (; i + QuatLanes::width <= n; i += QuatLanes::width) {
+		blendLanes<QuatLanes, bSlerp>(pa + 4 * i, pb + 4 * i, t + i, po + 4 * i);
+	}
+	for (; i < n; i++) {
+		blendLanes<ScalarQuatLanes, bSlerp>(pa + 4 * i, pb + 4 * i, t + i, po + 4 * i);
+	}
+}
+
+void nlerpBatch(const glm::quat *a, const glm::quat *b, const float *t, glm::quat *out, int n) {
+	blendBatch<false>(a, b, t, out, n);
+}
+
+void slerpBatch(const glm::quat *a, const glm::quat *b, const float *t, glm::quat *out, int n) {
+	blendBatch<true>(a, b, t, out, n);
+}
+
+glm::quat nlerpQuat(const glm::quat &a, const glm::quat &b, float t) {
+	glm::quat r;
+	blendLanes<ScalarQuatLanes, false>((const float *)&a, (const float *)&b, &t, (float *)&r);
+	return r;
+}
+
+glm::quat slerpQuat(const glm::quat &a, const glm::quat &b, float t) {
+	glm::quat r;
+	blendLanes<ScalarQuatLanes, true>((const float *)&a, (const float *)&b, &t, (float *)&r);
+	return r;
+}
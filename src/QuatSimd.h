@@ -0,0 +1,39 @@
+//
+//  QuatSimd.h - Batched quaternion interpolation
+//
+//  nlerp and slerp of n quaternion pairs at once, QUAT_LANES pairs per step
+//  with SSE (4) or AVX (8) depending on what the translation unit is
+//  compiled for.  Quaternions stay in their usual array of structures
+//  layout and are transposed in registers, so callers can pass the arrays
+//  they already have.
+//
+//  Both take the shortest arc (b is negated when the pair is more than 90
+//  degrees apart) and return unit quaternions.  slerp uses polynomial acos
+//  and sin instead of the library calls, good to a few 1e-7, and falls back
+//  to nlerp for nearly equal pairs.  The scalar versions run exactly the
+//  same arithmetic, and QuatSimd.cpp turns off multiply-add contraction so
+//  FMA builds keep it that way: a quaternion gets the same result whether
+//  it lands in a vector lane or in the tail.  Only depends on glm.
+//
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#if defined(__AVX__)
+#define QUAT_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUAT_LANES 4
+#else
+#define QUAT_LANES 1
+#endif
+
+// out[i] = blend of a[i] and b[i] at t[i] (0 to 1).  out may be a or b
+//
+void nlerpBatch(const glm::quat *a, const glm::quat *b, const float *t, glm::quat *out, int n);
+void slerpBatch(const glm::quat *a, const glm::quat *b, const float *t, glm::quat *out, int n);
+
+// one pair, same results as the batched versions
+//
+glm::quat nlerpQuat(const glm::quat &a, const glm::quat &b, float t);
+glm::quat slerpQuat(const glm::quat &a, const glm::quat &b, float t);
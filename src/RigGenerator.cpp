@@ -0,0 +1,42 @@
+//
+//  RigGenerator.cpp - Synthetic skeletons for benchmarks and stress tests
+//
+
+#include "RigGenerator.h"
+#include <random>
+#include <string>
+
+SkeletonFile generateRig(const RigShape &shape) {
+	SkeletonFile file;
+	if (shape.depth < 1 || shape.maxJoints < 1) return file;
+
+	std::mt19937 rng(shape.seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	JointDesc root;
+	root.name = "joint0";
+	file.joints.reserve(shape.maxJoints);
+	file.addJoint(root);
+
+	// level by level: [levelStart, levelEnd) are the joints of the level
+	// being given children
+	//
+	int levelStart = 0;
+	for (int level = 1; level < shape.depth; level++) {
+		int levelEnd = (int)file.joints.size();
+		for (int parent = levelStart; parent < levelEnd; parent++) {
+			for (int c = 0; c < shape.branching; c++) {
+				if ((int)file.joints.size() >= shape.maxJoints) return file;
+				JointDesc joint;
+				joint.name = "joint" + std::to_string(file.joints.size());
+				joint.parent = parent;
+				joint.translation = glm::vec3(unit(rng), -1.0f, unit(rng)) * shape.boneLength;
+				joint.rotation = glm::vec3(unit(rng), unit(rng), unit(rng)) * shape.maxAngle;
+				file.addJoint(joint);
+			}
+		}
+		if ((int)file.joints.size() == levelEnd) break;
+		levelStart = levelEnd;
+	}
+	return file;
+}
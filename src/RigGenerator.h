@@ -0,0 +1,50 @@
+//
+//  RigGenerator.h - Synthetic skeletons for benchmarks and stress tests
+//
+//  Builds trees of any shape out of a few numbers: every joint gets
+//  branching children, level by level, until the tree is depth levels deep
+//  or has maxJoints joints.  Branching 1 is a chain (deep rigs), depth 2 a
+//  root with a fan of children (wide rigs), anything in between a bushy
+//  tree.  Bone offsets and rotations are random but seeded, so the same
+//  shape is the same rig on every run and machine, and saving it with
+//  SkeletonFile::saveText() makes model.txt files of any size.  Only
+//  depends on glm.
+//
+#pragma once
+
+#include <stdint.h>
+#include "SkeletonFile.h"
+
+struct RigShape {
+	int depth = 8;             // levels, the root is level 1
+	int branching = 2;         // children of every joint above the last level
+	int maxJoints = 1 << 20;
+	float boneLength = 0.5f;
+	float maxAngle = 30;       // largest rest rotation per axis, degrees
+	uint32_t seed = 1;
+
+	static RigShape chain(int depth) {
+		RigShape s;
+		s.depth = depth;
+		s.branching = 1;
+		return s;
+	}
+	static RigShape fan(int width) {
+		RigShape s;
+		s.depth = 2;
+		s.branching = width;
+		return s;
+	}
+	static RigShape tree(int depth, int branching, int maxJoints) {
+		RigShape s;
+		s.depth = depth;
+		s.branching = branching;
+		s.maxJoints = maxJoints;
+		return s;
+	}
+};
+
+// joints named joint0, joint1, ... in breadth first order, so parents come
+// first like in the files the app saves
+//
+SkeletonFile generateRig(const RigShape &shape);
@@ -0,0 +1,98 @@
+//
+//  SkeletonBatch.cpp - Draw buffers of a whole skeleton, built once per frame
+//
+
+#include "SkeletonBatch.h"
+#include "Parallel.h"
+#include "glm/gtc/quaternion.hpp"
+#include <algorithm>
+#include <cmath>
+
+// rotation taking +y to the unit vector dir, like SceneObject::rotateToVector()
+// but also for dir along the y axis, where the cross product vanishes
+//
+static glm::mat3 rotateYTo(const glm::vec3 &dir) {
+	glm::vec3 axis(dir.z, 0, -dir.x);       // cross((0, 1, 0), dir)
+	float s = glm::length(axis);
+	if (s < 1e-6f) return dir.y >= 0 ? glm::mat3(1.0f) : glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, -1));
+	return glm::mat3_cast(glm::angleAxis(std::atan2(s, dir.y), axis / s));
+}
+
+// Bones are numbered in joint order, so the line vertices only move when a
+// parent does.  The colors are written here and left alone by build()
+//
+void SkeletonBatch::layout(int n, const int *parents) {
+	if (n == (int)lastParents.size() && std::equal(parents, parents + n, lastParents.begin()) && !lineColors.empty()) return;
+	lastParents.assign(parents, parents + n);
+	version++;
+
+	boneStart.resize(n);
+	nBones = 0;
+	for (int i = 0; i < n; i++) {
+		bool bBone = parents[i] >= 0 && parents[i] < n && parents[i] != i;
+		boneStart[i] = bBone ? 6 * n + 16 * nBones++ : -1;
+	}
+	int total = 6 * n + 16 * nBones;
+	lineVertices.resize(total);
+	lineColors.resize(total);
+
+	const glm::vec4 axisColors[3] = { glm::vec4(1, 0, 0, 1), glm::vec4(0, 1, 0, 1), glm::vec4(0, 0, 1, 1) };
+	for (int i = 0; i < n; i++) {
+		for (int k = 0; k < 6; k++) lineColors[6 * i + k] = axisColors[k / 2];
+	}
+	std::fill(lineColors.begin() + 6 * n, lineColors.end(), boneColor);
+}
+
+void SkeletonBatch::build(int n, const int *parents, const glm::mat4 *world, const glm::vec3 *translations,
+	const float *radii, const glm::vec4 *colors) {
+
+	layout(n, parents);
+	instanceMatrices.resize(n);
+	instanceColors.resize(n);
+
+	parallelFor(0, n, 256, [&](int b, int e) {
+		for (int i = b; i < e; i++) {
+			const glm::mat4 &m = world[i];
+			glm::vec3 origin(m[3]);
+
+			instanceMatrices[i] = glm::mat4(m[0] * radii[i], m[1] * radii[i], m[2] * radii[i], m[3]);
+			instanceColors[i] = colors[i];
+
+			glm::vec3 *axes = &lineVertices[6 * i];
+			for (int k = 0; k < 3; k++) {
+				axes[2 * k] = origin;
+				axes[2 * k + 1] = origin + glm::vec3(m[k]) * axisLength;
+			}
+
+			// the pyramid of Joint::draw(), drawn by the parent: its apex in
+			// the parent's sphere, its base the child's radius short of the
+			// child, turned within the parent's frame towards the child
+			//
+			if (boneStart[i] < 0) continue;
+			float len = glm::length(translations[i]);
+			glm::vec3 *bone = &lineVertices[boneStart[i]];
+			const glm::mat4 &pm = world[parents[i]];
+			glm::vec3 from(pm[3]);
+			if (len == 0) {
+				for (int k = 0; k < 16; k++) bone[k] = from;
+				continue;
+			}
+			glm::mat3 frame = glm::mat3(pm) * rotateYTo(translations[i] / len);
+			float baseW = radii[i] / 2.5f;
+			float height = glm::distance(from, origin) - radii[i];
+			glm::vec3 p[5] = {
+				from + frame * glm::vec3(baseW, height, baseW),
+				from + frame * glm::vec3(-baseW, height, baseW),
+				from + frame * glm::vec3(-baseW, height, -baseW),
+				from + frame * glm::vec3(baseW, height, -baseW),
+				from + frame * glm::vec3(0, radii[parents[i]], 0)
+			};
+			for (int k = 0; k < 4; k++) {
+				bone[2 * k] = p[k];
+				bone[2 * k + 1] = p[4];
+				bone[8 + 2 * k] = p[k];
+				bone[8 + 2 * k + 1] = p[(k + 1) % 4];
+			}
+		}
+	});
+}
@@ -0,0 +1,64 @@
+//
+//  SkeletonBatch.h - Draw buffers of a whole skeleton, built once per frame
+//
+//  Joint::draw() takes a sphere, eight lines per bone and three axis lines
+//  per joint, each its own draw call.  build() produces the same picture as
+//  a handful of arrays instead: one instance per joint (the sphere's
+//  transform and color) and one GL_LINES vertex list with the bone
+//  pyramids and the RGB axes of every joint.  The arrays keep their
+//  capacity from frame to frame, so they can be uploaded over the previous
+//  frame's buffers (see SkeletonRenderer.h).
+//
+//  Joints are built in parallel on the work stealing pool (see
+//  ThreadPool.h).  Only depends on glm, so it runs and is benchmarked
+//  without a window.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+class SkeletonBatch {
+public:
+
+	// n joints in any order.  parents[i] is -1 for a root; translations[i]
+	// is joint i's position relative to its parent, which the bone from the
+	// parent points along.  A sphere of radii[i] is drawn at world[i]
+	//
+	void build(int n, const int *parents, const glm::mat4 *world, const glm::vec3 *translations,
+		const float *radii, const glm::vec4 *colors);
+
+	int jointCount() const { return (int)instanceMatrices.size(); }
+	int boneCount() const { return nBones; }
+	int lineVertexCount() const { return (int)lineVertices.size(); }
+
+	// bumped whenever the line layout (and so lineColors) changed, i.e. the
+	// joint count or a parent.  Otherwise only the positions are new
+	//
+	int layoutVersion() const { return version; }
+
+	// look of the lines, as drawn by Joint::draw().  The colors are taken
+	// when the layout changes, so set them before the first build()
+	//
+	float axisLength = 1.5f;
+	glm::vec4 boneColor = glm::vec4(1.0f, 182 / 255.0f, 193 / 255.0f, 1.0f);     // ofColor::lightPink
+
+	// per joint: world * scale(radius) of a unit sphere, and its color
+	//
+	std::vector<glm::mat4> instanceMatrices;
+	std::vector<glm::vec4> instanceColors;
+
+	// line pairs: the axes of joint i at [6 i, 6 i + 6), then 16 vertices
+	// (4 edges to the apex, 4 around the base) for every bone
+	//
+	std::vector<glm::vec3> lineVertices;
+	std::vector<glm::vec4> lineColors;
+
+private:
+	void layout(int n, const int *parents);
+
+	std::vector<int> lastParents;
+	std::vector<int> boneStart;     // first line vertex of joint i's bone from its parent, -1 for roots
+	int nBones = 0;
+	int version = 0;
+};
@@ -0,0 +1,334 @@
+//
+//  SkeletonFile.cpp - Reading skeleton files (model.txt)
+//
+
+#include "SkeletonFile.h"
+#include "MappedFile.h"
+#include "NumberParse.h"
+#include "TextParse.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace TextParse;
+
+bool SkeletonFile::loadText(const std::string &path) {
+	MappedFile file;
+	if (!file.open(path)) {
+		clear();
+		error = "can't open " + path;
+		return false;
+	}
+	return parseText(file.data(), file.size());
+}
+
+void SkeletonFile::clear() {
+	joints.clear();
+	index.clear();
+	error.clear();
+}
+
+bool SkeletonFile::parseText(const char *data, size_t size) {
+	clear();
+
+	// parent names by joint, with where they were read for error reporting
+	//
+	struct ParentRef {
+		const char *name;
+		size_t length;
+		int line, column;
+	};
+	std::vector<ParentRef> parents;
+
+	const char *end = data + size;
+	const char *p = data;
+	int line = 0;
+	LineParser lp;
+	while (p < end && !lp.message) {
+		const char *eol = (const char *)memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+		line++;
+		lp.lineStart = p;
+
+		const char *q = skipSpace(p, eol);
+		p = eol + 1;
+		if (q == eol) continue;    // blank line
+
+		if (!matchWord(q, eol, "create")) {
+			lp.fail(q, "expected 'create'");
+			break;
+		}
+		q = skipSpace(q, eol);
+		if (!matchWord(q, eol, "-joint")) {
+			lp.fail(q, "expected '-joint'");
+			break;
+		}
+
+		JointDesc joint;
+		ParentRef parent = { NULL, 0, 0, 0 };
+		const char *name = NULL;
+		while (!lp.message) {
+			q = skipSpace(q, eol);
+			if (q < eol && *q == ';') break;
+			if (!name) {
+				// the joint name follows -joint
+				name = q;
+				q = skipName(q, eol);
+				if (q == name) {
+					lp.fail(q, "expected a joint name");
+					break;
+				}
+				joint.name.assign(name, q - name);
+			}
+			else if (matchWord(q, eol, "-rotate")) lp.vector(q, eol, joint.rotation);
+			else if (matchWord(q, eol, "-translate")) lp.vector(q, eol, joint.translation);
+			else if (matchWord(q, eol, "-parent")) {
+				// the parent name is empty for roots
+				q = skipSpace(q, eol);
+				parent.name = q;
+				q = skipName(q, eol);
+				parent.length = q - parent.name;
+				parent.line = line;
+				parent.column = (int)(parent.name - lp.lineStart) + 1;
+			}
+			else lp.fail(q, q == eol ? "expected ';'" : "unknown option");
+		}
+		if (lp.message) break;
+
+		q = skipSpace(q + 1, eol);
+		if (q != eol) {
+			lp.fail(q, "unexpected text after ';'");
+			break;
+		}
+
+		int i = (int)joints.size();
+		if (!index.emplace(joint.name, i).second) {
+			lp.fail(name, "duplicate joint name");
+			break;
+		}
+		joints.push_back(std::move(joint));
+		parents.push_back(parent);
+	}
+
+	if (lp.message) {
+		error = lp.describe(line);
+		joints.clear();
+		index.clear();
+		return false;
+	}
+
+	// resolve parents now that all the names are known
+	//
+	for (int i = 0; i < joints.size(); i++) {
+		const ParentRef &ref = parents[i];
+		if (ref.length == 0) continue;
+		auto it = index.find(std::string(ref.name, ref.length));
+		if (it == index.end() || it->second == i) {
+			error = "line " + std::to_string(ref.line) + ", column " + std::to_string(ref.column) + ": " +
+				(it == index.end() ? "unknown parent joint" : "joint is its own parent");
+			joints.clear();
+			index.clear();
+			return false;
+		}
+		joints[i].parent = it->second;
+	}
+
+	int loop = findParentLoop();
+	if (loop >= 0) {
+		const ParentRef &ref = parents[loop];
+		error = "line " + std::to_string(ref.line) + ", column " + std::to_string(ref.column) + ": parent links form a loop";
+		joints.clear();
+		index.clear();
+		return false;
+	}
+	return true;
+}
+
+// A loop in the parent links would hang every walk up the hierarchy.
+// Each chain is followed until it reaches a root or a joint already known
+// to lead to one, so this stays linear.
+//
+int SkeletonFile::findParentLoop() const {
+	std::vector<char> state(joints.size(), 0);    // 0 unseen, 1 on the current chain, 2 leads to a root
+	for (int i = 0; i < joints.size(); i++) {
+		int j = i;
+		while (j >= 0 && state[j] == 0) {
+			state[j] = 1;
+			j = joints[j].parent;
+		}
+		if (j >= 0 && state[j] == 1) return j;
+		for (j = i; j >= 0 && state[j] == 1; j = joints[j].parent) state[j] = 2;
+	}
+	return -1;
+}
+
+int SkeletonFile::addJoint(const JointDesc &joint) {
+	int i = (int)joints.size();
+	if (!index.emplace(joint.name, i).second) return -1;
+	joints.push_back(joint);
+	return i;
+}
+
+bool SkeletonFile::saveText(const std::string &path) const {
+	std::string text;
+	for (int i = 0; i < joints.size(); i++) {
+		const JointDesc &j = joints[i];
+		text += "create -joint " + j.name +
+			" -rotate " + formatVector(j.rotation) +
+			" -translate " + formatVector(j.translation) +
+			" -parent " + (j.parent >= 0 ? joints[j.parent].name : std::string()) + ";";
+		if (i != joints.size() - 1) text += "\n";
+	}
+	return writeFile(path, text.data(), text.size());
+}
+
+bool SkeletonFile::writeFile(const std::string &path, const void *data, size_t size) {
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+	bool bOk = fwrite(data, 1, size, f) == size;
+	return (fclose(f) == 0) && bOk;
+}
+
+// Binary layout (little endian):
+//
+//   SkeletonBinaryHeader
+//   SkeletonBinaryJoint x jointCount
+//   string table: the joint names back to back, not terminated
+//
+struct SkeletonBinaryHeader {
+	char magic[8];          // "SKELETON"
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t jointCount;
+	uint32_t stringBytes;
+};
+
+struct SkeletonBinaryJoint {
+	float rotation[3];
+	float translation[3];
+	int32_t parent;         // -1 for roots
+	uint32_t nameOffset;    // into the string table
+	uint32_t nameLength;
+};
+
+static const char skeletonMagic[8] = { 'S', 'K', 'E', 'L', 'E', 'T', 'O', 'N' };
+
+bool SkeletonFile::saveBinary(const std::string &path) const {
+	SkeletonBinaryHeader header;
+	memcpy(header.magic, skeletonMagic, sizeof(header.magic));
+	header.version = binaryVersion;
+	header.headerSize = sizeof(SkeletonBinaryHeader);
+	header.jointCount = (uint32_t)joints.size();
+	header.stringBytes = 0;
+	for (int i = 0; i < joints.size(); i++) header.stringBytes += (uint32_t)joints[i].name.size();
+
+	// built in memory and written with a single call
+	//
+	std::vector<char> buffer(sizeof(header) + joints.size() * sizeof(SkeletonBinaryJoint) + header.stringBytes);
+	memcpy(buffer.data(), &header, sizeof(header));
+	SkeletonBinaryJoint *out = (SkeletonBinaryJoint *)(buffer.data() + sizeof(header));
+	char *strings = (char *)(out + joints.size());
+	uint32_t offset = 0;
+	for (int i = 0; i < joints.size(); i++) {
+		const JointDesc &j = joints[i];
+		for (int a = 0; a < 3; a++) {
+			out[i].rotation[a] = j.rotation[a];
+			out[i].translation[a] = j.translation[a];
+		}
+		out[i].parent = j.parent;
+		out[i].nameOffset = offset;
+		out[i].nameLength = (uint32_t)j.name.size();
+		memcpy(strings + offset, j.name.data(), j.name.size());
+		offset += (uint32_t)j.name.size();
+	}
+	return writeFile(path, buffer.data(), buffer.size());
+}
+
+bool SkeletonFile::loadBinary(const std::string &path) {
+	MappedFile file;
+	if (!file.open(path)) {
+		clear();
+		error = "can't open " + path;
+		return false;
+	}
+	return parseBinary(file.data(), file.size());
+}
+
+bool SkeletonFile::parseBinary(const char *data, size_t size) {
+	clear();
+	SkeletonBinaryHeader header;
+	if (size < sizeof(header)) {
+		error = "file too short";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, skeletonMagic, sizeof(skeletonMagic)) != 0) {
+		error = "not a binary skeleton file";
+		return false;
+	}
+	if (header.version != binaryVersion || header.headerSize != sizeof(header)) {
+		error = "unsupported version " + std::to_string(header.version);
+		return false;
+	}
+	uint64_t expected = sizeof(header) + (uint64_t)header.jointCount * sizeof(SkeletonBinaryJoint) + header.stringBytes;
+	if (expected != size) {
+		error = "file size doesn't match the header";
+		return false;
+	}
+
+	// the records aren't necessarily aligned in memory, so copy them out
+	//
+	const char *records = data + sizeof(header);
+	const char *strings = records + header.jointCount * sizeof(SkeletonBinaryJoint);
+	joints.resize(header.jointCount);
+	index.reserve(header.jointCount);
+	for (uint32_t i = 0; i < header.jointCount; i++) {
+		SkeletonBinaryJoint in;
+		memcpy(&in, records + i * sizeof(SkeletonBinaryJoint), sizeof(in));
+		JointDesc &j = joints[i];
+		j.rotation = glm::vec3(in.rotation[0], in.rotation[1], in.rotation[2]);
+		j.translation = glm::vec3(in.translation[0], in.translation[1], in.translation[2]);
+		j.parent = in.parent;
+
+		const char *message = NULL;
+		if ((uint64_t)in.nameOffset + in.nameLength > header.stringBytes) message = "name outside the string table";
+		else if (in.parent < -1 || in.parent >= (int32_t)header.jointCount || in.parent == (int32_t)i) message = "bad parent index";
+		else {
+			j.name.assign(strings + in.nameOffset, in.nameLength);
+			if (!index.emplace(j.name, (int)i).second) message = "duplicate joint name";
+		}
+		if (message) {
+			error = "joint " + std::to_string(i) + ": " + message;
+			joints.clear();
+			index.clear();
+			return false;
+		}
+	}
+
+	int loop = findParentLoop();
+	if (loop >= 0) {
+		error = "joint " + std::to_string(loop) + ": parent links form a loop";
+		joints.clear();
+		index.clear();
+		return false;
+	}
+	return true;
+}
+
+int SkeletonFile::find(const std::string &name) const {
+	auto it = index.find(name);
+	return it == index.end() ? -1 : it->second;
+}
+
+int SkeletonFile::maxJointNumber() const {
+	int maxNumber = -1;
+	for (int i = 0; i < joints.size(); i++) {
+		const std::string &name = joints[i].name;
+		size_t k = name.size();
+		while (k > 0 && NumberParse::isDigit(name[k - 1])) k--;
+		if (k == name.size() || name.size() - k > 9) continue;
+		maxNumber = std::max(maxNumber, atoi(name.c_str() + k));
+	}
+	return maxNumber;
+}
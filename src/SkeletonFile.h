@@ -0,0 +1,73 @@
+//
+//  SkeletonFile.h - Reading skeleton files (model.txt)
+//
+//  One joint per line, as written by ofApp::saveToFile():
+//
+//    create -joint joint1 -rotate <0, 0, 0> -translate <0, -1.44, 0> -parent joint0;
+//
+//  The buffer is parsed in a single pass without copying lines or splitting
+//  them into tokens.  Parents are resolved through a name -> joint hash
+//  index once every joint is known, so loading is linear in the size of the
+//  file and a parent may come after its children.  Malformed input is
+//  reported with its line and column.
+//
+//  Numbers are written with the fewest digits that read back exactly, so
+//  text files lose nothing.  The binary form (model.skel) holds the same
+//  data: versioned header, fixed size joint records with full precision
+//  transforms and parent indices, then a string table of the names.  It is
+//  mapped and read in one pass.  Text and binary convert into each other
+//  without loss.  Only depends on glm.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "glm/glm.hpp"
+
+struct JointDesc {
+	std::string name;
+	glm::vec3 rotation = glm::vec3(0, 0, 0);       // euler angles, degrees
+	glm::vec3 translation = glm::vec3(0, 0, 0);    // relative to the parent
+	int parent = -1;                               // index in SkeletonFile::joints
+};
+
+class SkeletonFile {
+public:
+	bool loadText(const std::string &path);
+	bool parseText(const char *data, size_t size);
+	bool saveText(const std::string &path) const;
+
+	static const uint32_t binaryVersion = 1;
+	bool loadBinary(const std::string &path);
+	bool parseBinary(const char *data, size_t size);
+	bool saveBinary(const std::string &path) const;
+
+	// append a joint, returns its index or -1 if the name is taken.
+	// joint.parent is an index into joints (or -1)
+	//
+	int addJoint(const JointDesc &joint);
+
+	// index of the joint with the given name, -1 if there is none
+	//
+	int find(const std::string &name) const;
+
+	// largest number n of the joints named <anything>n, -1 if none are.
+	// createJoint() numbers new joints past it
+	//
+	int maxJointNumber() const;
+
+	void clear();
+
+	std::vector<JointDesc> joints;
+
+	// "line L, column C: message" after a failed load or parse
+	std::string error;
+
+private:
+	int findParentLoop() const;
+	static bool writeFile(const std::string &path, const void *data, size_t size);
+
+	std::unordered_map<std::string, int> index;
+};
@@ -0,0 +1,133 @@
+//
+//  SkeletonRenderer.cpp - GPU side of a SkeletonBatch
+//
+
+#include "SkeletonRenderer.h"
+
+// The instance matrix scales and places the unit sphere.  Lighting is a
+// diffuse term of light 0, where the OF light is in the fixed pipeline
+//
+static const char *jointVertexShader = R"(
+#version 120
+attribute mat4 instanceMatrix;
+attribute vec4 instanceColor;
+varying vec3 eyeNormal;
+varying vec3 eyePosition;
+varying vec4 color;
+
+void main() {
+	vec4 eye = gl_ModelViewMatrix * (instanceMatrix * gl_Vertex);
+	eyePosition = eye.xyz;
+	eyeNormal = gl_NormalMatrix * (mat3(instanceMatrix[0].xyz, instanceMatrix[1].xyz, instanceMatrix[2].xyz) * gl_Normal);
+	color = instanceColor;
+	gl_Position = gl_ProjectionMatrix * eye;
+}
+)";
+
+static const char *jointFragmentShader = R"(
+#version 120
+varying vec3 eyeNormal;
+varying vec3 eyePosition;
+varying vec4 color;
+
+void main() {
+	vec4 light = gl_LightSource[0].position;
+	vec3 l = normalize(light.xyz - eyePosition * light.w);
+	float diffuse = max(dot(normalize(eyeNormal), l), 0.0);
+	gl_FragColor = vec4(color.rgb * (0.2 + 0.8 * diffuse), color.a);
+}
+)";
+
+// The sphere of ofDrawSphere() (same resolution) with the instance
+// attributes wired to the two buffers: a mat4 takes four locations, one
+// per column
+//
+bool SkeletonRenderer::setupInstancing() {
+	bSetupTried = true;
+	if (ofIsGLProgrammableRenderer()) return false;
+	if (!shader.setupShaderFromSource(GL_VERTEX_SHADER, jointVertexShader) ||
+		!shader.setupShaderFromSource(GL_FRAGMENT_SHADER, jointFragmentShader) ||
+		!shader.linkProgram()) {
+		ofLogWarning("SkeletonRenderer") << "instancing shader failed, joints are drawn one by one";
+		return false;
+	}
+	int matrixLocation = shader.getAttributeLocation("instanceMatrix");
+	int colorLocation = shader.getAttributeLocation("instanceColor");
+	if (matrixLocation < 0 || colorLocation < 0) return false;
+
+	ofMesh mesh = ofMesh::sphere(1.0, 20);
+	sphere.setMesh(mesh, GL_STATIC_DRAW);
+	sphereIndexCount = (int)mesh.getNumIndices();
+
+	instanceCapacity = 1024;
+	matrixBuffer.allocate(instanceCapacity * sizeof(glm::mat4), GL_DYNAMIC_DRAW);
+	colorBuffer.allocate(instanceCapacity * sizeof(glm::vec4), GL_DYNAMIC_DRAW);
+	for (int k = 0; k < 4; k++) {
+		sphere.setAttributeBuffer(matrixLocation + k, matrixBuffer, 4, sizeof(glm::mat4), k * sizeof(glm::vec4));
+		sphere.setAttributeDivisor(matrixLocation + k, 1);
+	}
+	sphere.setAttributeBuffer(colorLocation, colorBuffer, 4, sizeof(glm::vec4));
+	sphere.setAttributeDivisor(colorLocation, 1);
+	return true;
+}
+
+// Growing a buffer object reallocates its storage under the same name, so
+// the attribute bindings made in setupInstancing() stay valid
+//
+void SkeletonRenderer::update(const SkeletonBatch &batch) {
+	if (!bSetupTried) bInstanced = setupInstancing();
+
+	instanceCount = batch.jointCount();
+	if (bInstanced && instanceCount > 0) {
+		if ((size_t)instanceCount > instanceCapacity) {
+			instanceCapacity = std::max((size_t)instanceCount, instanceCapacity * 2);
+			matrixBuffer.allocate(instanceCapacity * sizeof(glm::mat4), GL_DYNAMIC_DRAW);
+			colorBuffer.allocate(instanceCapacity * sizeof(glm::vec4), GL_DYNAMIC_DRAW);
+		}
+		matrixBuffer.updateData(0, instanceCount * sizeof(glm::mat4), batch.instanceMatrices.data());
+		colorBuffer.updateData(0, instanceCount * sizeof(glm::vec4), batch.instanceColors.data());
+	}
+
+	// ofFloatColor is four floats, like the glm::vec4 colors
+	//
+	lineCount = batch.lineVertexCount();
+	if (lineCount == 0) return;
+	const ofFloatColor *colors = (const ofFloatColor *)batch.lineColors.data();
+	if (lineCount > lineCapacity) {
+		lineCapacity = lineCount;
+		lines.setVertexData(batch.lineVertices.data(), lineCount, GL_DYNAMIC_DRAW);
+		lines.setColorData(colors, lineCount, GL_DYNAMIC_DRAW);
+		lineLayout = batch.layoutVersion();
+		return;
+	}
+	lines.updateVertexData(batch.lineVertices.data(), lineCount);
+	if (lineLayout != batch.layoutVersion()) {
+		lines.updateColorData(colors, lineCount);
+		lineLayout = batch.layoutVersion();
+	}
+}
+
+void SkeletonRenderer::drawJoints(const SkeletonBatch &batch) {
+	if (instanceCount == 0) return;
+	if (bInstanced) {
+		shader.begin();
+		sphere.drawElementsInstanced(GL_TRIANGLES, sphereIndexCount, instanceCount);
+		shader.end();
+		return;
+	}
+	for (int i = 0; i < batch.jointCount(); i++) {
+		const glm::vec4 &c = batch.instanceColors[i];
+		ofSetColor(ofColor(c.x * 255, c.y * 255, c.z * 255, c.w * 255));
+		ofPushMatrix();
+		ofMultMatrix(batch.instanceMatrices[i]);
+		ofDrawSphere(1.0);
+		ofPopMatrix();
+	}
+}
+
+void SkeletonRenderer::drawLines() {
+	if (lineCount == 0) return;
+	ofSetLineWidth(1.0);
+	ofSetColor(ofColor::white);
+	lines.draw(GL_LINES, 0, lineCount);
+}
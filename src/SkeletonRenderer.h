@@ -0,0 +1,49 @@
+//
+//  SkeletonRenderer.h - GPU side of a SkeletonBatch
+//
+//  update() copies the batch into buffers that live as long as the
+//  renderer: they are only reallocated when the skeleton outgrows them,
+//  otherwise overwritten in place, and the line colors are only sent again
+//  when the batch's layout changed.  drawJoints() then draws every joint
+//  sphere with one instanced call and drawLines() every bone and axis with
+//  one GL_LINES call.
+//
+//  The instanced spheres need the fixed function (GL 2) renderer the app
+//  runs on, for the GLSL 120 shader and its use of the OF light.  Where the
+//  shader can't be used the spheres are drawn one by one, the lines are
+//  still a single call.  Main thread only.
+//
+#pragma once
+
+#include "ofMain.h"
+#include "SkeletonBatch.h"
+
+class SkeletonRenderer {
+public:
+	void update(const SkeletonBatch &batch);
+
+	// lit like the other objects (enable lighting first), and the lines
+	// unlit in their own colors
+	//
+	void drawJoints(const SkeletonBatch &batch);
+	void drawLines();
+
+	bool isInstanced() const { return bInstanced; }
+
+private:
+	bool setupInstancing();
+
+	ofVbo sphere;
+	int sphereIndexCount = 0;
+	ofShader shader;
+	ofBufferObject matrixBuffer, colorBuffer;
+	size_t instanceCapacity = 0;       // instances the buffers hold
+	int instanceCount = 0;
+	bool bInstanced = false;
+	bool bSetupTried = false;
+
+	ofVbo lines;
+	int lineCapacity = 0;
+	int lineCount = 0;
+	int lineLayout = -1;               // batch layoutVersion() of the colors in lines
+};
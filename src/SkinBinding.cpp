@@ -0,0 +1,407 @@
+//
+//  SkinBinding.cpp - Automatic skin weights against a skeleton
+//
+
+#include "SkinBinding.h"
+#include "MeshCache.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+
+static const float infinity = std::numeric_limits<float>::infinity();
+
+std::vector<BoneSegment> boneSegments(const std::vector<int> &parents, const std::vector<glm::vec3> &positions) {
+	int n = (int)parents.size();
+	std::vector<bool> bHasChildren(n, false);
+	std::vector<BoneSegment> bones;
+	for (int i = 0; i < n; i++) {
+		int p = parents[i];
+		if (p < 0) continue;
+		bHasChildren[p] = true;
+		BoneSegment bone;
+		bone.a = positions[p];
+		bone.b = positions[i];
+		bone.joint = p;
+		bones.push_back(bone);
+	}
+	for (int i = 0; i < n; i++) {
+		if (bHasChildren[i]) continue;
+		BoneSegment bone;
+		bone.a = bone.b = positions[i];
+		bone.joint = i;
+		bones.push_back(bone);
+	}
+	return bones;
+}
+
+static float segmentDistance(const glm::vec3 &p, const BoneSegment &bone) {
+	glm::vec3 ab = bone.b - bone.a;
+	float len2 = glm::dot(ab, ab);
+	float t = len2 > 0 ? glm::clamp(glm::dot(p - bone.a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+	return glm::length(p - (bone.a + ab * t));
+}
+
+static int jointCount(const std::vector<BoneSegment> &bones) {
+	int n = 0;
+	for (int i = 0; i < bones.size(); i++) n = std::max(n, bones[i].joint + 1);
+	return n;
+}
+
+// distance[j] = straight line distance to the nearest bone of joint j
+//
+static void euclideanDistances(const glm::vec3 &p, const std::vector<BoneSegment> &bones, float *distance) {
+	for (int i = 0; i < bones.size(); i++) {
+		float d = segmentDistance(p, bones[i]);
+		distance[bones[i].joint] = std::min(distance[bones[i].joint], d);
+	}
+}
+
+// Solid voxels of a mesh: the ones its triangles touch and the ones they
+// enclose.  A mesh with holes just has no interior, its shell still counts.
+// The grid has an empty border of two voxels so the outside is connected.
+//
+struct VoxelGrid {
+	glm::vec3 origin;
+	float size = 1;
+	int nx = 0, ny = 0, nz = 0;
+	std::vector<uint8_t> solid;
+
+	int index(int x, int y, int z) const { return (z * ny + y) * nx + x; }
+	int count() const { return nx * ny * nz; }
+
+	void cell(const glm::vec3 &p, int &x, int &y, int &z) const {
+		glm::vec3 c = (p - origin) / size;
+		x = glm::clamp((int)std::floor(c.x), 0, nx - 1);
+		y = glm::clamp((int)std::floor(c.y), 0, ny - 1);
+		z = glm::clamp((int)std::floor(c.z), 0, nz - 1);
+	}
+	int cellIndex(const glm::vec3 &p) const {
+		int x, y, z;
+		cell(p, x, y, z);
+		return index(x, y, z);
+	}
+	glm::vec3 center(int i) const {
+		int x = i % nx, y = (i / nx) % ny, z = i / (nx * ny);
+		return origin + (glm::vec3((float)x, (float)y, (float)z) + 0.5f) * size;
+	}
+
+	void build(const MeshData &mesh, int resolution);
+};
+
+void VoxelGrid::build(const MeshData &mesh, int resolution) {
+	glm::vec3 lo, hi;
+	if (!mesh.getBounds(lo, hi)) {
+		lo = hi = glm::vec3(0, 0, 0);
+	}
+	glm::vec3 extent = hi - lo;
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	size = longest > 0 ? longest / std::max(resolution, 1) : 1.0f;
+	origin = lo - 2.0f * size;
+	nx = (int)std::ceil(extent.x / size) + 4;
+	ny = (int)std::ceil(extent.y / size) + 4;
+	nz = (int)std::ceil(extent.z / size) + 4;
+	solid.assign((size_t)count(), 0);
+
+	// surface: triangles are sampled at half a voxel or closer, each slab of
+	// the grid only marks its own voxels so slabs can run side by side
+	//
+	int nTris = mesh.triangleCount();
+	std::vector<int> zRange(2 * (size_t)nTris);
+	parallelFor(0, nTris, 4096, [&](int b, int e) {
+		for (int t = b; t < e; t++) {
+			int lo = nz, hi = -1;
+			for (int k = 0; k < 3; k++) {
+				int x, y, z;
+				cell(mesh.positions[mesh.indices[3 * t + k]], x, y, z);
+				lo = std::min(lo, z);
+				hi = std::max(hi, z);
+			}
+			zRange[2 * t] = lo;
+			zRange[2 * t + 1] = hi;
+		}
+	});
+	parallelFor(0, nz, 1, [&](int zb, int ze) {
+		for (int t = 0; t < nTris; t++) {
+			if (zRange[2 * t + 1] < zb || zRange[2 * t] >= ze) continue;
+			glm::vec3 a = mesh.positions[mesh.indices[3 * t]];
+			glm::vec3 e1 = mesh.positions[mesh.indices[3 * t + 1]] - a;
+			glm::vec3 e2 = mesh.positions[mesh.indices[3 * t + 2]] - a;
+			float longestEdge = std::max(glm::length(e1), std::max(glm::length(e2), glm::length(e2 - e1)));
+			int n = std::max(1, (int)std::ceil(2.0f * longestEdge / size));
+			for (int i = 0; i <= n; i++) {
+				for (int j = 0; i + j <= n; j++) {
+					int x, y, z;
+					cell(a + e1 * ((float)i / n) + e2 * ((float)j / n), x, y, z);
+					if (z >= zb && z < ze) solid[index(x, y, z)] = 1;
+				}
+			}
+		}
+	});
+
+	// interior: whatever the outside can't reach through empty voxels
+	//
+	std::vector<uint8_t> outside((size_t)count(), 0);
+	std::vector<int> stack;
+	stack.push_back(0);
+	outside[0] = 1;
+	while (!stack.empty()) {
+		int i = stack.back();
+		stack.pop_back();
+		int x = i % nx, y = (i / nx) % ny, z = i / (nx * ny);
+		int next[6][3] = { { x - 1, y, z }, { x + 1, y, z }, { x, y - 1, z }, { x, y + 1, z }, { x, y, z - 1 }, { x, y, z + 1 } };
+		for (int k = 0; k < 6; k++) {
+			int cx = next[k][0], cy = next[k][1], cz = next[k][2];
+			if (cx < 0 || cy < 0 || cz < 0 || cx >= nx || cy >= ny || cz >= nz) continue;
+			int c = index(cx, cy, cz);
+			if (solid[c] || outside[c]) continue;
+			outside[c] = 1;
+			stack.push_back(c);
+		}
+	}
+	for (size_t i = 0; i < solid.size(); i++) solid[i] = !outside[i];
+}
+
+// Shortest paths through the solid voxels (26 neighbours) from the voxels
+// the joint's bones pass through, seeded with their distance to the bones.
+// A joint whose bones miss the mesh starts from the solid voxel nearest to
+// them.
+//
+static void geodesicField(const VoxelGrid &grid, const std::vector<BoneSegment> &bones, int joint, std::vector<float> &distance) {
+	distance.assign((size_t)grid.count(), infinity);
+	typedef std::pair<float, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+
+	auto seed = [&](int c, float d) {
+		if (d < distance[c]) {
+			distance[c] = d;
+			queue.push(Entry(d, c));
+		}
+	};
+	auto boneDistance = [&](const glm::vec3 &p) {
+		float d = infinity;
+		for (int i = 0; i < bones.size(); i++) {
+			if (bones[i].joint == joint) d = std::min(d, segmentDistance(p, bones[i]));
+		}
+		return d;
+	};
+
+	for (int i = 0; i < bones.size(); i++) {
+		if (bones[i].joint != joint) continue;
+		int n = std::max(1, (int)std::ceil(2.0f * glm::length(bones[i].b - bones[i].a) / grid.size));
+		for (int k = 0; k <= n; k++) {
+			int c = grid.cellIndex(bones[i].a + (bones[i].b - bones[i].a) * ((float)k / n));
+			if (grid.solid[c]) seed(c, segmentDistance(grid.center(c), bones[i]));
+		}
+	}
+	if (queue.empty()) {
+		int nearest = -1;
+		float best = infinity;
+		for (int c = 0; c < grid.count(); c++) {
+			if (!grid.solid[c]) continue;
+			float d = boneDistance(grid.center(c));
+			if (d < best) {
+				best = d;
+				nearest = c;
+			}
+		}
+		if (nearest < 0) return;
+		seed(nearest, best);
+	}
+
+	static const float diagonal2 = std::sqrt(2.0f), diagonal3 = std::sqrt(3.0f);
+	while (!queue.empty()) {
+		Entry top = queue.top();
+		queue.pop();
+		int c = top.second;
+		if (top.first > distance[c]) continue;
+		int x = c % grid.nx, y = (c / grid.nx) % grid.ny, z = c / (grid.nx * grid.ny);
+		for (int dz = -1; dz <= 1; dz++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					int steps = (dx != 0) + (dy != 0) + (dz != 0);
+					if (steps == 0) continue;
+					int cx = x + dx, cy = y + dy, cz = z + dz;
+					if (cx < 0 || cy < 0 || cz < 0 || cx >= grid.nx || cy >= grid.ny || cz >= grid.nz) continue;
+					int n = grid.index(cx, cy, cz);
+					if (!grid.solid[n]) continue;
+					float d = top.first + grid.size * (steps == 1 ? 1.0f : (steps == 2 ? diagonal2 : diagonal3));
+					if (d < distance[n]) {
+						distance[n] = d;
+						queue.push(Entry(d, n));
+					}
+				}
+			}
+		}
+	}
+}
+
+void computeSkinWeights(const MeshData &mesh, const std::vector<BoneSegment> &bones,
+	const SkinBindSettings &settings, SkinWeights &weights) {
+	int nVertices = mesh.vertexCount();
+	int nJoints = jointCount(bones);
+	weights.resize(nVertices, settings.influences);
+	if (nJoints == 0) return;
+
+	glm::vec3 lo, hi;
+	float extent = mesh.getBounds(lo, hi) ? glm::length(hi - lo) : 1.0f;
+	float epsilon = 1e-4f * std::max(extent, 1e-6f);
+
+	// distance from each vertex to each joint's bones through the mesh, the
+	// straight line distance being a lower bound within a voxel
+	//
+	std::vector<float> geodesic;
+	if (settings.bGeodesic) {
+		VoxelGrid grid;
+		grid.build(mesh, settings.resolution);
+		std::vector<int> vertexCell(nVertices);
+		parallelFor(0, nVertices, 4096, [&](int b, int e) {
+			for (int v = b; v < e; v++) vertexCell[v] = grid.cellIndex(mesh.positions[v]);
+		});
+
+		geodesic.assign((size_t)nVertices * nJoints, infinity);
+		parallelFor(0, nJoints, 1, [&](int b, int e) {
+			static thread_local std::vector<float> field;
+			for (int j = b; j < e; j++) {
+				geodesicField(grid, bones, j, field);
+				for (int v = 0; v < nVertices; v++) geodesic[(size_t)v * nJoints + j] = field[vertexCell[v]];
+			}
+		});
+	}
+
+	parallelFor(0, nVertices, 1024, [&](int b, int e) {
+		std::vector<float> distance(nJoints);
+		std::vector<float> w(nJoints);
+		std::vector<int> joints(nJoints);
+		for (int j = 0; j < nJoints; j++) joints[j] = j;
+
+		for (int v = b; v < e; v++) {
+			std::fill(distance.begin(), distance.end(), infinity);
+			euclideanDistances(mesh.positions[v], bones, distance.data());
+
+			// joints the mesh doesn't connect to this vertex get no weight,
+			// unless none is connected at all
+			bool bConnected = false;
+			if (settings.bGeodesic) {
+				const float *g = &geodesic[(size_t)v * nJoints];
+				for (int j = 0; j < nJoints; j++) {
+					bConnected = bConnected || g[j] < infinity;
+				}
+				if (bConnected) {
+					for (int j = 0; j < nJoints; j++) distance[j] = std::max(distance[j], g[j]);
+				}
+			}
+			for (int j = 0; j < nJoints; j++) {
+				w[j] = distance[j] < infinity ? 1.0f / std::pow(std::max(distance[j], epsilon), settings.falloff) : 0.0f;
+			}
+			weights.setVertex(v, joints.data(), w.data(), nJoints);
+		}
+	});
+}
+
+struct SkinWeightCacheHeader {
+	char magic[8];           // "SKINWGTS"
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint64_t key;
+
+	uint32_t vertexCount;
+	uint32_t influences;
+};
+
+static const char weightsMagic[8] = { 'S', 'K', 'I', 'N', 'W', 'G', 'T', 'S' };
+
+std::string SkinWeightCache::cachePath(const std::string &sourcePath) {
+	return sourcePath + ".skinweights";
+}
+
+// FNV-1a, 64 bit, over the bones and the settings field by field
+//
+uint64_t SkinWeightCache::key(const std::vector<BoneSegment> &bones, const SkinBindSettings &settings) {
+	uint64_t h = 14695981039346656037ULL;
+	auto mix = [&h](const void *data, size_t bytes) {
+		const unsigned char *p = (const unsigned char *)data;
+		for (size_t i = 0; i < bytes; i++) {
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+	};
+	for (int i = 0; i < bones.size(); i++) {
+		float f[6] = { bones[i].a.x, bones[i].a.y, bones[i].a.z, bones[i].b.x, bones[i].b.y, bones[i].b.z };
+		mix(f, sizeof(f));
+		mix(&bones[i].joint, sizeof(int));
+	}
+	int mode = settings.bGeodesic ? 1 : 0;
+	mix(&mode, sizeof(int));
+	mix(&settings.influences, sizeof(int));
+	mix(&settings.falloff, sizeof(float));
+	if (settings.bGeodesic) mix(&settings.resolution, sizeof(int));
+	return h;
+}
+
+bool SkinWeightCache::write(const std::string &sourcePath, uint64_t key, const SkinWeights &weights) {
+	SkinWeightCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, weightsMagic, sizeof(h.magic));
+	h.version = version;
+	h.headerSize = sizeof(SkinWeightCacheHeader);
+	if (!MeshCache::stamp(sourcePath, h.sourceSize, h.sourceTime) || !MeshCache::hash(sourcePath, h.sourceHash)) return false;
+	h.key = key;
+	h.vertexCount = (uint32_t)weights.vertexCount();
+	h.influences = (uint32_t)weights.influences;
+
+	std::string path = cachePath(sourcePath);
+	std::string tmpPath = path + ".tmp";
+	FILE *f = fopen(tmpPath.c_str(), "wb");
+	if (!f) return false;
+	bool bOk = fwrite(&h, sizeof(h), 1, f) == 1 &&
+		(weights.joints.empty() || fwrite(weights.joints.data(), sizeof(uint16_t), weights.joints.size(), f) == weights.joints.size()) &&
+		(weights.weights.empty() || fwrite(weights.weights.data(), sizeof(float), weights.weights.size(), f) == weights.weights.size());
+	bOk = (fclose(f) == 0) && bOk;
+	if (bOk) {
+		remove(path.c_str());
+		bOk = rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+	if (!bOk) remove(tmpPath.c_str());
+	return bOk;
+}
+
+bool SkinWeightCache::read(const std::string &sourcePath, uint64_t key, int vertexCount, int jointCount, SkinWeights &weights) {
+	uint64_t size;
+	int64_t time;
+	if (!MeshCache::stamp(sourcePath, size, time)) return false;
+	FILE *f = fopen(cachePath(sourcePath).c_str(), "rb");
+	if (!f) return false;
+
+	SkinWeightCacheHeader h;
+	bool bValid = fread(&h, sizeof(h), 1, f) == 1 &&
+		memcmp(h.magic, weightsMagic, sizeof(weightsMagic)) == 0 &&
+		h.version == version && h.headerSize == sizeof(SkinWeightCacheHeader) &&
+		h.key == key && h.vertexCount == (uint32_t)vertexCount &&
+		h.influences >= 1 && h.influences <= SkinWeights::maxInfluences &&
+		h.sourceSize == size;
+	if (bValid && h.sourceTime != time) {
+		uint64_t sourceHash;
+		bValid = MeshCache::hash(sourcePath, sourceHash) && sourceHash == h.sourceHash;
+	}
+	if (bValid) {
+		SkinWeights loaded;
+		loaded.resize(vertexCount, h.influences);
+		bValid = (loaded.joints.empty() || fread(loaded.joints.data(), sizeof(uint16_t), loaded.joints.size(), f) == loaded.joints.size()) &&
+			(loaded.weights.empty() || fread(loaded.weights.data(), sizeof(float), loaded.weights.size(), f) == loaded.weights.size());
+		for (size_t i = 0; bValid && i < loaded.joints.size(); i++) {
+			bValid = loaded.joints[i] < jointCount && std::isfinite(loaded.weights[i]) && loaded.weights[i] >= 0;
+		}
+		if (bValid) weights = loaded;
+	}
+	fclose(f);
+	return bValid;
+}
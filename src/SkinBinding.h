@@ -0,0 +1,79 @@
+//
+//  SkinBinding.h - Automatic skin weights against a skeleton
+//
+//  The bones are the segments between a joint and each of its children,
+//  owned by the parent (it is the joint that turns them); a joint without
+//  children owns the point it sits at.  A vertex is weighted towards the
+//  joints whose bones are nearest, 1 / distance^falloff, keeping the
+//  heaviest few (see SkinWeights).
+//
+//  The cheap mode measures straight line distance to the bones.  The
+//  geodesic mode voxelizes the mesh (its surface and the space it
+//  encloses) and measures distance through solid voxels only, from the
+//  voxels each bone passes through, so an arm hanging next to the body
+//  doesn't pick up weight from the hip (geodesic voxel binding).
+//  Voxelization runs over slabs of the grid, the distance fields over
+//  joints and the weights over vertices, all on the work stealing pool.
+//  It keeps one distance per vertex and joint while it runs.
+//
+//  Weights are cached next to the mesh source, "model.obj.skinweights".
+//  The cache is tied to the source file the same way a MeshCache is, and
+//  to a key hashed from the bones and the settings, so moving the skeleton
+//  or the mesh before binding computes them again.  Only depends on glm.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "glm/glm.hpp"
+#include "MeshData.h"
+#include "Skinning.h"
+
+struct BoneSegment {
+	glm::vec3 a, b;          // a == b for a leaf joint
+	int joint;
+};
+
+// bones of a skeleton given parent first (parents[i] < i, -1 for roots)
+// with the joint positions in the space of the mesh
+//
+std::vector<BoneSegment> boneSegments(const std::vector<int> &parents, const std::vector<glm::vec3> &positions);
+
+struct SkinBindSettings {
+	bool bGeodesic = false;
+	int influences = 4;
+	float falloff = 2.0f;
+
+	// voxels along the longest side of the mesh bounds (geodesic mode)
+	//
+	int resolution = 64;
+};
+
+// weights of the mesh's vertices, joint indices as in the bones
+//
+void computeSkinWeights(const MeshData &mesh, const std::vector<BoneSegment> &bones,
+	const SkinBindSettings &settings, SkinWeights &weights);
+
+class SkinWeightCache {
+public:
+	static const uint32_t version = 1;
+
+	// "model.obj" -> "model.obj.skinweights"
+	//
+	static std::string cachePath(const std::string &sourcePath);
+
+	// hash of everything besides the mesh the weights depend on
+	//
+	static uint64_t key(const std::vector<BoneSegment> &bones, const SkinBindSettings &settings);
+
+	// written under a temporary name and renamed, like MeshCache::write()
+	//
+	static bool write(const std::string &sourcePath, uint64_t key, const SkinWeights &weights);
+
+	// false if the cache is missing, damaged, stale or for another key.
+	// Weights on joints past jointCount, or that aren't finite, count as
+	// damaged, since skinning indexes the joint palette with them
+	//
+	static bool read(const std::string &sourcePath, uint64_t key, int vertexCount, int jointCount, SkinWeights &weights);
+};
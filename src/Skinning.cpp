@@ -0,0 +1,480 @@
+//
+//  Skinning.cpp - Linear blend skinning on the CPU
+//
+
+#include "Skinning.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__AVX__)
+#define SKIN_SIMD 2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKIN_SIMD 1
+#else
+#define SKIN_SIMD 0
+#endif
+
+#if SKIN_SIMD > 0
+#include <immintrin.h>
+#endif
+
+// vertices per task
+//
+static const int skinGrain = 4096;
+
+void SkinWeights::resize(int nVertices, int nInfluences) {
+	influences = std::min(std::max(nInfluences, 1), (int)maxInfluences);
+	joints.assign((size_t)nVertices * influences, 0);
+	weights.assign((size_t)nVertices * influences, 0.0f);
+}
+
+void SkinWeights::setVertex(int v, const int *jointList, const float *weightList, int count) {
+	int topJ[maxInfluences];
+	float topW[maxInfluences];
+	int used = 0;
+	for (int i = 0; i < count; i++) {
+		float w = weightList[i];
+		if (!(w > 0)) continue;
+
+		// insert into the list sorted heaviest first, dropping the lightest
+		// once it is full
+		int k;
+		if (used < influences) k = used++;
+		else if (w > topW[influences - 1]) k = influences - 1;
+		else continue;
+		while (k > 0 && topW[k - 1] < w) {
+			topW[k] = topW[k - 1];
+			topJ[k] = topJ[k - 1];
+			k--;
+		}
+		topW[k] = w;
+		topJ[k] = jointList[i];
+	}
+
+	float sum = 0;
+	for (int k = 0; k < used; k++) sum += topW[k];
+	uint16_t *j = &joints[(size_t)v * influences];
+	float *w = &weights[(size_t)v * influences];
+	for (int k = 0; k < influences; k++) {
+		j[k] = k < used ? (uint16_t)topJ[k] : 0;
+		w[k] = k < used ? topW[k] / sum : 0.0f;
+	}
+}
+
+int SkinWeights::jointCount() const {
+	int n = 0;
+	for (size_t i = 0; i < weights.size(); i++) {
+		if (weights[i] > 0) n = std::max(n, joints[i] + 1);
+	}
+	return n;
+}
+
+// Weighted sum of palette matrices, only the top three rows matter (the
+// palette is affine).  set() starts the sum, add() accumulates into it.
+//
+#if SKIN_SIMD == 2
+
+// columns 0 and 1 in one register, 2 and 3 in the other
+//
+struct BlendedMatrix {
+	__m256 c01, c23;
+
+	static __m256 halves(float a, float b) {
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1);
+	}
+	static void store(__m256 v, glm::vec3 &out) {
+		float f[4];
+		_mm_storeu_ps(f, _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+		out = glm::vec3(f[0], f[1], f[2]);
+	}
+	void set(const glm::mat4 &m, float w) {
+		__m256 s = _mm256_set1_ps(w);
+		c01 = _mm256_mul_ps(s, _mm256_loadu_ps(&m[0][0]));
+		c23 = _mm256_mul_ps(s, _mm256_loadu_ps(&m[2][0]));
+	}
+	void add(const glm::mat4 &m, float w) {
+		__m256 s = _mm256_set1_ps(w);
+		c01 = _mm256_add_ps(c01, _mm256_mul_ps(s, _mm256_loadu_ps(&m[0][0])));
+		c23 = _mm256_add_ps(c23, _mm256_mul_ps(s, _mm256_loadu_ps(&m[2][0])));
+	}
+	void transformPoint(const glm::vec3 &p, glm::vec3 &out) const {
+		store(_mm256_add_ps(_mm256_mul_ps(c01, halves(p.x, p.y)), _mm256_mul_ps(c23, halves(p.z, 1.0f))), out);
+	}
+	void transformVector(const glm::vec3 &n, glm::vec3 &out) const {
+		store(_mm256_add_ps(_mm256_mul_ps(c01, halves(n.x, n.y)), _mm256_mul_ps(c23, halves(n.z, 0.0f))), out);
+	}
+};
+
+#elif SKIN_SIMD == 1
+
+struct BlendedMatrix {
+	__m128 c0, c1, c2, c3;
+
+	static void store(__m128 v, glm::vec3 &out) {
+		float f[4];
+		_mm_storeu_ps(f, v);
+		out = glm::vec3(f[0], f[1], f[2]);
+	}
+	void set(const glm::mat4 &m, float w) {
+		__m128 s = _mm_set1_ps(w);
+		c0 = _mm_mul_ps(s, _mm_loadu_ps(&m[0][0]));
+		c1 = _mm_mul_ps(s, _mm_loadu_ps(&m[1][0]));
+		c2 = _mm_mul_ps(s, _mm_loadu_ps(&m[2][0]));
+		c3 = _mm_mul_ps(s, _mm_loadu_ps(&m[3][0]));
+	}
+	void add(const glm::mat4 &m, float w) {
+		__m128 s = _mm_set1_ps(w);
+		c0 = _mm_add_ps(c0, _mm_mul_ps(s, _mm_loadu_ps(&m[0][0])));
+		c1 = _mm_add_ps(c1, _mm_mul_ps(s, _mm_loadu_ps(&m[1][0])));
+		c2 = _mm_add_ps(c2, _mm_mul_ps(s, _mm_loadu_ps(&m[2][0])));
+		c3 = _mm_add_ps(c3, _mm_mul_ps(s, _mm_loadu_ps(&m[3][0])));
+	}
+	void transformPoint(const glm::vec3 &p, glm::vec3 &out) const {
+		__m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y)));
+		r = _mm_add_ps(r, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3));
+		store(r, out);
+	}
+	void transformVector(const glm::vec3 &n, glm::vec3 &out) const {
+		__m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y)));
+		store(_mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(n.z))), out);
+	}
+};
+
+#else
+
+struct BlendedMatrix {
+	glm::mat4 m;
+
+	void set(const glm::mat4 &p, float w) { m = p * w; }
+	void add(const glm::mat4 &p, float w) { m += p * w; }
+	void transformPoint(const glm::vec3 &p, glm::vec3 &out) const { out = glm::vec3(m * glm::vec4(p, 1.0f)); }
+	void transformVector(const glm::vec3 &n, glm::vec3 &out) const { out = glm::mat3(m) * n; }
+};
+
+#endif
+
+static inline void normalizeInPlace(glm::vec3 &n) {
+	float len2 = n.x * n.x + n.y * n.y + n.z * n.z;
+	if (len2 > 0) n *= 1.0f / std::sqrt(len2);
+}
+
+// vertices without influences are copied through unchanged
+//
+template <bool bNormals>
+static void skinLinearRange(int begin, int end, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &sw, const glm::mat4 *palette, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+	int nInfluences = sw.influences;
+	BlendedMatrix m;
+	for (int v = begin; v < end; v++) {
+		const uint16_t *j = &sw.joints[(size_t)v * nInfluences];
+		const float *w = &sw.weights[(size_t)v * nInfluences];
+		if (!(w[0] > 0)) {
+			outPositions[v] = positions[v];
+			if (bNormals) outNormals[v] = normals[v];
+			continue;
+		}
+
+		m.set(palette[j[0]], w[0]);
+		for (int k = 1; k < nInfluences && w[k] > 0; k++) m.add(palette[j[k]], w[k]);
+		m.transformPoint(positions[v], outPositions[v]);
+		if (bNormals) {
+			m.transformVector(normals[v], outNormals[v]);
+			normalizeInPlace(outNormals[v]);
+		}
+	}
+}
+
+// Dual quaternion skinning runs in blocks of vertices, in two passes.  The
+// first blends each vertex's dual quaternions (eight floats, one or two
+// registers) into a structure of arrays; the second normalizes them and
+// transforms positions and normals across the vector lanes, so the square
+// roots and divides of neighbouring vertices overlap instead of each
+// vertex waiting on its own.
+//
+static_assert(sizeof(DualQuat) == 8 * sizeof(float), "DualQuat must be eight packed floats");
+
+struct DualQuatBlock {
+	enum { size = 64 };
+	float q[8][size];          // blended real (x y z w) and dual parts
+	float in[6][size];         // position and normal
+	float out[6][size];
+};
+
+// every influence goes on the hemisphere of the first (the same rotation
+// either way, but only one sign blends correctly): w with the sign of the
+// dot product of the real parts
+//
+#if SKIN_SIMD >= 1
+static inline __m128 hemisphere(__m128 first, __m128 q, float w) {
+	__m128 d = _mm_mul_ps(first, q);
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_xor_ps(_mm_set1_ps(w), _mm_and_ps(d, _mm_set1_ps(-0.0f)));
+}
+#else
+static inline float hemisphere(const float *first, const float *q, float w) {
+	float d = first[0] * q[0] + first[1] * q[1] + first[2] * q[2] + first[3] * q[3];
+	return std::copysign(w, d);
+}
+#endif
+
+static void blendDualQuats(const float *const *quats, const float *w, int count, float *sum) {
+#if SKIN_SIMD == 2
+	__m128 first = _mm_loadu_ps(quats[0]);
+	__m256 s = _mm256_mul_ps(_mm256_set1_ps(w[0]), _mm256_loadu_ps(quats[0]));
+	for (int k = 1; k < count; k++) {
+		__m128 wk = hemisphere(first, _mm_loadu_ps(quats[k]), w[k]);
+		__m256 wk2 = _mm256_insertf128_ps(_mm256_castps128_ps256(wk), wk, 1);
+		s = _mm256_add_ps(s, _mm256_mul_ps(wk2, _mm256_loadu_ps(quats[k])));
+	}
+	_mm256_storeu_ps(sum, s);
+#elif SKIN_SIMD == 1
+	__m128 first = _mm_loadu_ps(quats[0]);
+	__m128 w0 = _mm_set1_ps(w[0]);
+	__m128 real = _mm_mul_ps(w0, first);
+	__m128 dual = _mm_mul_ps(w0, _mm_loadu_ps(quats[0] + 4));
+	for (int k = 1; k < count; k++) {
+		__m128 qk = _mm_loadu_ps(quats[k]);
+		__m128 wk = hemisphere(first, qk, w[k]);
+		real = _mm_add_ps(real, _mm_mul_ps(wk, qk));
+		dual = _mm_add_ps(dual, _mm_mul_ps(wk, _mm_loadu_ps(quats[k] + 4)));
+	}
+	_mm_storeu_ps(sum, real);
+	_mm_storeu_ps(sum + 4, dual);
+#else
+	const float *first = quats[0];
+	for (int i = 0; i < 8; i++) sum[i] = w[0] * first[i];
+	for (int k = 1; k < count; k++) {
+		float s = hemisphere(first, quats[k], w[k]);
+		for (int i = 0; i < 8; i++) sum[i] += s * quats[k][i];
+	}
+#endif
+}
+
+// lanes for the second pass
+//
+struct ScalarSkinLanes {
+	enum { width = 1 };
+	typedef float V;
+	static V load(const float *p) { return *p; }
+	static void store(float *p, V v) { *p = v; }
+	static V set1(float f) { return f; }
+	static V add(V a, V b) { return a + b; }
+	static V sub(V a, V b) { return a - b; }
+	static V mul(V a, V b) { return a * b; }
+	static V div(V a, V b) { return a / b; }
+	static V sqrt(V a) { return std::sqrt(a); }
+};
+
+#if SKIN_SIMD >= 1
+struct SSESkinLanes {
+	enum { width = 4 };
+	typedef __m128 V;
+	static V load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+	static V set1(float f) { return _mm_set1_ps(f); }
+	static V add(V a, V b) { return _mm_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm_div_ps(a, b); }
+	static V sqrt(V a) { return _mm_sqrt_ps(a); }
+};
+#endif
+
+#if SKIN_SIMD == 2
+struct AVXSkinLanes {
+	enum { width = 8 };
+	typedef __m256 V;
+	static V load(const float *p) { return _mm256_loadu_ps(p); }
+	static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+	static V set1(float f) { return _mm256_set1_ps(f); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+};
+typedef AVXSkinLanes WideSkinLanes;
+#elif SKIN_SIMD == 1
+typedef SSESkinLanes WideSkinLanes;
+#else
+typedef ScalarSkinLanes WideSkinLanes;
+#endif
+
+// v + 2 * cross(r, cross(r, v) + w * v)
+//
+template <class L>
+static inline void rotateLanes(typename L::V x, typename L::V y, typename L::V z, typename L::V w,
+	typename L::V vx, typename L::V vy, typename L::V vz,
+	typename L::V &ox, typename L::V &oy, typename L::V &oz) {
+	typename L::V cx = L::add(L::sub(L::mul(y, vz), L::mul(z, vy)), L::mul(w, vx));
+	typename L::V cy = L::add(L::sub(L::mul(z, vx), L::mul(x, vz)), L::mul(w, vy));
+	typename L::V cz = L::add(L::sub(L::mul(x, vy), L::mul(y, vx)), L::mul(w, vz));
+	typename L::V two = L::set1(2.0f);
+	ox = L::add(vx, L::mul(two, L::sub(L::mul(y, cz), L::mul(z, cy))));
+	oy = L::add(vy, L::mul(two, L::sub(L::mul(z, cx), L::mul(x, cz))));
+	oz = L::add(vz, L::mul(two, L::sub(L::mul(x, cy), L::mul(y, cx))));
+}
+
+// entries [begin, end) of the block, as far as whole steps of L::width go.
+// Returns where it stopped.  Normals stay unit length, a rotation by a unit
+// quaternion doesn't change it
+//
+template <class L, bool bNormals>
+static int transformDualQuats(DualQuatBlock &b, int begin, int end) {
+	typedef typename L::V V;
+	int i = begin;
+	for (; i + L::width <= end; i += L::width) {
+		V x = L::load(&b.q[0][i]), y = L::load(&b.q[1][i]), z = L::load(&b.q[2][i]), w = L::load(&b.q[3][i]);
+		V dx = L::load(&b.q[4][i]), dy = L::load(&b.q[5][i]), dz = L::load(&b.q[6][i]), dw = L::load(&b.q[7][i]);
+		V len2 = L::add(L::add(L::mul(x, x), L::mul(y, y)), L::add(L::mul(z, z), L::mul(w, w)));
+		V s = L::div(L::set1(1.0f), L::sqrt(len2));
+		x = L::mul(x, s); y = L::mul(y, s); z = L::mul(z, s); w = L::mul(w, s);
+		dx = L::mul(dx, s); dy = L::mul(dy, s); dz = L::mul(dz, s); dw = L::mul(dw, s);
+
+		// translation 2 * dual * conj(real)
+		V two = L::set1(2.0f);
+		V tx = L::mul(two, L::add(L::sub(L::mul(w, dx), L::mul(dw, x)), L::sub(L::mul(y, dz), L::mul(z, dy))));
+		V ty = L::mul(two, L::add(L::sub(L::mul(w, dy), L::mul(dw, y)), L::sub(L::mul(z, dx), L::mul(x, dz))));
+		V tz = L::mul(two, L::add(L::sub(L::mul(w, dz), L::mul(dw, z)), L::sub(L::mul(x, dy), L::mul(y, dx))));
+
+		V ox, oy, oz;
+		rotateLanes<L>(x, y, z, w, L::load(&b.in[0][i]), L::load(&b.in[1][i]), L::load(&b.in[2][i]), ox, oy, oz);
+		L::store(&b.out[0][i], L::add(ox, tx));
+		L::store(&b.out[1][i], L::add(oy, ty));
+		L::store(&b.out[2][i], L::add(oz, tz));
+		if (bNormals) {
+			rotateLanes<L>(x, y, z, w, L::load(&b.in[3][i]), L::load(&b.in[4][i]), L::load(&b.in[5][i]), ox, oy, oz);
+			L::store(&b.out[3][i], ox);
+			L::store(&b.out[4][i], oy);
+			L::store(&b.out[5][i], oz);
+		}
+	}
+	return i;
+}
+
+// vertices without influences get the identity and so come out unchanged
+//
+template <bool bNormals>
+static void skinDualQuatRange(int begin, int end, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &sw, const DualQuat *palette, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+	static const float identity[8] = { 0, 0, 0, 1, 0, 0, 0, 0 };
+	int nInfluences = sw.influences;
+	DualQuatBlock block;
+	for (int v0 = begin; v0 < end; v0 += DualQuatBlock::size) {
+		int n = std::min((int)DualQuatBlock::size, end - v0);
+		for (int i = 0; i < n; i++) {
+			int v = v0 + i;
+			const uint16_t *j = &sw.joints[(size_t)v * nInfluences];
+			const float *w = &sw.weights[(size_t)v * nInfluences];
+			const float *quats[SkinWeights::maxInfluences];
+			int count = 0;
+			while (count < nInfluences && w[count] > 0) {
+				quats[count] = &palette[j[count]].real.x;
+				count++;
+			}
+
+			float sum[8];
+			if (count > 0) blendDualQuats(quats, w, count, sum);
+			const float *q = count > 0 ? sum : identity;
+			for (int c = 0; c < 8; c++) block.q[c][i] = q[c];
+			block.in[0][i] = positions[v].x;
+			block.in[1][i] = positions[v].y;
+			block.in[2][i] = positions[v].z;
+			if (bNormals) {
+				block.in[3][i] = normals[v].x;
+				block.in[4][i] = normals[v].y;
+				block.in[5][i] = normals[v].z;
+			}
+		}
+
+		int done = transformDualQuats<WideSkinLanes, bNormals>(block, 0, n);
+		transformDualQuats<ScalarSkinLanes, bNormals>(block, done, n);
+
+		for (int i = 0; i < n; i++) {
+			outPositions[v0 + i] = glm::vec3(block.out[0][i], block.out[1][i], block.out[2][i]);
+			if (bNormals) outNormals[v0 + i] = glm::vec3(block.out[3][i], block.out[4][i], block.out[5][i]);
+		}
+	}
+}
+
+template <class Palette, class Range>
+static void skinVertices(int nVertices, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &weights, const Palette *palette, SkinnedVertices &out, Range withNormals, Range withoutNormals) {
+	nVertices = std::min(nVertices, weights.vertexCount());
+	out.positions.resize(nVertices);
+	if (normals) out.normals.resize(nVertices);
+	else out.normals.clear();
+	glm::vec3 *outPositions = out.positions.data();
+	glm::vec3 *outNormals = out.normals.data();
+
+	parallelFor(0, nVertices, skinGrain, [&](int b, int e) {
+		if (normals) withNormals(b, e, positions, normals, weights, palette, outPositions, outNormals);
+		else withoutNormals(b, e, positions, normals, weights, palette, outPositions, outNormals);
+	});
+}
+
+void skinLinear(int nVertices, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &weights, const glm::mat4 *palette, SkinnedVertices &out) {
+	skinVertices(nVertices, positions, normals, weights, palette, out, skinLinearRange<true>, skinLinearRange<false>);
+}
+
+void skinDualQuat(int nVertices, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &weights, const DualQuat *palette, SkinnedVertices &out) {
+	skinVertices(nVertices, positions, normals, weights, palette, out, skinDualQuatRange<true>, skinDualQuatRange<false>);
+}
+
+DualQuat DualQuat::fromMatrix(const glm::mat4 &m) {
+	glm::mat3 r(glm::normalize(glm::vec3(m[0])), glm::normalize(glm::vec3(m[1])), glm::normalize(glm::vec3(m[2])));
+	DualQuat dq;
+	dq.real = glm::normalize(glm::quat_cast(r));
+	glm::vec3 t(m[3]);
+	dq.dual = glm::quat(0, t.x, t.y, t.z) * dq.real * 0.5f;
+	return dq;
+}
+
+void Skin::bind(const glm::mat4 &meshMatrix, const glm::mat4 *jointWorld, int n) {
+	inverseBind.resize(n);
+	for (int j = 0; j < n; j++) inverseBind[j] = glm::inverse(jointWorld[j]) * meshMatrix;
+	meshInverse = glm::inverse(meshMatrix);
+}
+
+void Skin::computePalette(const glm::mat4 *jointWorld, std::vector<glm::mat4> &out) const {
+	int n = jointCount();
+	out.resize(n);
+	for (int j = 0; j < n; j++) out[j] = meshInverse * jointWorld[j] * inverseBind[j];
+}
+
+void Skin::deform(const MeshData &bindMesh, const glm::mat4 *jointWorld, SkinnedVertices &out) {
+	computePalette(jointWorld, palette);
+	const glm::vec3 *normals = bindMesh.normals.empty() ? NULL : bindMesh.normals.data();
+	if (bDualQuaternion) {
+		dualPalette.resize(palette.size());
+		for (int j = 0; j < palette.size(); j++) dualPalette[j] = DualQuat::fromMatrix(palette[j]);
+		skinDualQuat(bindMesh.vertexCount(), bindMesh.positions.data(), normals, weights, dualPalette.data(), out);
+	}
+	else skinLinear(bindMesh.vertexCount(), bindMesh.positions.data(), normals, weights, palette.data(), out);
+}
+
+SkinBenchmark benchmarkSkin(Skin &skin, const MeshData &bindMesh, const glm::mat4 *jointWorld, int reps) {
+	SkinBenchmark result;
+	result.vertices = std::min(bindMesh.vertexCount(), skin.weights.vertexCount());
+	result.influences = skin.weights.influences;
+	result.reps = reps = std::max(reps, 1);
+
+	bool bWasDualQuaternion = skin.bDualQuaternion;
+	SkinnedVertices out;
+	for (int mode = 0; mode < 2; mode++) {
+		skin.bDualQuaternion = mode == 1;
+		skin.deform(bindMesh, jointWorld, out);   // warm up, sizes the output
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < reps; i++) skin.deform(bindMesh, jointWorld, out);
+		double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+		if (mode == 1) result.dualQuatMicros = micros;
+		else result.linearMicros = micros;
+	}
+	skin.bDualQuaternion = bWasDualQuaternion;
+	return result;
+}
@@ -0,0 +1,144 @@
+//
+//  Skinning.h - Linear blend skinning on the CPU
+//
+//  A skinned mesh keeps its bind pose geometry and up to 8 joint influences
+//  per vertex.  Every frame the joints' world matrices are turned into a
+//  palette (world * inverse bind, see Skin) and each vertex is moved by the
+//  weighted sum of its joints' palette matrices.  Normals go through the
+//  same blended matrix and are renormalized, which is exact for rotations
+//  and uniform scale.
+//
+//  Dual quaternion skinning blends the joints' rigid transforms as unit
+//  dual quaternions instead, which keeps the volume of twisted joints (no
+//  "candy wrapper" at shoulders and wrists); it assumes the palette is
+//  rigid, scale is ignored.  Each Skin chooses one of the two.
+//
+//  The kernels blend matrix columns or dual quaternions in SSE registers
+//  (twice as wide with AVX when the translation unit is built for it); the
+//  dual quaternions are then normalized and applied 4 or 8 vertices at a
+//  time.  Both run on the work stealing pool in blocks of vertices.  Results go into a
+//  caller owned SkinnedVertices that is only reallocated when the vertex
+//  count changes.  Only depends on glm.
+//
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "MeshData.h"
+
+// Fixed size influence slots, influences (up to 8, usually 4 or 8) per
+// vertex: vertex v uses joints/weights [v * influences, (v + 1) *
+// influences).  Used slots come first and the weights of a vertex sum to 1;
+// unused slots have weight 0 (the kernel stops at the first one).
+//
+struct SkinWeights {
+	enum { maxInfluences = 8 };
+
+	int influences = 4;
+	std::vector<uint16_t> joints;
+	std::vector<float> weights;
+
+	// nVertices vertices with no influences
+	//
+	void resize(int nVertices, int nInfluences);
+
+	int vertexCount() const { return influences > 0 ? (int)weights.size() / influences : 0; }
+	bool empty() const { return weights.empty(); }
+
+	// the heaviest influences of count joint/weight pairs, heaviest first and
+	// normalized.  Pairs of weight 0 or less are dropped
+	//
+	void setVertex(int v, const int *jointList, const float *weightList, int count);
+
+	// largest joint index used plus one
+	//
+	int jointCount() const;
+};
+
+// output of the kernels, reused from frame to frame
+//
+struct SkinnedVertices {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+};
+
+// positions[v] (and normals[v] when normals isn't NULL) deformed by the
+// weighted sum of palette[joints], written to out.  palette must hold every
+// joint the weights refer to
+//
+void skinLinear(int nVertices, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &weights, const glm::mat4 *palette, SkinnedVertices &out);
+
+// Rotation followed by translation t: dual = 0.5 * (0, t) * real.  Eight
+// packed floats, real part first
+//
+struct DualQuat {
+	glm::quat real;
+	glm::quat dual;
+
+	// the rotation and translation of an affine matrix (scale is dropped)
+	//
+	static DualQuat fromMatrix(const glm::mat4 &m);
+};
+
+// same as skinLinear() with dual quaternion blending.  Each influence is
+// flipped onto the hemisphere of the vertex's first one before blending
+//
+void skinDualQuat(int nVertices, const glm::vec3 *positions, const glm::vec3 *normals,
+	const SkinWeights &weights, const DualQuat *palette, SkinnedVertices &out);
+
+// Bind pose and weights of one mesh.  Vertices stay in the mesh's own space
+// (the one its model matrix maps to the world), so the mesh can keep being
+// drawn and picked through the model matrix it had when it was bound.
+//
+class Skin {
+public:
+	SkinWeights weights;
+
+	// dual quaternion instead of linear blend skinning
+	//
+	bool bDualQuaternion = false;
+
+	// mesh space to joint space at bind time, per joint
+	//
+	std::vector<glm::mat4> inverseBind;
+
+	// world to mesh space at bind time
+	//
+	glm::mat4 meshInverse = glm::mat4(1.0);
+
+	// record the bind pose: the mesh's model matrix and the world matrices
+	// of the n joints the weights refer to
+	//
+	void bind(const glm::mat4 &meshMatrix, const glm::mat4 *jointWorld, int n);
+
+	int jointCount() const { return (int)inverseBind.size(); }
+
+	// palette for the joints' current world matrices
+	//
+	void computePalette(const glm::mat4 *jointWorld, std::vector<glm::mat4> &palette) const;
+
+	// skin the bind geometry with the joints' current world matrices
+	//
+	void deform(const MeshData &bindMesh, const glm::mat4 *jointWorld, SkinnedVertices &out);
+
+private:
+	std::vector<glm::mat4> palette;
+	std::vector<DualQuat> dualPalette;
+};
+
+// Average deform() time of a skin in each mode over reps runs on the same
+// mesh and pose, in microseconds (the palette is included).  The skin's
+// mode is restored afterwards
+//
+struct SkinBenchmark {
+	int vertices = 0;
+	int influences = 0;
+	int reps = 0;
+	double linearMicros = 0;
+	double dualQuatMicros = 0;
+};
+
+SkinBenchmark benchmarkSkin(Skin &skin, const MeshData &bindMesh, const glm::mat4 *jointWorld, int reps);
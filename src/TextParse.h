@@ -0,0 +1,141 @@
+//
+//  TextParse.h - Shared pieces of the command style text files
+//
+//  model.txt and model.anim are written as one command per line, options
+//  introduced by '-' and a ';' at the end:
+//
+//    create -joint joint1 -rotate <0, 0, 0> -translate <0, -1.44, 0> -parent joint0;
+//
+//  These read such a line in place out of a mapped buffer, and LineParser
+//  remembers the first error with where it happened so the file readers can
+//  report it as "line L, column C: message".  formatFloat() writes numbers
+//  back with the fewest digits that read back exactly.
+//
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "NumberParse.h"
+
+namespace TextParse {
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char *skipSpace(const char *p, const char *end) {
+	while (p < end && isSpace(*p)) p++;
+	return p;
+}
+
+// names run up to white space or the ';' ending the command
+//
+inline const char *skipName(const char *p, const char *end) {
+	while (p < end && !isSpace(*p) && *p != ';') p++;
+	return p;
+}
+
+// true, and p moved past it, if the text at p is the given word
+//
+inline bool matchWord(const char *&p, const char *end, const char *word) {
+	size_t n = strlen(word);
+	if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) return false;
+	if (p + n < end && !isSpace(p[n]) && p[n] != ';') return false;
+	p += n;
+	return true;
+}
+
+struct LineParser {
+	const char *lineStart;
+	const char *where = NULL;      // position of the error
+	const char *message = NULL;
+
+	bool fail(const char *p, const char *m) {
+		where = p;
+		message = m;
+		return false;
+	}
+
+	bool expect(const char *&p, const char *end, char c, const char *m) {
+		p = skipSpace(p, end);
+		if (p == end || *p != c) return fail(p, m);
+		p++;
+		return true;
+	}
+
+	// nan, inf and numbers out of float range are errors, so a damaged file
+	// can't load non-finite transforms or key values
+	//
+	bool number(const char *&p, const char *end, float &v) {
+		p = skipSpace(p, end);
+		const char *q = NumberParse::parseFloat(p, end, v);
+		if (!q) return fail(p, "expected a number");
+		if (!std::isfinite(v)) return fail(p, "expected a finite number");
+		p = q;
+		return true;
+	}
+
+	// <v[0], v[1], ...> with n components
+	//
+	bool components(const char *&p, const char *end, float *v, int n) {
+		if (!expect(p, end, '<', "expected '<'")) return false;
+		for (int k = 0; k < n; k++) {
+			if (!number(p, end, v[k])) return false;
+			if (!expect(p, end, k < n - 1 ? ',' : '>', k < n - 1 ? "expected ','" : "expected '>'")) return false;
+		}
+		return true;
+	}
+
+	// <x, y, z>
+	//
+	bool vector(const char *&p, const char *end, glm::vec3 &v) {
+		return components(p, end, &v.x, 3);
+	}
+
+	// <x, y, z, w>
+	//
+	bool quaternion(const char *&p, const char *end, glm::quat &q) {
+		float v[4];
+		if (!components(p, end, v, 4)) return false;
+		q = glm::quat(v[3], v[0], v[1], v[2]);
+		return true;
+	}
+
+	// "line L, column C: message"
+	//
+	std::string describe(int line) const {
+		return "line " + std::to_string(line) + ", column " + std::to_string((int)(where - lineStart) + 1) + ": " + message;
+	}
+};
+
+// Shortest text that reads back as exactly v, so text files round trip
+// without loss but stay as short as the old two decimal ones for values
+// like 0.04.  to_chars gives the shortest form for a correctly rounding
+// reader; it is checked against our own parser and more digits are used in
+// the rare case that one rounds differently.
+//
+inline std::string formatFloat(float v) {
+	char buf[32];
+	std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf) - 1, v);
+	*r.ptr = 0;
+	for (int precision = 9; precision <= 17; precision++) {
+		float back;
+		const char *end = buf + strlen(buf);
+		if (NumberParse::parseFloat(buf, end, back) == end && memcmp(&back, &v, sizeof(v)) == 0) break;
+		snprintf(buf, sizeof(buf), "%.*g", precision, v);
+	}
+	return buf;
+}
+
+inline std::string formatVector(const glm::vec3 &v) {
+	return "<" + formatFloat(v.x) + ", " + formatFloat(v.y) + ", " + formatFloat(v.z) + ">";
+}
+
+inline std::string formatQuat(const glm::quat &q) {
+	return "<" + formatFloat(q.x) + ", " + formatFloat(q.y) + ", " + formatFloat(q.z) + ", " + formatFloat(q.w) + ">";
+}
+
+}
@@ -0,0 +1,118 @@
+//
+//  ThreadPool.cpp - Work stealing thread pool
+//
+
+#include "ThreadPool.h"
+#include "Trace.h"
+
+// pool and index of the worker running on this thread, NULL and -1 elsewhere
+//
+static thread_local ThreadPool *currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+ThreadPool &ThreadPool::instance() {
+	static ThreadPool pool(hardwareThreads() - 1);
+	return pool;
+}
+
+ThreadPool::ThreadPool(int nWorkers) {
+	nWorkers = std::max(nWorkers, 0);
+	for (int i = 0; i <= nWorkers; i++) queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	for (int i = 0; i < nWorkers; i++) threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		bStop = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+void ThreadPool::submit(TaskGroup &group, std::function<void()> task) {
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+	Queue &q = (currentPool == this) ? *queues[currentWorker] : *queues.back();
+	{
+		std::lock_guard<std::mutex> guard(q.lock);
+		Task t;
+		t.fn = std::move(task);
+		t.group = &group;
+		q.tasks.push_back(std::move(t));
+		queued.fetch_add(1, std::memory_order_release);
+	}
+
+	// the lock orders this against a worker that is about to sleep
+	//
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+// own queue from the back, then the shared queue, then the front of the
+// other workers' queues starting after our own
+//
+bool ThreadPool::findTask(int self, Task &task) {
+	if (queued.load(std::memory_order_acquire) == 0) return false;
+
+	if (self >= 0) {
+		Queue &q = *queues[self];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	int n = (int)queues.size();
+	for (int k = 0; k < n; k++) {
+		int v = (k == 0) ? n - 1 : (std::max(self, 0) + k - 1) % (n - 1);
+		if (v == self) continue;
+		Queue &q = *queues[v];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(Task &task) {
+	{
+		TRACE_ZONE("ThreadPool task");
+		task.fn();
+	}
+	task.fn = nullptr;
+	task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::wait(TaskGroup &group) {
+	int self = (currentPool == this) ? currentWorker : -1;
+	Task task;
+	while (!group.done()) {
+		if (findTask(self, task)) run(task);
+		else std::this_thread::yield();
+	}
+}
+
+void ThreadPool::workerLoop(int self) {
+	currentPool = this;
+	currentWorker = self;
+	Trace::setThreadName("pool worker");
+	Task task;
+	while (true) {
+		if (findTask(self, task)) {
+			run(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [&] { return bStop || queued.load(std::memory_order_acquire) > 0; });
+		if (bStop) return;
+	}
+}
@@ -0,0 +1,89 @@
+//
+//  ThreadPool.h - Work stealing thread pool
+//
+//  One worker per hardware thread besides the caller.  Every worker owns a
+//  deque: tasks it spawns go on its own end and are popped from there
+//  (newest first, still warm in cache), idle workers steal from the other
+//  end of someone else's (oldest first, usually the biggest pieces).
+//  Tasks submitted from outside the pool go to a shared queue.
+//
+//  A thread waiting on a TaskGroup runs pending tasks until the group is
+//  done instead of blocking, so tasks can submit and wait on groups of
+//  their own (recursive builds) without tying up the pool.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// queried once, hardware_concurrency() can be a system call
+//
+inline int hardwareThreads() {
+	static const int n = std::max(1, (int)std::thread::hardware_concurrency());
+	return n;
+}
+
+// tasks submitted together, see ThreadPool::wait()
+//
+class TaskGroup {
+public:
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class ThreadPool;
+	std::atomic<int> pending{ 0 };
+};
+
+class ThreadPool {
+public:
+
+	// the pool shared by parallelFor() and friends
+	//
+	static ThreadPool &instance();
+
+	explicit ThreadPool(int nWorkers);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// threads taking part in a parallel loop: the workers and the caller
+	//
+	int concurrency() const { return (int)threads.size() + 1; }
+
+	void submit(TaskGroup &group, std::function<void()> task);
+
+	// returns once every task of the group has run, running tasks meanwhile
+	//
+	void wait(TaskGroup &group);
+
+private:
+	struct Task {
+		std::function<void()> fn;
+		TaskGroup *group = NULL;
+	};
+	struct Queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	bool findTask(int self, Task &task);
+	void run(Task &task);
+	void workerLoop(int self);
+
+	// queues[i] belongs to worker i, the last one is the shared queue
+	//
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> queued{ 0 };
+	bool bStop = false;
+};
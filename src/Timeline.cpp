@@ -0,0 +1,331 @@
+//
+//  Timeline.cpp - Keyed animation curves
+//
+
+#include "Timeline.h"
+#include "Parallel.h"
+#include "Pose.h"
+#include "QuatSimd.h"
+#include <algorithm>
+#include <cmath>
+
+int AnimCurve::setKey(float time, float value, AnimInterp interp) {
+	// keys are usually appended in order, so check the end first
+	//
+	int i;
+	if (times.empty() || time > times.back()) i = (int)times.size();
+	else i = (int)(std::lower_bound(times.begin(), times.end(), time) - times.begin());
+
+	if (i < times.size() && times[i] == time) {
+		values[i] = value;
+		interps[i] = interp;
+		return i;
+	}
+	times.insert(times.begin() + i, time);
+	values.insert(values.begin() + i, value);
+	interps.insert(interps.begin() + i, interp);
+	return i;
+}
+
+void AnimCurve::removeKey(int i) {
+	times.erase(times.begin() + i);
+	values.erase(values.begin() + i);
+	interps.erase(interps.begin() + i);
+}
+
+void AnimCurve::clear() {
+	times.clear();
+	values.clear();
+	interps.clear();
+}
+
+int AnimCurve::findSegment(const std::vector<float> &times, float t) {
+	int n = (int)times.size();
+	if (n < 2 || t <= times[0]) return 0;
+	if (t >= times[n - 1]) return n - 1;
+	return (int)(std::upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+}
+
+// The cursor's segment is tried first, then the one after it (forward
+// playback crossing a key); anything else is a binary search.
+//
+int AnimCurve::findSegment(const std::vector<float> &times, float t, int &cursor) {
+	int n = (int)times.size();
+	int c = cursor;
+	if (c >= 0 && c < n - 1 && times[c] <= t) {
+		if (t < times[c + 1]) return c;
+		if (c + 2 < n && t < times[c + 2]) return cursor = c + 1;
+	}
+	return cursor = findSegment(times, t);
+}
+
+float AnimCurve::blendFactor(const std::vector<float> &times, const std::vector<AnimInterp> &interps, int i, float t) {
+	if (i == times.size() - 1 || t <= times[i]) return 0;
+
+	float u = (t - times[i]) / (times[i + 1] - times[i]);
+	switch (interps[i]) {
+	case InterpStep: return 0;
+	case InterpEase: return ease(u);
+	default: return u;
+	}
+}
+
+int AnimCurve::findSegment(float t) const {
+	return findSegment(times, t);
+}
+
+int AnimCurve::findSegment(float t, int &cursor) const {
+	return findSegment(times, t, cursor);
+}
+
+float AnimCurve::interpolate(int i, float t) const {
+	float u = blendFactor(times, interps, i, t);
+	if (u == 0) return values[i];
+	return values[i] + (values[i + 1] - values[i]) * u;
+}
+
+float AnimCurve::sample(float t) const {
+	if (times.empty()) return 0;
+	return interpolate(findSegment(t), t);
+}
+
+float AnimCurve::sample(float t, int &cursor) const {
+	if (times.empty()) return 0;
+	return interpolate(findSegment(t, cursor), t);
+}
+
+int AnimQuatCurve::setKey(float time, const glm::quat &value, AnimInterp interp) {
+	int i;
+	if (times.empty() || time > times.back()) i = (int)times.size();
+	else i = (int)(std::lower_bound(times.begin(), times.end(), time) - times.begin());
+
+	if (i < times.size() && times[i] == time) {
+		values[i] = value;
+		interps[i] = interp;
+		return i;
+	}
+	times.insert(times.begin() + i, time);
+	values.insert(values.begin() + i, value);
+	interps.insert(interps.begin() + i, interp);
+	return i;
+}
+
+void AnimQuatCurve::removeKey(int i) {
+	times.erase(times.begin() + i);
+	values.erase(values.begin() + i);
+	interps.erase(interps.begin() + i);
+}
+
+void AnimQuatCurve::clear() {
+	times.clear();
+	values.clear();
+	interps.clear();
+}
+
+void AnimQuatCurve::segment(float t, int &cursor, glm::quat &a, glm::quat &b, float &u) const {
+	if (times.empty()) {
+		a = b = glm::quat(1, 0, 0, 0);
+		u = 0;
+		return;
+	}
+	int i = AnimCurve::findSegment(times, t, cursor);
+	a = values[i];
+	b = values[i + 1 < times.size() ? i + 1 : i];
+	u = AnimCurve::blendFactor(times, interps, i, t);
+}
+
+// the same kernels as the batched path, so a single sample matches the
+// value the track gets in Timeline::sample()
+//
+glm::quat AnimQuatCurve::sample(float t, int &cursor, bool bSlerp) const {
+	glm::quat a, b;
+	float u;
+	segment(t, cursor, a, b, u);
+	return bSlerp ? slerpQuat(a, b, u) : nlerpQuat(a, b, u);
+}
+
+glm::quat AnimQuatCurve::sample(float t, bool bSlerp) const {
+	int cursor = 0;
+	return sample(t, cursor, bSlerp);
+}
+
+void AnimTrack::setKey(float time, const glm::vec3 &position, const glm::vec3 &rotation, AnimInterp interp) {
+	for (int a = 0; a < 3; a++) channels[ChannelPosX + a].setKey(time, position[a], interp);
+	if (bQuatRotation) {
+		quatChannel.setKey(time, eulerToQuat(rotation), interp);
+		return;
+	}
+	for (int a = 0; a < 3; a++) channels[ChannelRotX + a].setKey(time, rotation[a], interp);
+}
+
+void AnimTrack::setKey(float time, const glm::vec3 &position, const glm::quat &orientation, AnimInterp interp) {
+	if (!bQuatRotation) {
+		setKey(time, position, quatToEuler(orientation), interp);
+		return;
+	}
+	for (int a = 0; a < 3; a++) channels[ChannelPosX + a].setKey(time, position[a], interp);
+	quatChannel.setKey(time, orientation, interp);
+}
+
+glm::vec3 AnimTrack::position(float t) const {
+	return glm::vec3(channels[ChannelPosX].sample(t), channels[ChannelPosY].sample(t), channels[ChannelPosZ].sample(t));
+}
+
+glm::vec3 AnimTrack::rotation(float t) const {
+	if (bQuatRotation) return quatToEuler(quatChannel.sample(t));
+	return glm::vec3(channels[ChannelRotX].sample(t), channels[ChannelRotY].sample(t), channels[ChannelRotZ].sample(t));
+}
+
+glm::quat AnimTrack::orientation(float t) const {
+	if (bQuatRotation) return quatChannel.sample(t);
+	return eulerToQuat(rotation(t));
+}
+
+TrackSample AnimTrack::sample(float t) const {
+	TrackCursor cursor;
+	return sample(t, cursor);
+}
+
+TrackSample AnimTrack::sample(float t, TrackCursor &cursor) const {
+	TrackSample s;
+	for (int a = 0; a < 3; a++) {
+		s.position[a] = channels[ChannelPosX + a].sample(t, cursor.keys[ChannelPosX + a]);
+	}
+	if (bQuatRotation) {
+		s.orientation = quatChannel.sample(t, cursor.quatKey);
+		return s;
+	}
+	for (int a = 0; a < 3; a++) {
+		s.rotation[a] = channels[ChannelRotX + a].sample(t, cursor.keys[ChannelRotX + a]);
+	}
+	return s;
+}
+
+bool AnimTrack::empty() const {
+	for (int c = 0; c < ChannelCount; c++) {
+		if (!channels[c].empty()) return false;
+	}
+	return quatChannel.empty();
+}
+
+float AnimTrack::startTime() const {
+	float t = quatChannel.startTime();
+	bool bFirst = quatChannel.empty();
+	for (int c = 0; c < ChannelCount; c++) {
+		if (channels[c].empty()) continue;
+		t = bFirst ? channels[c].startTime() : std::min(t, channels[c].startTime());
+		bFirst = false;
+	}
+	return t;
+}
+
+float AnimTrack::endTime() const {
+	float t = quatChannel.endTime();
+	bool bFirst = quatChannel.empty();
+	for (int c = 0; c < ChannelCount; c++) {
+		if (channels[c].empty()) continue;
+		t = bFirst ? channels[c].endTime() : std::max(t, channels[c].endTime());
+		bFirst = false;
+	}
+	return t;
+}
+
+float Timeline::startTime() const {
+	float t = 0;
+	bool bFirst = true;
+	for (int i = 0; i < tracks.size(); i++) {
+		if (tracks[i].empty()) continue;
+		t = bFirst ? tracks[i].startTime() : std::min(t, tracks[i].startTime());
+		bFirst = false;
+	}
+	return t;
+}
+
+float Timeline::endTime() const {
+	float t = 0;
+	bool bFirst = true;
+	for (int i = 0; i < tracks.size(); i++) {
+		if (tracks[i].empty()) continue;
+		t = bFirst ? tracks[i].endTime() : std::max(t, tracks[i].endTime());
+		bFirst = false;
+	}
+	return t;
+}
+
+// Euler tracks are sampled as they come; quaternion tracks only have their
+// keys gathered, then all of them are blended in one batch and scattered
+// back.  A missing cursor starts at segment 0, which finds the same segment
+// as a plain binary search.
+//
+void Timeline::sampleFrame(float t, TrackSample *out, TrackCursor *cursors, QuatBatch &batch) const {
+	batch.tracks.clear();
+	batch.from.clear();
+	batch.to.clear();
+	batch.u.clear();
+	for (int i = 0; i < tracks.size(); i++) {
+		const AnimTrack &track = tracks[i];
+		TrackCursor fresh;
+		TrackCursor &cursor = cursors ? cursors[i] : fresh;
+		if (!track.bQuatRotation) {
+			out[i] = track.sample(t, cursor);
+			continue;
+		}
+		for (int a = 0; a < 3; a++) {
+			out[i].position[a] = track.channels[ChannelPosX + a].sample(t, cursor.keys[ChannelPosX + a]);
+		}
+		glm::quat from, to;
+		float u;
+		track.quatChannel.segment(t, cursor.quatKey, from, to, u);
+		batch.tracks.push_back(i);
+		batch.from.push_back(from);
+		batch.to.push_back(to);
+		batch.u.push_back(u);
+	}
+
+	int n = (int)batch.tracks.size();
+	if (n == 0) return;
+	batch.result.resize(n);
+	if (bSlerp) slerpBatch(batch.from.data(), batch.to.data(), batch.u.data(), batch.result.data(), n);
+	else nlerpBatch(batch.from.data(), batch.to.data(), batch.u.data(), batch.result.data(), n);
+	for (int k = 0; k < n; k++) out[batch.tracks[k]].orientation = batch.result[k];
+}
+
+// the batch arrays keep their capacity between frames
+//
+void Timeline::sample(float t, TrackSample *out, TrackCursor *cursors) const {
+	static thread_local QuatBatch batch;
+	sampleFrame(t, out, cursors, batch);
+}
+
+void Timeline::sample(float t, std::vector<TrackSample> &out) const {
+	out.resize(tracks.size());
+	sample(t, out.data(), NULL);
+}
+
+void Timeline::sample(float t, std::vector<TrackSample> &out, std::vector<TrackCursor> &cursors) const {
+	out.resize(tracks.size());
+	cursors.resize(tracks.size());
+	sample(t, out.data(), cursors.data());
+}
+
+int Timeline::frameCount(float start, float end, float rate) {
+	if (!(end >= start) || !(rate > 0)) return 0;
+	return (int)std::ceil((end - start) * rate - 1e-4f) + 1;
+}
+
+void Timeline::bake(float start, float end, float rate, std::vector<TrackSample> &frames) const {
+	int nFrames = frameCount(start, end, rate);
+	int nTracks = size();
+	frames.resize((size_t)nFrames * nTracks);
+
+	// each task walks its frames forward with its own cursors
+	//
+	parallelFor(0, nFrames, std::max(1, 4096 / std::max(nTracks, 1)), [&](int b, int e) {
+		std::vector<TrackCursor> cursors(nTracks);
+		QuatBatch batch;
+		for (int f = b; f < e; f++) {
+			float t = (f == nFrames - 1) ? end : start + f / rate;
+			sampleFrame(t, &frames[(size_t)f * nTracks], cursors.data(), batch);
+		}
+	});
+}
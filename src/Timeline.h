@@ -0,0 +1,217 @@
+//
+//  Timeline.h - Keyed animation curves
+//
+//  A Timeline holds one track per animated node; a track has one curve per
+//  channel (position x/y/z, rotation x/y/z) and every curve its own sorted
+//  keys, so channels can be keyed independently and with any number of keys.
+//  A key also says how to interpolate the segment that starts at it.
+//
+//  Sampling is stateless: the value at any time is computed directly from
+//  the keys around it, so clips can be scrubbed, sampled out of order and
+//  from several threads at once.  Playback can pass a cursor that remembers
+//  the segment of the last sample.  Playing forward only ever moves to the
+//  same or the next segment, which is found in O(1); a seek anywhere else
+//  is a binary search.
+//
+//  A track can instead key its rotation as one quaternion curve (see
+//  AnimTrack::bQuatRotation).  That takes the shortest way between keys with
+//  no gimbal lock, and Timeline::sample() blends the quaternion tracks of a
+//  frame together in one batched SIMD slerp (see QuatSimd.h).  Euler angles
+//  stay the view used to key and read such a track.  Only depends on glm.
+//
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+enum AnimChannel {
+	ChannelPosX, ChannelPosY, ChannelPosZ,
+	ChannelRotX, ChannelRotY, ChannelRotZ,
+	ChannelCount
+};
+
+// interpolation of the segment that starts at a key
+//
+enum AnimInterp : unsigned char {
+	InterpLinear,
+	InterpEase,      // sinusoidal ease in/out
+	InterpStep       // hold the key's value until the next key
+};
+
+class AnimCurve {
+public:
+
+	// insert a key, keeping the keys sorted by time.  A key already at that
+	// time is replaced.  Returns the index of the key
+	//
+	int setKey(float time, float value, AnimInterp interp = InterpLinear);
+	void removeKey(int i);
+	void clear();
+
+	int keyCount() const { return (int)times.size(); }
+	bool empty() const { return times.empty(); }
+	float startTime() const { return times.empty() ? 0 : times.front(); }
+	float endTime() const { return times.empty() ? 0 : times.back(); }
+
+	// value at time t.  Before the first key and after the last one the
+	// curve holds the end values exactly; an empty curve is 0
+	//
+	float sample(float t) const;
+
+	// same, starting the search from the segment in cursor (and updating it)
+	//
+	float sample(float t, int &cursor) const;
+
+	// index of the key starting the segment that holds t (the last key
+	// for t past the end, 0 for t before the start)
+	//
+	int findSegment(float t) const;
+	int findSegment(float t, int &cursor) const;
+
+	static float ease(float u) { return 0.5f - 0.5f * glm::cos(glm::pi<float>() * u); }
+
+	// shared by all curve types: the segment search over sorted key times,
+	// and the blend factor (0 to 1, shaped by interp) of t in segment i
+	//
+	static int findSegment(const std::vector<float> &times, float t);
+	static int findSegment(const std::vector<float> &times, float t, int &cursor);
+	static float blendFactor(const std::vector<float> &times, const std::vector<AnimInterp> &interps, int i, float t);
+
+	// keys, sorted by time
+	//
+	std::vector<float> times;
+	std::vector<float> values;
+	std::vector<AnimInterp> interps;
+
+private:
+	float interpolate(int i, float t) const;
+};
+
+// rotation keys as unit quaternions, blended along the shortest arc
+//
+class AnimQuatCurve {
+public:
+	int setKey(float time, const glm::quat &value, AnimInterp interp = InterpLinear);
+	void removeKey(int i);
+	void clear();
+
+	int keyCount() const { return (int)times.size(); }
+	bool empty() const { return times.empty(); }
+	float startTime() const { return times.empty() ? 0 : times.front(); }
+	float endTime() const { return times.empty() ? 0 : times.back(); }
+
+	// value at time t (identity for an empty curve), slerp or nlerp
+	//
+	glm::quat sample(float t, bool bSlerp = true) const;
+	glm::quat sample(float t, int &cursor, bool bSlerp = true) const;
+
+	// the keys around t and the blend factor between them, so many curves
+	// can be evaluated with one batched slerp
+	//
+	void segment(float t, int &cursor, glm::quat &a, glm::quat &b, float &u) const;
+
+	// keys, sorted by time
+	//
+	std::vector<float> times;
+	std::vector<glm::quat> values;
+	std::vector<AnimInterp> interps;
+};
+
+// pose of one track at some time.  rotation is filled in for euler tracks,
+// orientation for quaternion tracks (see AnimTrack::bQuatRotation)
+//
+struct TrackSample {
+	glm::vec3 position;
+	glm::vec3 rotation;
+	glm::quat orientation;
+};
+
+// segment of the last sample of each channel of a track
+//
+struct TrackCursor {
+	int keys[ChannelCount] = { 0 };
+	int quatKey = 0;
+};
+
+class AnimTrack {
+public:
+	AnimCurve channels[ChannelCount];
+
+	// rotation keyed in quatChannel instead of the three euler channels.
+	// Set it before the first key
+	//
+	bool bQuatRotation = false;
+	AnimQuatCurve quatChannel;
+
+	// key position and rotation at once, the rotation in euler degrees or as
+	// a quaternion (converted to whatever the track keys)
+	//
+	void setKey(float time, const glm::vec3 &position, const glm::vec3 &rotation, AnimInterp interp = InterpLinear);
+	void setKey(float time, const glm::vec3 &position, const glm::quat &orientation, AnimInterp interp = InterpLinear);
+
+	glm::vec3 position(float t) const;
+	glm::vec3 rotation(float t) const;      // euler degrees
+	glm::quat orientation(float t) const;
+	TrackSample sample(float t) const;
+	TrackSample sample(float t, TrackCursor &cursor) const;
+
+	bool empty() const;
+	float startTime() const;
+	float endTime() const;
+};
+
+class Timeline {
+public:
+	int addTrack() {
+		tracks.push_back(AnimTrack());
+		return (int)tracks.size() - 1;
+	}
+	void clear() { tracks.clear(); }
+	int size() const { return (int)tracks.size(); }
+
+	// time span covered by the keys of all tracks, 0 to 0 when there are none
+	//
+	float startTime() const;
+	float endTime() const;
+
+	// every track at time t, out[i] for tracks[i].  The quaternion tracks
+	// are blended together in one batch
+	//
+	void sample(float t, std::vector<TrackSample> &out) const;
+	void sample(float t, std::vector<TrackSample> &out, std::vector<TrackCursor> &cursors) const;
+
+	// same into out[0 .. size()), cursors may be NULL.  Doesn't allocate
+	// once the batch arrays of the calling thread have grown
+	//
+	void sample(float t, TrackSample *out, TrackCursor *cursors) const;
+
+	// frames at a fixed rate from start to end inclusive (the last frame is
+	// exactly at end), frame f of track i at frames[f * size() + i].
+	// Frames are independent, so they are sampled in parallel
+	//
+	void bake(float start, float end, float rate, std::vector<TrackSample> &frames) const;
+	static int frameCount(float start, float end, float rate);
+
+	std::vector<AnimTrack> tracks;
+
+	// quaternion tracks blend with slerp, or with the cheaper nlerp (slightly
+	// uneven angular speed) when this is false
+	//
+	bool bSlerp = true;
+
+private:
+
+	// keys and blend factors of the quaternion tracks of one frame
+	//
+	struct QuatBatch {
+		std::vector<int> tracks;
+		std::vector<glm::quat> from, to, result;
+		std::vector<float> u;
+	};
+
+	// every track into out[0 .. size()), cursors may be NULL
+	//
+	void sampleFrame(float t, TrackSample *out, TrackCursor *cursors, QuatBatch &batch) const;
+};
@@ -0,0 +1,232 @@
+//
+//  Trace.cpp - Scoped timing zones with a Chrome trace dump
+//
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Trace {
+
+std::atomic<bool> bEnabled{ false };
+
+// Single writer ring.  The fields are relaxed atomics only so a reader
+// copying them at the same time isn't a data race; on x86 and ARM they are
+// plain loads and stores.
+//
+struct Event {
+	std::atomic<const char *> name{ NULL };
+	std::atomic<int64_t> start{ 0 };
+	std::atomic<int64_t> end{ 0 };
+};
+
+struct ThreadBuffer {
+	enum { capacity = 1 << 15 };
+
+	Event events[capacity];
+	std::atomic<uint64_t> written{ 0 };     // events ever recorded, the next one goes at written % capacity
+	int id = 0;
+	std::string name;                       // guarded by registryLock
+};
+
+struct Snapshot {
+	const char *name;
+	int64_t start, end;
+	int thread;
+};
+
+// Buffers are registered once per thread and never freed, so a dump can
+// still show threads that have ended.
+//
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+static thread_local ThreadBuffer *localBuffer = NULL;
+static thread_local const char *pendingName = NULL;
+
+// only the owner thread writes a ring, so clear() just hides what is there
+//
+static std::atomic<int64_t> clearedAt{ -1 };
+
+static ThreadBuffer *threadBuffer() {
+	if (!localBuffer) {
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		std::lock_guard<std::mutex> guard(registryLock);
+		buffer->id = (int)registry.size();
+		buffer->name = pendingName ? std::string(pendingName) : "thread " + std::to_string(buffer->id);
+		localBuffer = buffer.get();
+		registry.push_back(std::move(buffer));
+	}
+	return localBuffer;
+}
+
+int64_t now() {
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void setEnabled(bool b) {
+	now();
+	bEnabled.store(b, std::memory_order_relaxed);
+}
+
+void record(const char *name, int64_t start, int64_t end) {
+	ThreadBuffer *buffer = threadBuffer();
+	uint64_t n = buffer->written.load(std::memory_order_relaxed);
+
+	// pairs with the acquire fence in copyEvents(): a reader that sees any
+	// of these stores also sees written at n or later
+	//
+	std::atomic_thread_fence(std::memory_order_release);
+	Event &e = buffer->events[n % ThreadBuffer::capacity];
+	e.name.store(name, std::memory_order_relaxed);
+	e.start.store(start, std::memory_order_relaxed);
+	e.end.store(end, std::memory_order_relaxed);
+	buffer->written.store(n + 1, std::memory_order_release);
+}
+
+// a thread that never records doesn't get a buffer just to be named
+//
+void setThreadName(const char *name) {
+	if (!localBuffer) {
+		pendingName = name;
+		return;
+	}
+	std::lock_guard<std::mutex> guard(registryLock);
+	localBuffer->name = name;
+}
+
+// Events of one ring that survive the copy.  Anything the writer may have
+// reached while we were copying is dropped.  record() fills slot written
+// before it counts it, so after the second read of the write count the
+// slot of event written - capacity may be half overwritten, and only
+// events at or past written + 1 - capacity are known intact.
+//
+static void copyEvents(ThreadBuffer &buffer, int64_t since, std::vector<Snapshot> &out) {
+	uint64_t written = buffer.written.load(std::memory_order_acquire);
+	uint64_t first = written > ThreadBuffer::capacity ? written - ThreadBuffer::capacity : 0;
+	size_t base = out.size();
+	for (uint64_t i = first; i < written; i++) {
+		const Event &e = buffer.events[i % ThreadBuffer::capacity];
+		Snapshot s;
+		s.name = e.name.load(std::memory_order_relaxed);
+		s.start = e.start.load(std::memory_order_relaxed);
+		s.end = e.end.load(std::memory_order_relaxed);
+		s.thread = buffer.id;
+		out.push_back(s);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after = buffer.written.load(std::memory_order_relaxed);
+	uint64_t intact = after + 1 > ThreadBuffer::capacity ? after + 1 - ThreadBuffer::capacity : 0;
+	size_t overwritten = (size_t)(std::min(std::max(intact, first), written) - first);
+	out.erase(out.begin() + base, out.begin() + base + overwritten);
+	out.erase(std::remove_if(out.begin() + base, out.end(), [&](const Snapshot &s) {
+		return s.name == NULL || s.end < since;
+	}), out.end());
+}
+
+// copies of every ring, with the thread names by id
+//
+static void snapshot(int64_t since, std::vector<Snapshot> &events, std::vector<std::string> *names) {
+	since = std::max(since, clearedAt.load(std::memory_order_relaxed));
+	std::vector<ThreadBuffer *> buffers;
+	{
+		std::lock_guard<std::mutex> guard(registryLock);
+		for (int i = 0; i < registry.size(); i++) {
+			buffers.push_back(registry[i].get());
+			if (names) names->push_back(registry[i]->name);
+		}
+	}
+	for (int i = 0; i < buffers.size(); i++) copyEvents(*buffers[i], since, events);
+}
+
+void clear() {
+	clearedAt.store(now(), std::memory_order_relaxed);
+}
+
+void zoneStats(std::vector<ZoneStats> &out, double windowSeconds) {
+	out.clear();
+	std::vector<Snapshot> events;
+	snapshot(now() - (int64_t)(windowSeconds * 1e9), events, NULL);
+
+	// durations by zone, ordered by name
+	//
+	struct NameLess {
+		bool operator()(const char *a, const char *b) const { return strcmp(a, b) < 0; }
+	};
+	std::map<const char *, std::vector<double>, NameLess> zones;
+	for (int i = 0; i < events.size(); i++) {
+		zones[events[i].name].push_back((events[i].end - events[i].start) * 1e-6);
+	}
+	for (auto &zone : zones) {
+		std::vector<double> &d = zone.second;
+		ZoneStats s;
+		s.name = zone.first;
+		s.count = (int)d.size();
+		size_t k50 = (d.size() - 1) / 2;
+		size_t k99 = (size_t)((d.size() - 1) * 0.99 + 0.5);
+		std::nth_element(d.begin(), d.begin() + k99, d.end());
+		s.p99 = d[k99];
+		std::nth_element(d.begin(), d.begin() + k50, d.begin() + k99);
+		s.p50 = d[k50];
+		out.push_back(s);
+	}
+}
+
+static void appendJsonString(std::string &text, const char *s) {
+	text += '"';
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			text += '\\';
+			text += (char)c;
+		}
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			text += buf;
+		}
+		else text += (char)c;
+	}
+	text += '"';
+}
+
+bool writeChromeTrace(const std::string &path) {
+	std::vector<Snapshot> events;
+	std::vector<std::string> names;
+	snapshot(0, events, &names);
+
+	// complete ("X") events, times in microseconds
+	//
+	std::string text = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	for (int i = 0; i < names.size(); i++) {
+		text += "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(i) + ", \"args\": {\"name\": ";
+		appendJsonString(text, names[i].c_str());
+		text += "}},\n";
+	}
+	char buf[96];
+	for (int i = 0; i < events.size(); i++) {
+		const Snapshot &e = events[i];
+		text += "{\"name\": ";
+		appendJsonString(text, e.name);
+		snprintf(buf, sizeof(buf), ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f},\n",
+			e.thread, e.start * 1e-3, (e.end - e.start) * 1e-3);
+		text += buf;
+	}
+	text += "{\"name\": \"trace end\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 0, \"ts\": ";
+	snprintf(buf, sizeof(buf), "%.3f", now() * 1e-3);
+	text += buf;
+	text += "}\n]}\n";
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) return false;
+	bool bOk = fwrite(text.data(), 1, text.size(), f) == text.size();
+	return (fclose(f) == 0) && bOk;
+}
+
+}
@@ -0,0 +1,88 @@
+//
+//  Trace.h - Scoped timing zones with a Chrome trace dump
+//
+//  TRACE_ZONE("name") times the rest of the enclosing scope.  Every thread
+//  records its zones into a ring buffer of its own, so recording takes no
+//  lock and never waits for a reader; the oldest events are overwritten.
+//  A dump or a stats query copies the rings while they are being written
+//  and drops whatever was overwritten during the copy (the write count is
+//  read before and after, like a sequence lock).
+//
+//  Tracing starts disabled, and then a zone is one relaxed atomic load and
+//  a branch.  Defining TRACE_DISABLED compiles the zones out altogether.
+//  Zone names are string literals: only the pointer is recorded.
+//
+//  writeChromeTrace() writes the events in the Chrome trace event format,
+//  for chrome://tracing or ui.perfetto.dev.  zoneStats() gives the median
+//  and 99th percentile time of each zone over a recent window.  Only
+//  depends on the standard library.
+//
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Trace {
+
+extern std::atomic<bool> bEnabled;
+
+inline bool enabled() { return bEnabled.load(std::memory_order_relaxed); }
+void setEnabled(bool b);
+
+// nanoseconds since the first call into the tracer
+//
+int64_t now();
+
+void record(const char *name, int64_t start, int64_t end);
+
+// shown as the calling thread's name in the dump (threads default to
+// "thread N").  A string literal, like the zone names
+//
+void setThreadName(const char *name);
+
+// forget every recorded event
+//
+void clear();
+
+struct ZoneStats {
+	const char *name;
+	int count;
+	double p50, p99;      // milliseconds
+};
+
+// zones that ended in the last windowSeconds, sorted by name
+//
+void zoneStats(std::vector<ZoneStats> &out, double windowSeconds = 2.0);
+
+// every event still in the buffers; false if the file can't be written
+//
+bool writeChromeTrace(const std::string &path);
+
+class Scope {
+public:
+	explicit Scope(const char *zone) : name(enabled() ? zone : NULL) {
+		if (name) start = now();
+	}
+	~Scope() {
+		if (name) record(name, start, now());
+	}
+	Scope(const Scope &) = delete;
+	Scope &operator=(const Scope &) = delete;
+
+private:
+	const char *name;
+	int64_t start = 0;
+};
+
+}
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#ifdef TRACE_DISABLED
+#define TRACE_ZONE(name) ((void)0)
+#else
+#define TRACE_ZONE(name) Trace::Scope TRACE_CONCAT(traceZone, __LINE__)(name)
+#endif
@@ -12,6 +12,11 @@
  *
  */
 bool Box::intersect(const _Ray &r, float t0, float t1) const {
+  float tHit;
+  return intersect(r, t0, t1, tHit);
+}
+
+bool Box::intersect(const _Ray &r, float t0, float t1, float &tHit) const {
   float tmin, tmax, tymin, tymax, tzmin, tzmax;
 
   tmin = (parameters[r.sign[0]].x() - r.origin.x()) * r.inv_direction.x();
@@ -32,5 +37,6 @@ bool Box::intersect(const _Ray &r, float t0, float t1) const {
     tmin = tzmin;
   if (tzmax < tmax)
     tmax = tzmax;
+  tHit = (tmin > t0) ? tmin : tmax;
   return ( (tmin < t1) && (tmax > t0) );
 }
@@ -25,6 +25,9 @@ class Box {
     }
     // (t0, t1) is the interval for valid hits
     bool intersect(const _Ray &, float t0, float t1) const;
+    // same test, also returns the ray parameter of the hit: where the ray
+    // enters the box, or where it leaves it when it starts inside (t0, t1)
+    bool intersect(const _Ray &, float t0, float t1, float &tHit) const;
 
     // corners
     Vector3 parameters[2];
@@ -0,0 +1,237 @@
+#include <limits>
+#include <bitset>
+#include "boxset.h"
+
+#if BOXSET_LANES > 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Lane abstractions for the batched Williams test.  Every kernel below is
+ * written once against these and instantiated for the widest instruction
+ * set the file is compiled with.  Comparisons use the ordered, non-signalling
+ * predicates so a NaN slab compares false just like the scalar code in box.cc.
+ */
+
+struct ScalarLanes {
+  enum { width = 1 };
+  typedef float V;
+  typedef bool M;
+  static V load(const float *p) { return *p; }
+  static void store(float *p, V v) { *p = v; }
+  static V set1(float f) { return f; }
+  static V sub(V a, V b) { return a - b; }
+  static V mul(V a, V b) { return a * b; }
+  static M gt(V a, V b) { return a > b; }
+  static M lt(V a, V b) { return a < b; }
+  static M orM(M a, M b) { return a || b; }
+  static M andM(M a, M b) { return a && b; }
+  static M andNotM(M a, M b) { return !a && b; }
+  static V select(M m, V a, V b) { return m ? a : b; }     // m ? a : b
+  static uint32_t bits(M m) { return m ? 1u : 0u; }
+};
+
+#if BOXSET_LANES >= 4
+struct SSELanes {
+  enum { width = 4 };
+  typedef __m128 V;
+  typedef __m128 M;
+  static V load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+  static V set1(float f) { return _mm_set1_ps(f); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static M gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+  static M lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static M orM(M a, M b) { return _mm_or_ps(a, b); }
+  static M andM(M a, M b) { return _mm_and_ps(a, b); }
+  static M andNotM(M a, M b) { return _mm_andnot_ps(a, b); }
+  static V select(M m, V a, V b) {
+#if defined(__SSE4_1__) || defined(__AVX__)
+    return _mm_blendv_ps(b, a, m);
+#else
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+#endif
+  }
+  static uint32_t bits(M m) { return (uint32_t)_mm_movemask_ps(m); }
+};
+#endif
+
+#if BOXSET_LANES >= 8
+struct AVXLanes {
+  enum { width = 8 };
+  typedef __m256 V;
+  typedef __m256 M;
+  static V load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+  static V set1(float f) { return _mm256_set1_ps(f); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static M gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static M orM(M a, M b) { return _mm256_or_ps(a, b); }
+  static M andM(M a, M b) { return _mm256_and_ps(a, b); }
+  static M andNotM(M a, M b) { return _mm256_andnot_ps(a, b); }
+  // masks are all ones or all zeros per lane, so and/or selects the same as
+  // blendv.  GCC turns _mm256_blendv_ps into scalar code for plain -mavx
+  static V select(M m, V a, V b) { return _mm256_or_ps(_mm256_and_ps(m, a), _mm256_andnot_ps(m, b)); }
+  static uint32_t bits(M m) { return (uint32_t)_mm256_movemask_ps(m); }
+};
+#endif
+
+#if BOXSET_LANES >= 16
+struct AVX512Lanes {
+  enum { width = 16 };
+  typedef __m512 V;
+  typedef __mmask16 M;
+  static V load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *p, V v) { _mm512_storeu_ps(p, v); }
+  static V set1(float f) { return _mm512_set1_ps(f); }
+  static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+  static M gt(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  static M lt(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static M orM(M a, M b) { return (M)(a | b); }
+  static M andM(M a, M b) { return (M)(a & b); }
+  static M andNotM(M a, M b) { return (M)(~a & b); }
+  static V select(M m, V a, V b) { return _mm512_mask_blend_ps(m, b, a); }
+  static uint32_t bits(M m) { return (uint32_t)m; }
+};
+#endif
+
+#if BOXSET_LANES == 16
+typedef AVX512Lanes Lanes;
+#elif BOXSET_LANES == 8
+typedef AVXLanes Lanes;
+#elif BOXSET_LANES == 4
+typedef SSELanes Lanes;
+#else
+typedef ScalarLanes Lanes;
+#endif
+
+// per ray constants, splatted once and reused for every block of boxes
+//
+template <class L>
+struct RayLanes {
+  RayLanes(const BoxSet &s, const _Ray &r, float t0, float t1) {
+    ox = L::set1(r.origin.x()); oy = L::set1(r.origin.y()); oz = L::set1(r.origin.z());
+    ix = L::set1(r.inv_direction.x()); iy = L::set1(r.inv_direction.y()); iz = L::set1(r.inv_direction.z());
+    lt0 = L::set1(t0);
+    lt1 = L::set1(t1);
+
+    // same as parameters[r.sign[k]] / parameters[1 - r.sign[k]] in box.cc
+    loX = r.sign[0] ? s.maxX.data() : s.minX.data();
+    hiX = r.sign[0] ? s.minX.data() : s.maxX.data();
+    loY = r.sign[1] ? s.maxY.data() : s.minY.data();
+    hiY = r.sign[1] ? s.minY.data() : s.maxY.data();
+    loZ = r.sign[2] ? s.maxZ.data() : s.minZ.data();
+    hiZ = r.sign[2] ? s.minZ.data() : s.maxZ.data();
+  }
+  typename L::V ox, oy, oz, ix, iy, iz, lt0, lt1;
+  const float *loX, *hiX, *loY, *hiY, *loZ, *hiZ;
+};
+
+// Box::intersect on L::width boxes starting at box i
+//
+template <class L>
+static inline uint32_t testBlock(const RayLanes<L> &r, int i, float *tEntry) {
+  typedef typename L::V V;
+  typedef typename L::M M;
+
+  V tmin = L::mul(L::sub(L::load(r.loX + i), r.ox), r.ix);
+  V tmax = L::mul(L::sub(L::load(r.hiX + i), r.ox), r.ix);
+  V tymin = L::mul(L::sub(L::load(r.loY + i), r.oy), r.iy);
+  V tymax = L::mul(L::sub(L::load(r.hiY + i), r.oy), r.iy);
+  M miss = L::orM(L::gt(tmin, tymax), L::gt(tymin, tmax));
+  tmin = L::select(L::gt(tymin, tmin), tymin, tmin);
+  tmax = L::select(L::lt(tymax, tmax), tymax, tmax);
+
+  V tzmin = L::mul(L::sub(L::load(r.loZ + i), r.oz), r.iz);
+  V tzmax = L::mul(L::sub(L::load(r.hiZ + i), r.oz), r.iz);
+  miss = L::orM(miss, L::orM(L::gt(tmin, tzmax), L::gt(tzmin, tmax)));
+  tmin = L::select(L::gt(tzmin, tmin), tzmin, tmin);
+  tmax = L::select(L::lt(tzmax, tmax), tzmax, tmax);
+
+  M hit = L::andNotM(miss, L::andM(L::lt(tmin, r.lt1), L::gt(tmax, r.lt0)));
+  if (tEntry) L::store(tEntry, L::select(hit, tmin, L::set1(std::numeric_limits<float>::infinity())));
+  return L::bits(hit);
+}
+
+// one ray against boxes [first, last) of the set (first is a multiple of the
+// lane width).  hits must be cleared by the caller.
+//
+template <class L>
+static int testRange(const RayLanes<L> &r, int count, int first, int last, uint32_t *hits, float *tEntry) {
+  int nHits = 0;
+  for (int i = first; i < last; i += L::width) {
+    float tail[L::width];
+    bool partial = (i + L::width > count);
+    float *out = tEntry ? (partial ? tail : tEntry + i) : NULL;
+
+    uint32_t m = testBlock<L>(r, i, out);
+    if (partial) {
+      int valid = count - i;
+      m &= (1u << valid) - 1;
+      for (int k = 0; out && k < valid; k++) tEntry[i + k] = tail[k];
+    }
+    if (m) {
+      hits[i / 32] |= m << (i % 32);
+      nHits += (int)std::bitset<32>(m).count();
+    }
+  }
+  return nHits;
+}
+
+void BoxSet::clear() {
+  count = 0;
+  minX.clear(); minY.clear(); minZ.clear();
+  maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void BoxSet::reserve(int n) {
+  n = (n + 15) & ~15;
+  minX.reserve(n); minY.reserve(n); minZ.reserve(n);
+  maxX.reserve(n); maxY.reserve(n); maxZ.reserve(n);
+}
+
+// storage grows 16 lanes at a time; unused lanes hold an empty (inverted)
+// box so full width loads never read past the end
+//
+int BoxSet::add(const Vector3 &min, const Vector3 &max) {
+  if (count == (int)minX.size()) {
+    float inf = std::numeric_limits<float>::infinity();
+    int n = count + 16;
+    minX.resize(n, inf); minY.resize(n, inf); minZ.resize(n, inf);
+    maxX.resize(n, -inf); maxY.resize(n, -inf); maxZ.resize(n, -inf);
+  }
+  set(count, min, max);
+  return count++;
+}
+
+void BoxSet::set(int i, const Vector3 &min, const Vector3 &max) {
+  minX[i] = min.x(); minY[i] = min.y(); minZ[i] = min.z();
+  maxX[i] = max.x(); maxY[i] = max.y(); maxZ[i] = max.z();
+}
+
+int BoxSet::intersect(const _Ray &r, float t0, float t1, uint32_t *hits, float *tEntry) const {
+  for (int w = 0; w < maskWords(); w++) hits[w] = 0;
+  return testRange(RayLanes<Lanes>(*this, r, t0, t1), count, 0, count, hits, tEntry);
+}
+
+int BoxSet::intersect(const _Ray *rays, int nRays, float t0, float t1, uint32_t *hits, float *tEntry) const {
+  int words = maskWords();
+  int nHits = 0;
+  for (int j = 0; j < nRays * words; j++) hits[j] = 0;
+
+  // walk the boxes in chunks that stay in L1 and run the whole packet over
+  // each chunk before moving on
+  const int chunk = 256;
+  for (int first = 0; first < count; first += chunk) {
+    int last = (first + chunk < count ? first + chunk : count);
+    for (int j = 0; j < nRays; j++) {
+      RayLanes<Lanes> r(*this, rays[j], t0, t1);
+      nHits += testRange(r, count, first, last, hits + j * words, tEntry ? tEntry + j * count : NULL);
+    }
+  }
+  return nHits;
+}
@@ -0,0 +1,71 @@
+#ifndef _BOXSET_H_
+#define _BOXSET_H_
+
+#include <stdint.h>
+#include <vector>
+#include "vector3.h"
+#include "ray.h"
+#include "box.h"
+
+/*
+ * Batched version of the Williams et al. ray-box test (see box.h).
+ *
+ * Boxes are stored as a structure of arrays (one lane per box for each of
+ * min/max x, y, z) and tested BOXSET_LANES at a time with SSE (4), AVX (8)
+ * or AVX-512 (16), depending on what the translation unit is compiled for.
+ * The comparisons are done in exactly the same order as Box::intersect, so
+ * the results match it bit for bit, including rays with zero direction
+ * components (infinite inv_direction) and the resulting NaN slabs.  The
+ * app's --bench run checks this and times both (see AppBenchmarks.h).
+ */
+
+#if defined(__AVX512F__)
+#define BOXSET_LANES 16
+#elif defined(__AVX__)
+#define BOXSET_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOXSET_LANES 4
+#else
+#define BOXSET_LANES 1
+#endif
+
+class BoxSet {
+  public:
+    BoxSet() : count(0) { }
+
+    int size() const { return count; }
+
+    // number of 32 bit words in a hit mask for this set
+    int maskWords() const { return (count + 31) / 32; }
+
+    void clear();
+    void reserve(int n);
+
+    // append a box, returns its index
+    int add(const Vector3 &min, const Vector3 &max);
+    int add(const Box &b) { return add(b.parameters[0], b.parameters[1]); }
+
+    // overwrite the bounds of box i (used when refitting)
+    void set(int i, const Vector3 &min, const Vector3 &max);
+
+    // One ray against every box.  Bit i of hits (hits[i / 32]) is set when
+    // box i is hit inside (t0, t1); tEntry[i] receives the entry distance of
+    // the ray for hit boxes and +infinity otherwise.  tEntry may be NULL.
+    // Returns the number of boxes hit.
+    int intersect(const _Ray &r, float t0, float t1, uint32_t *hits, float *tEntry) const;
+
+    // A packet of rays against every box.  Each block of boxes is loaded
+    // once and tested against all rays of the packet.  Results for ray j
+    // are at hits + j * maskWords() and tEntry + j * size().
+    // Returns the total number of hits.
+    int intersect(const _Ray *rays, int nRays, float t0, float t1, uint32_t *hits, float *tEntry) const;
+
+    // box bounds, padded with empty boxes to a multiple of 16 lanes
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+  private:
+    int count;
+};
+
+#endif // _BOXSET_H_
@@ -1,13 +1,27 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "AppBenchmarks.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// --bench times the core paths and exits without opening a window
+	if (wantsBenchmarks(argc, argv)) return runBenchmarks(argc, argv);
+
+	// --trace [path] records timing zones from the start and writes them on exit
+	string tracePath;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) != "--trace") continue;
+		Trace::setEnabled(true);
+		tracePath = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[i + 1] : ofToDataPath("trace.json");
+	}
+
 	ofSetupOpenGL(1200,800,OF_WINDOW);			// <-------- setup the GL context
+	ofApp *app = new ofApp();
+	app->tracePath = tracePath;
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(app);
 
 }
@@ -14,6 +14,7 @@
 //
 
 #include "ofApp.h"
+#include <filesystem>
 
 /**
 * Method that sets the scene along with the cameras and lights.
@@ -50,10 +51,62 @@ void ofApp::setup() {
 	//
 	// ground plane
 	//
-	scene.push_back(new Plane(glm::vec3(0, -2, 0), glm::vec3(0, 1, 0)));
+	scene.push_back(&ground);
 
 	gui.setup();
 	gui.add(dur.setup("Animation Duration", 1, 0.5, 3.0));
+	gui.add(scrub.setup("Animation Time", 0, 0, 1));
+	gui.add(quatKeys.setup("Quaternion Rotation Keys", false));
+	gui.add(geodesicWeights.setup("Geodesic Skin Weights", false));
+	gui.add(meshLod.setup("Mesh LOD", true));
+	gui.add(traceZones.setup("Trace Zones", Trace::enabled()));
+}
+
+/**
+* Writes the trace to the path given with --trace, if any.
+*/
+void ofApp::exit()
+{
+	if (!tracePath.empty()) dumpTrace();
+}
+
+/**
+* Write the zones still held by the trace buffers as Chrome trace JSON,
+* to the --trace path or data/trace.json.
+*/
+void ofApp::dumpTrace()
+{
+	string path = tracePath.empty() ? ofToDataPath("trace.json") : tracePath;
+	if (Trace::writeChromeTrace(path)) cout << "Trace written to " << path << endl;
+	else cout << "Could not write " << path << endl;
+}
+
+/**
+* Refresh the p50/p99 labels of the trace zones, twice a second.
+* A label is added to the panel the first time a zone shows up.
+*/
+void ofApp::updateTraceStats()
+{
+	float time = ofGetElapsedTimef();
+	if (time - lastTraceStats < 0.5) return;
+	lastTraceStats = time;
+
+	vector<Trace::ZoneStats> stats;
+	Trace::zoneStats(stats);
+	for (int i = 0; i < stats.size(); i++)
+	{
+		string name = stats[i].name;
+		char value[64];
+		snprintf(value, sizeof(value), "p50 %.3f  p99 %.3f ms", stats[i].p50, stats[i].p99);
+		auto found = traceLabelIndex.find(name);
+		if (found == traceLabelIndex.end())
+		{
+			traceLabels.emplace_back();
+			traceLabelIndex[name] = (int)traceLabels.size() - 1;
+			gui.add(traceLabels.back().setup(name, value));
+		}
+		else traceLabels[found->second] = string(value);
+	}
 }
 
  
@@ -62,30 +115,64 @@ void ofApp::setup() {
 * This update is called by every frame (60 frames per second)
 */
 void ofApp::update(){
+	if (traceZones != Trace::enabled()) Trace::setEnabled(traceZones);
+	if (traceZones) updateTraceStats();
+	TRACE_ZONE("ofApp::update");
+
+	// applies to tracks created from now on, keyed tracks keep their kind
+	animation.bQuatRotation = quatKeys;
+
 	if (playing)
 	{
 		playing = animation.playback();
+		scrub = lastScrub = animation.getProgress();
+
+		// the whole skeleton moves, so evaluate it in one linear pass
+		// instead of lazily walking the parent chains
+		if (bPoseDirty)
+		{
+			skeletonPose.build(scene);
+			bPoseDirty = false;
+		}
+		skeletonPose.evaluate();
+	}
+	else if (scrub != lastScrub)
+	{
+		// scrubbing samples the clip directly at the chosen time
+		lastScrub = scrub;
+		animation.seek(scrub);
 	}
 
+	if (!pendingModels.empty() || !abandonedModels.empty()) finishPendingModels();
+
 	for (int i = 0; i < mods.size(); i++)
 	{
+		// skinned models keep the placement they were bound with
+		if (models[i].isSkinned())
+		{
+			models[i].updateSkin();
+			continue;
+		}
+
+		glm::vec3 jointPos = mods[i]->getPosition();
 		if (models[i].name.compare("engineerfriend.obj") == 0)
 		{
-			models[i].mesh.setPosition(mods[i]->getPosition().x - 0.1, mods[i]->getPosition().y - 0.25, mods[i]->getPosition().z + 0.3);
-			models[i].mesh.setRotation(0, mods[i]->rotation.x - 90, 1, 0, 0);
+			models[i].mesh.setPosition(jointPos.x - 0.1, jointPos.y - 0.25, jointPos.z + 0.3);
+			models[i].mesh.setRotation(0, mods[i]->getRotation().x - 90, 1, 0, 0);
 		}
 		else
 		{
-			models[i].mesh.setPosition(mods[i]->getPosition().x, mods[i]->getPosition().y - 0.25, mods[i]->getPosition().z);
-			models[i].mesh.setRotation(0, mods[i]->rotation.x, 1, 0, 0);
+			models[i].mesh.setPosition(jointPos.x, jointPos.y - 0.25, jointPos.z);
+			models[i].mesh.setRotation(0, mods[i]->getRotation().x, 1, 0, 0);
 		}
-		models[i].mesh.setRotation(1, mods[i]->rotation.z, 0, -1, 0);
-		models[i].mesh.setRotation(2, mods[i]->rotation.y, 0, 0, 1);
+		models[i].mesh.setRotation(1, mods[i]->getRotation().z, 0, -1, 0);
+		models[i].mesh.setRotation(2, mods[i]->getRotation().y, 0, 0, 1);
 	}
 }
 
 //--------------------------------------------------------------
 void ofApp::draw(){
+	TRACE_ZONE("ofApp::draw");
 
 	// draw gui
 	glDepthMask(false);
@@ -101,15 +188,22 @@ void ofApp::draw(){
 	//
 	material.begin();
 	ofFill();
-	for (int i = 0; i < scene.size(); i++) {
-		if (objSelected() && scene[i] == selected[0])
+	{
+		TRACE_ZONE("SceneObject::draw");
+		if (objSelected() && scene[0] == selected[0])
 			ofSetColor(ofColor::white);
-		else ofSetColor(scene[i]->diffuseColor);
-		scene[i]->draw();
+		else ofSetColor(scene[0]->diffuseColor);
+		scene[0]->draw();
 	}
+	drawSkeleton();
 
+	// each model at the coarsest level that looks the same from this camera
+	glm::vec3 eye = theCam->getGlobalPosition();
 	for (int i = 0; i < models.size(); i++)
 	{
+		TRACE_ZONE("Mesh::draw");
+		Model &model = models[i].mesh;
+		model.setLodLevel(meshLod ? model.pickLod(eye, theCam->getFov(), ofGetViewportHeight()) : 0);
 		models[i].draw();
 	}
 
@@ -118,6 +212,52 @@ void ofApp::draw(){
 	theCam->end();
 }
 
+/**
+* Draw the joints with a few calls: the ground plane is scene[0], every
+* object after it is a joint.  Their matrices, positions and colors are
+* gathered each frame, the parents only after joints were created, removed
+* or loaded.  The spheres are lit, the bones and axes are not.
+*/
+void ofApp::drawSkeleton()
+{
+	TRACE_ZONE("ofApp::drawSkeleton");
+	int n = (int)scene.size() - 1;
+	if (bBatchDirty)
+	{
+		unordered_map<SceneObject *, int> jointIndex;
+		for (int i = 0; i < n; i++) jointIndex[scene[i + 1]] = i;
+		batchParents.resize(n);
+		for (int i = 0; i < n; i++)
+		{
+			auto found = jointIndex.find(scene[i + 1]->parent);
+			batchParents[i] = (found != jointIndex.end()) ? found->second : -1;
+		}
+		batchWorld.resize(n);
+		batchTranslations.resize(n);
+		batchRadii.resize(n);
+		batchColors.resize(n);
+		bBatchDirty = false;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		Joint *joint = (Joint *)scene[i + 1];
+		ofColor c = (objSelected() && joint == selected[0]) ? ofColor::white : joint->diffuseColor;
+		batchWorld[i] = joint->getMatrix();
+		batchTranslations[i] = joint->position;
+		batchRadii[i] = joint->radius;
+		batchColors[i] = glm::vec4(c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f);
+	}
+	skeletonBatch.build(n, batchParents.data(), batchWorld.data(), batchTranslations.data(),
+		batchRadii.data(), batchColors.data());
+	skeletonRenderer.update(skeletonBatch);
+
+	skeletonRenderer.drawJoints(skeletonBatch);
+	ofDisableLighting();
+	skeletonRenderer.drawLines();
+	ofEnableLighting();
+}
+
 // 
 // Draw an XYZ axis in RGB at transform
 //
@@ -143,7 +283,7 @@ void ofApp::drawAxis(glm::mat4 m, float len) {
 //
 void ofApp::printChannels(SceneObject *obj) {
 	cout << "position = glm::vec3(" << obj->position.x << "," << obj->position.y << "," << obj->position.z << ");" << endl;
-	cout << "rotation = glm::vec3(" << obj->rotation.x << "," << obj->rotation.y << "," << obj->rotation.z << ");" << endl;
+	cout << "rotation = glm::vec3(" << obj->getRotation().x << "," << obj->getRotation().y << "," << obj->getRotation().z << ");" << endl;
 	cout << "scale = glm::vec3(" << obj->scale.x << "," << obj->scale.y << "," << obj->scale.z << ");" << endl;
 }
 
@@ -176,9 +316,15 @@ void ofApp::printFamily(SceneObject* obj)
 * The file created/saved is called model.txt
 * Each joint is saved in the format:
 * create -joint joint1 -rotate <0, 0, 0> -translate <0.04, -1.01, 0> -parent joint0;
+* Numbers are written at full precision.  The same skeleton is also saved in
+* binary form to model.skel, which is what loadFromFile() reads when it is current.
+* The keyed animation goes to model.anim with its tracks named after their joints (see
+* AnimationFile), which the headless bake tool can play without the app.
 */
 void ofApp::saveToFile()
 {
+	TRACE_ZONE("ofApp::saveToFile");
+
 	// check if root exists
 	bool bRootExists = false;
 	for (int i = 1; i < scene.size(); i++)
@@ -195,126 +341,147 @@ void ofApp::saveToFile()
 		return;
 	}
 
-	// creates and build fresh file
-	skeleton.open("model.txt", ofFile::WriteOnly);
-	skeleton.create(); 
-	
-	string parentName;
+	// joints keep their scene order; parents are stored by index
+	//
+	SkeletonFile file;
+	unordered_map<SceneObject *, int> jointIndex;
+	for (int i = 1; i < scene.size(); i++)
+	{
+		jointIndex[scene[i]] = i - 1;
+	}
 	for (int i = 1; i < scene.size(); i++)
 	{
-		parentName = "";
-		if (scene[i]->parent != NULL)
+		JointDesc desc;
+		desc.name = scene[i]->name;
+		desc.rotation = scene[i]->getRotation();
+		desc.translation = scene[i]->position;
+		desc.parent = (scene[i]->parent != NULL) ? jointIndex[scene[i]->parent] : -1;
+		if (file.addJoint(desc) < 0)
 		{
-			parentName = scene[i]->parent->name;
+			cout << "Duplicate joint name " << desc.name << ", save failed" << endl;
+			return;
 		}
+	}
 
-		// format each number to two decimal places
-		glm::vec3 formattedRot = scene[i]->rotation;
-		formattedRot.x = ((int)(formattedRot.x * 100 + .5)) / 100.0f;
-		formattedRot.y = ((int)(formattedRot.y * 100 + .5)) / 100.0f;
-		formattedRot.z = ((int)(formattedRot.z * 100 + .5)) / 100.0f;
-
-		glm::vec3 formattedPos = scene[i]->position;
-		formattedPos.x = ((int)(formattedPos.x * 100 + .5)) / 100.0f;
-		formattedPos.y = ((int)(formattedPos.y * 100 + .5)) / 100.0f;
-		formattedPos.z = ((int)(formattedPos.z * 100 + .5)) / 100.0f;
-
-		skeleton << "create -joint " << scene[i]->name <<
-			" -rotate <" << formattedRot <<
-			"> -translate <" << formattedPos <<
-			"> -parent " << parentName << ";";
+	if (!file.saveText(ofToDataPath("model.txt")) || !file.saveBinary(ofToDataPath("model.skel")))
+	{
+		cout << "Could not write model.txt/model.skel, save failed" << endl;
+		return;
+	}
+	cout << "Sucessfully saved joints!" << endl;
 
-		if (i != scene.size() - 1)
+	// an old clip would be played on the new joints, so it goes when there are no keys
+	//
+	string animPath = ofToDataPath("model.anim");
+	if (animation.addedNodes.empty())
+	{
+		std::error_code ec;
+		std::filesystem::remove(animPath, ec);
+		return;
+	}
+	AnimationFile clip;
+	for (int i = 0; i < animation.addedNodes.size(); i++)
+	{
+		if (clip.addTrack(animation.addedNodes[i]->name, animation.timeline.tracks[i]) < 0)
 		{
-			skeleton << endl;
+			cout << "Two animated objects are named " << animation.addedNodes[i]->name << ", model.anim not saved" << endl;
+			return;
 		}
 	}
-	skeleton.close();
-	cout << "Sucessfully saved joints!" << endl;
+	clip.timeline.bSlerp = animation.timeline.bSlerp;
+	if (!clip.saveText(animPath))
+	{
+		cout << "Could not write model.anim" << endl;
+		return;
+	}
+	cout << "Sucessfully saved the animation!" << endl;
 }
 
 /**
 * Method to load a saved joint configuration file overwriting the any current joints present.
-* This method will parse each line from the input file and create a joint system.
-* All Keyframes and Models are deleted upon loading.
+* The whole file is parsed first (see SkeletonFile), so a malformed file is reported
+* with its line and column and leaves the current joints alone.
+* model.skel is read instead when it is at least as new as model.txt.
+* All Keyframes and Models are deleted upon loading; the keys saved in model.anim are
+* then loaded back onto the joints they are named after.
 */
 void ofApp::loadFromFile()
 {
+	TRACE_ZONE("ofApp::loadFromFile");
+
 	if (!skeleton.doesFileExist("model.txt"))
 	{
 		cout << "The file doesn't exist, no model to load!";
 		return;
 	}
 
-	skeleton.open("model.txt", ofFile::Append, false);
+	// the binary copy is skipped if model.txt was edited after the last save
+	//
+	SkeletonFile file;
+	string textPath = ofToDataPath("model.txt");
+	string binaryPath = ofToDataPath("model.skel");
+	std::error_code ec;
+	bool bBinary = std::filesystem::exists(binaryPath, ec) &&
+		std::filesystem::last_write_time(binaryPath, ec) >= std::filesystem::last_write_time(textPath, ec) && !ec;
+	if (!bBinary || !file.loadBinary(binaryPath))
+	{
+		if (!file.loadText(textPath))
+		{
+			cout << "model.txt: " << file.error << endl;
+			return;
+		}
+	}
 
 	// clear any objects on screen and reset keyframes
 	//
-	scene.clear();
-	scene.push_back(new Plane(glm::vec3(0, -2, 0), glm::vec3(0, 1, 0)));
-	animation.addedNodes.clear();
-	animation.nStartPos.clear();
-	animation.nEndPos.clear();
-	animation.nStartRot.clear();
-	animation.nEndRot.clear();
-	models.clear();
-	mods.clear();
+	clearScene();
+	clearAnimation();
 
-	// read from file into buffer
-	ofBuffer buffer = ofBufferFromFile(skeleton);
-	string line = buffer.getNextLine();
-	vector<string> splitted;
-
-	while (!line.empty())
+	// joint creation; joints are numbered like the file, so parents
+	// are found by index
+	//
+	vector<Joint *> loaded(file.joints.size());
+	for (int i = 0; i < file.joints.size(); i++)
 	{
-		// split line by spaces
-		stringstream ss(line);
-		string word;
-		while (ss >> word)
-		{
-			splitted.push_back(word);
-		}
+		const JointDesc &desc = file.joints[i];
+		loaded[i] = newJoint(desc.translation);
+		loaded[i]->name = desc.name;
+		loaded[i]->setRotation(desc.rotation);
+	}
 
-		// joint creation
-		glm::vec3 lPos = glm::vec3(
-			stof(splitted[8].substr(1, splitted[8].size() - 1)),
-			stof(splitted[9].substr(0, splitted[9].size() - 1)),
-			stof(splitted[10].substr(0, splitted[10].size() - 1)));
-		
-		Joint* loaded = new Joint(lPos, radius);
-		loaded->name = splitted[2];
-		loaded->rotation = glm::vec3(
-			stof(splitted[4].substr(1, splitted[4].size() - 1)), 
-			stof(splitted[5].substr(0, splitted[5].size() - 1)),
-			stof(splitted[6].substr(0, splitted[6].size() - 1)));
-
-		// parent child links
-		string pName = splitted[12].substr(0, splitted[12].size() - 1);
-		if (!pName.empty())
+	// parent child links, then push objects onto scene in file order
+	//
+	for (int i = 0; i < file.joints.size(); i++)
+	{
+		if (file.joints[i].parent >= 0)
 		{
-			for (int j = 1; j < scene.size(); j++)
-			{
-				if (scene[j]->name.compare(pName) == 0)
-				{
-					scene[j]->addChild(loaded);
-				}
-			}
+			loaded[file.joints[i].parent]->addChild(loaded[i]);
 		}
-
-		// push object onto scene
-		scene.push_back(loaded);
-
-		// sync jointNumber count
-		jointNumber = max(jointNumber, stoi(splitted[2].substr(splitted[2].size() - 1, splitted[2].size())));
-	
-		// next line
-		splitted.clear();
-		line = buffer.getNextLine();
+		scene.push_back(loaded[i]);
 	}
 
-	jointNumber++;
-	skeleton.close();
+	// sync jointNumber count with the highest numbered joint
+	jointNumber = file.maxJointNumber() + 1;
 	cout << "Sucessfully loaded joints!" << endl;
+
+	// keys of models can't come back since the models are gone, only joints
+	//
+	if (!skeleton.doesFileExist("model.anim")) return;
+	AnimationFile clip;
+	if (!clip.loadText(ofToDataPath("model.anim")))
+	{
+		cout << "model.anim: " << clip.error << endl;
+		return;
+	}
+	vector<SceneObject *> nodes(clip.timeline.size(), NULL);
+	for (int i = 0; i < nodes.size(); i++)
+	{
+		int j = file.find(clip.trackJoints[i]);
+		if (j >= 0) nodes[i] = loaded[j];
+		else cout << "model.anim: no joint " << clip.trackJoints[i] << ", track skipped" << endl;
+	}
+	animation.setClip(clip.timeline, nodes);
+	cout << "Sucessfully loaded the animation!" << endl;
 }
 
 /**
@@ -325,7 +492,7 @@ void ofApp::createJoint()
 {
 	glm::vec3 point;
 	mouseToDragPlane(mouseX, mouseY, point);
-	Joint* created = new Joint(glm::vec3(0, 0, 0), radius, ofColor::blue);
+	Joint* created = newJoint(glm::vec3(0, 0, 0));
 	created->name = created->name + std::to_string(jointNumber);
 	
 	if (objSelected()) // create parent child relation between nodes
@@ -340,6 +507,9 @@ void ofApp::createJoint()
 	}
 	scene.push_back(created);
 	jointNumber++;
+	bPoseDirty = true;
+	bPickerDirty = true;
+	bBatchDirty = true;
 }
 
 /**
@@ -387,25 +557,70 @@ void ofApp::removeJoint()
 			{
 				for (int j = 0; j < scene[i]->childList.size(); j++)
 				{
-					scene[i]->childList[j]->parent = NULL;
+					scene[i]->childList[j]->clearParent();
 				}
 			}
 		}
 	}
 
-	// erasw selected node
+	// erasw selected node and give it back to the pool
 	scene.erase(scene.begin() + eraseIndex);
+	jointPool.release(selected[0]->handle);
 
 	// remove selection and keyframes upon delete
 	selected.clear(); 
-	animation.addedNodes.clear();
-	animation.nStartPos.clear();
-	animation.nEndPos.clear();
-	animation.nStartRot.clear();
-	animation.nEndRot.clear();
+	bPoseDirty = true;
+	bPickerDirty = true;
+	bBatchDirty = true;
+	clearAnimation();
+}
+
+//--------------------------------------------------------------
+/**
+* A joint from the pool, with its handle.  Marks the pose, picker and batch
+* dirty; the caller links it and pushes it onto the scene.
+*/
+Joint *ofApp::newJoint(glm::vec3 p)
+{
+	PoolHandle handle = jointPool.create(p, radius, ofColor::blue);
+	Joint *joint = jointPool.get(handle);
+	joint->handle = handle;
+	bPoseDirty = true;
+	bPickerDirty = true;
+	bBatchDirty = true;
+	return joint;
+}
+
+/**
+* Empty the scene down to the ground plane.  All joints go back to the pool
+* in one step and every handle to them goes stale.
+*/
+void ofApp::clearScene()
+{
+	scene.clear();
+	selected.clear();
+	jointPool.clear();
+	scene.push_back(&ground);
+	bPoseDirty = true;
+	bPickerDirty = true;
+	bBatchDirty = true;
+}
+
+/**
+* Drop the keyframes and the models rigged to joints, together, since both point
+* at joints that are about to go away.  Loads still running are abandoned
+* rather than destroyed, since a future from std::async blocks in its
+* destructor until the load is done; update() lets them go later.
+*/
+void ofApp::clearAnimation()
+{
+	animation.clear();
 	models.clear();
 	mods.clear();
+	for (int i = 0; i < pendingModels.size(); i++) abandonedModels.push_back(std::move(pendingModels[i].result));
+	pendingModels.clear();
 }
+
 //--------------------------------------------------------------
 void ofApp::keyReleased(int key){
 
@@ -452,6 +667,9 @@ void ofApp::keyPressed(int key) {
 	case 'h':
 		bHide = !bHide;
 		break;
+	case 'b':
+		benchmarkSkinning();
+		break;
 	case 'i':
 		if (objSelected()) printFamily(selected[0]);
 		break;
@@ -459,6 +677,9 @@ void ofApp::keyPressed(int key) {
 	case 'j':
 		createJoint();
 		break;
+	case 'k':
+		if (objSelected()) skinModels(selected[0]);
+		break;
 	case 'L':
 	case 'l':
 		loadFromFile();
@@ -468,20 +689,26 @@ void ofApp::keyPressed(int key) {
 		if (!playing)
 		{
 			playing = true;
-			animation.setTheStage(false, dur / 2.0);
+			animation.setTheStage(false, dur);
 		}
 		break;
+	case 'q':
+		if (objSelected()) toggleDualQuaternion(selected[0]);
+		break;
 	case 'r':
 		if (!playing)
 		{
 			playing = true;
-			animation.setTheStage(true, dur / 2.0);
+			animation.setTheStage(true, dur);
 		}
 		break;
 	case 'S':
 	case 's':
 		saveToFile();
 		break;
+	case 't':
+		dumpTrace();
+		break;
 	case 'X':
 	case 'x':
 		bRotateX = true;
@@ -527,16 +754,16 @@ void ofApp::mouseDragged(int x, int y, int button) {
 		glm::vec3 point; 
 		mouseToDragPlane(x, y, point);
 		if (bRotateX) {
-			selected[0]->rotation += glm::vec3((point.x - lastPoint.x) * 20.0, 0, 0);
+			selected[0]->setRotation(selected[0]->getRotation() + glm::vec3((point.x - lastPoint.x) * 20.0, 0, 0));
 		}
 		else if (bRotateY) {
-			selected[0]->rotation += glm::vec3(0, (point.x - lastPoint.x) * 20.0, 0);
+			selected[0]->setRotation(selected[0]->getRotation() + glm::vec3(0, (point.x - lastPoint.x) * 20.0, 0));
 		}
 		else if (bRotateZ) {
-			selected[0]->rotation += glm::vec3(0, 0, (point.x - lastPoint.x) * 20.0);
+			selected[0]->setRotation(selected[0]->getRotation() + glm::vec3(0, 0, (point.x - lastPoint.x) * 20.0));
 		}
 		else {
-			selected[0]->position += (point - lastPoint);
+			selected[0]->setLocalPosition(selected[0]->position + (point - lastPoint));
 		}
 		lastPoint = point;
 	}
@@ -575,6 +802,7 @@ void ofApp::mousePressed(int x, int y, int button){
 	// if we are moving the camera around, don't allow selection
 	//
 	if (mainCam.getMouseInputEnabled()) return;
+	TRACE_ZONE("ofApp::mousePressed");
 
 	// clear selection list
 	//
@@ -583,38 +811,34 @@ void ofApp::mousePressed(int x, int y, int button){
 	//
 	// test if something selected
 	//
-	vector<SceneObject *> hits;
-
 	glm::vec3 p = theCam->screenToWorld(glm::vec3(x, y, 0));
 	glm::vec3 d = p - theCam->getPosition();
 	glm::vec3 dn = glm::normalize(d);
 
-	// check for selection of scene objects
+	// check for selection of scene objects.  the BVH only needs refitting
+	// for objects that moved since the last click
 	//
-	for (int i = 0; i < scene.size(); i++) {
-		
-		glm::vec3 point, norm;
-		
-		//  We hit an object
-		//
-		if (scene[i]->isSelectable && scene[i]->intersect(Ray(p, dn), point, norm)) {
-			hits.push_back(scene[i]);
-		}
+	if (bPickerDirty) {
+		picker.build(scene);
+		bPickerDirty = false;
 	}
+	else picker.refit();
 
+	// nearest hit along the ray wins
+	//
+	glm::vec3 point, norm;
+	float dist;
+	SceneObject *selectedObj = picker.pick(Ray(p, dn), point, norm, dist);
 
-	// if we selected more than one, pick nearest
+	// clicking a bound model selects the joint it is bound to
 	//
-	SceneObject *selectedObj = NULL;
-	if (hits.size() > 0) {
-		selectedObj = hits[0];
-		float nearestDist = std::numeric_limits<float>::infinity();
-		for (int n = 0; n < hits.size(); n++) {
-			float dist = glm::length(hits[n]->position - theCam->getPosition());
-			if (dist < nearestDist) {
-				nearestDist = dist;
-				selectedObj = hits[n];
-			}	
+	for (int i = 0; i < models.size(); i++) {
+		glm::vec3 mPoint, mNorm;
+		if (!models[i].intersect(Ray(p, dn), mPoint, mNorm)) continue;
+		float mDist = glm::dot(mPoint - p, dn);
+		if (!selectedObj || mDist < dist) {
+			selectedObj = mods[i];
+			dist = mDist;
 		}
 	}
 	if (selectedObj) {
@@ -657,6 +881,9 @@ void ofApp::gotMessage(ofMessage msg){
 * Method to drag an obj file into the scene at the mouse point.
 * The model is bound to a selected joint.
 * Joints may only have one object bound to them.
+* OBJ files are loaded (from their cache when it is up to date) on a worker
+* thread and added by update() once ready;
+* other formats are loaded through assimp right away.
 */
 void ofApp::dragEvent(ofDragInfo dragInfo){
 	if (!objSelected())
@@ -671,30 +898,164 @@ void ofApp::dragEvent(ofDragInfo dragInfo){
 			return;
 		}
 	}
+	for (int i = 0; i < pendingModels.size(); i++)
+	{
+		if (selected[0]->handle == pendingModels[i].joint)
+		{
+			return;
+		}
+	}
+
+	string path = dragInfo.files[0];
+	int slash = 0;
+	for (int i = path.length() - 1; i >= 0; i--)
+	{
+		// find the first backslash from the end
+		if (path.at(i) == '\\')
+		{
+			break;
+		}
+		slash++;
+	}
+	string temp = path.substr(path.length() - slash, path.length());
+
+	if (Model::isObj(path))
+	{
+		PendingModel pending;
+		pending.name = temp;
+		pending.joint = selected[0]->handle;
+		pending.result = std::async(std::launch::async, [path] {
+			string error;
+			ModelSource source = Model::loadSource(path, &error);
+			if (!source.isValid()) ofLogError("dragEvent") << path << ": " << error;
+			return source;
+		});
+		pendingModels.push_back(std::move(pending));
+		return;
+	}
+
+	Model model;
+	if (model.loadModel(path)) {
+		addModel(model, temp, selected[0]);
+	}
+}
+
+/**
+* Bind a loaded model to a joint.
+*/
+void ofApp::addModel(Model model, string name, SceneObject *joint)
+{
+	model.setScale(0.2, 0.2, 0.2);
+	model.setPosition(0, 0, 0);
+	if (name.compare("engineerfriend.obj") == 0)
+	{
+		model.setScale(0.01, 0.01, 0.01);
+	}
+	models.push_back(Mesh(model, name));
+	mods.push_back(joint);
+}
 
-	ofxAssimpModelLoader model;
-	if (model.loadModel(dragInfo.files[0])) {
-		model.setScaleNormalization(false);
-		model.setScale(0.2, 0.2, 0.2);
-		model.setPosition(0, 0, 0);
+/**
+* Skin the models bound to the joint to every joint of its skeleton, in the
+* pose and placement they have now.  Weights come from the cache next to the
+* model file when it matches, otherwise they are computed and cached.
+*/
+void ofApp::skinModels(SceneObject *joint)
+{
+	ScenePose tree;
+	tree.build(vector<SceneObject *>(1, joint));
 
-		int slash = 0;
-		for (int i = dragInfo.files[0].length() - 1; i >= 0; i--)
+	SkinBindSettings settings;
+	settings.bGeodesic = geodesicWeights;
+	for (int i = 0; i < models.size(); i++)
+	{
+		if (mods[i] != joint) continue;
+		Mesh &model = models[i];
+		const MeshData &data = model.mesh.getData();
+
+		// bones in the model's own space
+		glm::mat4 toModel = glm::inverse(model.mesh.getModelMatrix());
+		vector<glm::vec3> positions(tree.nodes.size());
+		for (int j = 0; j < tree.nodes.size(); j++) positions[j] = toModel * glm::vec4(tree.nodes[j]->getPosition(), 1.0);
+		vector<BoneSegment> bones = boneSegments(tree.pose.parents, positions);
+
+		float start = ofGetElapsedTimef();
+		SkinWeights weights;
+		uint64_t key = SkinWeightCache::key(bones, settings);
+		const string &path = model.mesh.getPath();
+		bool bCached = !path.empty() && SkinWeightCache::read(path, key, data.vertexCount(), (int)tree.nodes.size(), weights);
+		if (!bCached)
 		{
-			// find the first backslash from the end
-			if (dragInfo.files[0].at(i) == '\\')
-			{
-				break;
-			}
-			slash++;
+			computeSkinWeights(data, bones, settings, weights);
+			if (!path.empty()) SkinWeightCache::write(path, key, weights);
 		}
+		model.bindSkin(tree.nodes, weights);
+		cout << model.name << ": skinned to " << tree.nodes.size() << " joints in " << ofGetElapsedTimef() - start << "s"
+			<< (bCached ? " (cached weights)" : "") << endl;
+	}
+}
 
-		string temp = dragInfo.files[0].substr(dragInfo.files[0].length() - slash, dragInfo.files[0].length());
-		if (temp.compare("engineerfriend.obj") == 0)
+/**
+* Switch the skinned models bound to the joint between linear blend and dual
+* quaternion skinning.
+*/
+void ofApp::toggleDualQuaternion(SceneObject *joint)
+{
+	for (int i = 0; i < models.size(); i++)
+	{
+		if (mods[i] != joint || !models[i].isSkinned()) continue;
+		Skin &skin = models[i].skin;
+		skin.bDualQuaternion = !skin.bDualQuaternion;
+		models[i].bSkinStale = true;
+		cout << models[i].name << (skin.bDualQuaternion ? ": dual quaternion skinning" : ": linear blend skinning") << endl;
+	}
+}
+
+/**
+* Time both skinning modes on every skinned model in its current pose.
+*/
+void ofApp::benchmarkSkinning()
+{
+	for (int i = 0; i < models.size(); i++)
+	{
+		Mesh &model = models[i];
+		if (!model.isSkinned()) continue;
+		model.jointWorld.resize(model.skinJoints.size());
+		for (int j = 0; j < model.skinJoints.size(); j++) model.jointWorld[j] = model.skinJoints[j]->getMatrix();
+		SkinBenchmark result = benchmarkSkin(model.skin, model.mesh.getData(), model.jointWorld.data(), 100);
+		cout << model.name << ": " << result.vertices << " vertices, " << result.influences << " influences, "
+			<< "linear " << result.linearMicros << " us, dual quaternion " << result.dualQuatMicros << " us" << endl;
+	}
+}
+
+/**
+* Add the models whose background load has finished, and let go of the
+* abandoned loads that have finished.
+*/
+void ofApp::finishPendingModels()
+{
+	for (int i = 0; i < abandonedModels.size(); )
+	{
+		if (abandonedModels[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) abandonedModels.erase(abandonedModels.begin() + i);
+		else i++;
+	}
+
+	for (int i = 0; i < pendingModels.size(); )
+	{
+		PendingModel &pending = pendingModels[i];
+		if (pending.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+		ModelSource source = pending.result.get();
+		Joint *joint = jointPool.get(pending.joint);
+		if (source.isValid() && joint)
 		{
-			model.setScale(0.01, 0.01, 0.01);
+			Model model;
+			model.setup(source);
+			addModel(model, pending.name, joint);
 		}
-		models.push_back(Mesh(model, temp));
-		mods.push_back(selected[0]);
+		pendingModels.erase(pendingModels.begin() + i);
 	}
 }
\ No newline at end of file
@@ -7,6 +7,19 @@
 //
 //  Modifer keys for rotatation are x, y and z keys (for each axis of rotation)
 //
+//  k skins the models bound to the selected joint to its skeleton with
+//  automatic weights (geodesic ones when "Geodesic Skin Weights" is on),
+//  q switches them between linear blend and dual quaternion skinning, b
+//  times both modes on every skinned model
+//
+//  Models are drawn at the coarsest level of detail (see MeshLod.h) that
+//  stays within a pixel of the full mesh; "Mesh LOD" off draws them whole
+//
+//  With "Trace Zones" on (or --trace on the command line) the main paths
+//  record timing zones (see Trace.h); the panel shows each zone's p50/p99
+//  and t writes the recorded frames to trace.json for chrome://tracing
+//  or ui.perfetto.dev.  --trace path also writes them there on exit
+//
 //  (c) Kevin M. Smith  - 24 September 2018
 // 
 //  Calvin Quach - 7 December 2022
@@ -15,28 +28,51 @@
 //  - implemented obj model rigging
 
 #include "ofMain.h"
+#include "AnimationFile.h"
 #include "box.h"
 #include "Primitives.h"
+#include "SkeletonBatch.h"
+#include "SkeletonRenderer.h"
+#include "SkeletonFile.h"
+#include "SkinBinding.h"
+#include "Timeline.h"
+#include "Trace.h"
 #include "ofxGui.h"
-#include "ofxAssimpModelLoader.h"
+#include <deque>
+#include <future>
 
+/**
+* Interactive front end of a Timeline.
+* Track i of the timeline animates addedNodes[i], trackIndex maps a node back to
+* its track so keying any number of nodes stays linear.  Keys set with '1' and '2' go at
+* the start (0) and end (1) of the clip with an eased segment between them; clips
+* with any number of keys per channel play the same way.  Playback stretches the
+* keyed span over the requested duration.
+*/
 class Keyframe {
 public:
 	float frameRate = 60.0;
 	float duration = 1.0;
 	float frameNumber = 0.0;
+	bool bReverse = false;
 	vector<SceneObject*> addedNodes;
+	unordered_map<SceneObject*, int> trackIndex;
+	Timeline timeline;
 
-	// Start and End Position Vectors
-	vector<glm::vec3> nStartPos;
-	vector<glm::vec3> nEndPos;
+	// clip times of the start and end keys
+	static constexpr float startKeyTime = 0.0;
+	static constexpr float endKeyTime = 1.0;
 
-	// Start and End Rotation Vectors
-	vector<glm::vec3> nStartRot;
-	vector<glm::vec3> nEndRot;
+	// keyed span being played
+	float playStart = 0.0;
+	float playEnd = 0.0;
 
-	vector<glm::vec3> deltaPos;
-	vector<glm::vec3> deltaRot;
+	// last sampled pose and the segment cursors of playback
+	vector<TrackSample> samples;
+	vector<TrackCursor> cursors;
+
+	// new tracks key their rotation as quaternions (shortest path, batched slerp)
+	bool bQuatRotation = false;
 
 	/**
 	* Default Constructor
@@ -44,48 +80,54 @@ public:
 	Keyframe(){}
 
 	/**
-	* Helper method to return the index of the object in the SceneObject vector.
+	* Index of the object's track, -1 if it is not animated.
 	*/
-	int getIndex(SceneObject* obj)
+	int getIndex(SceneObject* obj) const
 	{
-		int index = -1;
-		for (int i = 0; i < addedNodes.size(); i++)
+		auto it = trackIndex.find(obj);
+		return (it == trackIndex.end() ? -1 : it->second);
+	}
+
+	/**
+	* Index of the object's track, adding one if the object has none.
+	* A new track is keyed with the object's current values at the start and end
+	* so it holds still until keyed otherwise.
+	*/
+	int getOrAddTrack(SceneObject* obj)
+	{
+		auto inserted = trackIndex.emplace(obj, (int)addedNodes.size());
+		int i = inserted.first->second;
+		if (inserted.second)
 		{
-			if (obj == addedNodes[i])
-			{
-				index = i;
-			}
+			addedNodes.push_back(obj);
+			timeline.addTrack();
+			timeline.tracks[i].bQuatRotation = bQuatRotation;
+			keyObject(i, startKeyTime, obj);
+			keyObject(i, endKeyTime, obj);
 		}
+		return i;
+	}
 
-		return index;
+	/**
+	* Key the object's current position and rotation on track i.
+	* A quaternion track takes the object's orientation as it is, so no angles are lost
+	* in a round trip through euler.
+	*/
+	void keyObject(int i, float time, SceneObject* obj)
+	{
+		AnimTrack &track = timeline.tracks[i];
+		if (track.bQuatRotation) track.setKey(time, obj->position, obj->getOrientation(), InterpEase);
+		else track.setKey(time, obj->position, obj->getRotation(), InterpEase);
 	}
 
 	/**
 	* Method to set the starting values of the inputted object for the keyframe.
-	* 
-	* If the object doesn't exist in the addedNodes vector, 
-	* the object is pushed and the start and end values are the same.
-	* 
-	* If the object is found in the addedNodes vector, 
-	* the position and rotation vectors are set to the position and rotation of the object
+	* The position and rotation of the object are keyed at the start of the clip.
 	*/
 	void setStartValues(SceneObject* obj)
 	{
-		int i = getIndex(obj);
-
-		if (i == -1)
-		{
-			addedNodes.push_back(obj);
-			nStartPos.push_back(obj->position);
-			nStartRot.push_back(obj->rotation);
-			nEndPos.push_back(obj->position);
-			nEndRot.push_back(obj->rotation);
-		}
-		else
-		{
-			nStartPos[i] = obj->position;
-			nStartRot[i] = obj->rotation;
-		}
+		int i = getOrAddTrack(obj);
+		keyObject(i, startKeyTime, obj);
 		cout << obj->name << "'s starting valued saved" << endl;
 	}
 
@@ -95,72 +137,108 @@ public:
 	*/
 	void setEndValues(SceneObject* obj)
 	{
-		int i = getIndex(obj);
+		int i = getOrAddTrack(obj);
+		keyObject(i, endKeyTime, obj);
+		cout << obj->name << "'s ending valued saved" << endl;
+	}
 
-		if (i == -1)
+	/**
+	* Key every object at the given clip time without logging each one.
+	* Used by scripted keying passes over a whole rig.
+	*/
+	void setValues(const vector<SceneObject*>& objs, float time)
+	{
+		trackIndex.reserve(trackIndex.size() + objs.size());
+		for (int i = 0; i < objs.size(); i++) keyObject(getOrAddTrack(objs[i]), time, objs[i]);
+	}
+
+	/**
+	* Remove all nodes and their keys.
+	* Everything indexed by track is reset here together so none of it can go stale.
+	*/
+	void clear()
+	{
+		addedNodes.clear();
+		trackIndex.clear();
+		timeline.clear();
+		samples.clear();
+		cursors.clear();
+	}
+
+	/**
+	* Replace every track with the ones of a loaded clip, track i of clip animating nodes[i].
+	* Tracks whose node is NULL are dropped.
+	*/
+	void setClip(const Timeline &clip, const vector<SceneObject*>& nodes)
+	{
+		clear();
+		for (int i = 0; i < clip.size(); i++)
 		{
-			addedNodes.push_back(obj);
-			nStartPos.push_back(obj->position);
-			nStartRot.push_back(obj->rotation);
-			nEndPos.push_back(obj->position);
-			nEndRot.push_back(obj->rotation);
+			if (nodes[i] == NULL || !trackIndex.emplace(nodes[i], (int)addedNodes.size()).second) continue;
+			addedNodes.push_back(nodes[i]);
+			timeline.tracks.push_back(clip.tracks[i]);
 		}
-		else
+		timeline.bSlerp = clip.bSlerp;
+	}
+
+	/**
+	* Set every animated node to its value at clip time t.
+	* Playback passes the cursors along so stepping forward stays O(1) per channel.
+	*/
+	void apply(float t, bool bUseCursors = true)
+	{
+		if (bUseCursors) timeline.sample(t, samples, cursors);
+		else timeline.sample(t, samples);
+		for (int i = 0; i < addedNodes.size(); i++)
 		{
-			nEndPos[i] = obj->position;
-			nEndRot[i] = obj->rotation;
+			addedNodes[i]->setLocalPosition(samples[i].position);
+			if (timeline.tracks[i].bQuatRotation) addedNodes[i]->setOrientation(samples[i].orientation);
+			else addedNodes[i]->setRotation(samples[i].rotation);
 		}
-		cout << obj->name << "'s ending valued saved" << endl;
 	}
 
 	/**
-	* Method to reset the position and set the delta values.
+	* Jump to a point of the keyed span, 0 is the start and 1 the end.
+	*/
+	void seek(float u)
+	{
+		apply(glm::mix(timeline.startTime(), timeline.endTime(), glm::clamp(u, 0.0f, 1.0f)), false);
+	}
+
+	/**
+	* Position of the playback in the keyed span, 0 to 1.
 	*/
-	void setTheStage(bool rev, float second = 0.5)
+	float getProgress() const
+	{
+		float u = std::min(frameNumber / (frameRate * duration), 1.0f);
+		return bReverse ? 1 - u : u;
+	}
+
+	/**
+	* Method to reset the position to the first frame of the playback.
+	*/
+	void setTheStage(bool rev, float second = 1.0)
 	{
 		duration = second;
 		frameNumber = 0.0;
-		deltaPos.clear();
-		deltaRot.clear();
-
-		// play foreward
-		if (!rev)
-		{
-			for (int i = 0; i < addedNodes.size(); i++)
-			{
-				addedNodes[i]->position = nStartPos[i];
-				addedNodes[i]->rotation = nStartRot[i];
-				deltaPos.push_back((nEndPos[i] - nStartPos[i]) / (frameRate * duration));
-				deltaRot.push_back((nEndRot[i] - nStartRot[i]) / (frameRate * duration));
-			}
-		}
-		else // play in reverse
-		{
-			for (int i = 0; i < addedNodes.size(); i++)
-			{
-				addedNodes[i]->position = nEndPos[i];
-				addedNodes[i]->rotation = nEndRot[i];
-				deltaPos.push_back((nStartPos[i] - nEndPos[i]) / (frameRate * duration));
-				deltaRot.push_back((nStartRot[i] - nEndRot[i]) / (frameRate * duration));
-			}
-		}
+		bReverse = rev;
+		playStart = timeline.startTime();
+		playEnd = timeline.endTime();
+		apply(rev ? playEnd : playStart);
 	}
 
 	/**
 	* Play the keyframe animation.
 	* Return false on completion. (the animation is done and is not playing anymore)
-	* Sinusoidal Interpolation function from http://gizma.com/easing/#sin3
+	* Each frame the clip is evaluated at the matching time, so the last frame lands
+	* exactly on the final keys.
 	*/
 	bool playback()
 	{
-		float cosFunc = (glm::cos(PI * frameNumber / (frameRate * duration)) - 1);
-		for (int d = 0; d < addedNodes.size(); d++)
-		{
-			addedNodes[d]->position += -deltaPos[d] / 2.0 * cosFunc;
-			addedNodes[d]->rotation += -deltaRot[d] / 2.0 * cosFunc;
-		}
+		TRACE_ZONE("Keyframe::playback");
 		frameNumber++;
-		return frameNumber < (frameRate * duration * 2);
+		apply(glm::mix(playStart, playEnd, getProgress()));
+		return frameNumber < frameRate * duration;
 	}
 };
 
@@ -170,6 +248,7 @@ class ofApp : public ofBaseApp{
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed(int key);
 		void keyReleased(int key);
@@ -193,18 +272,70 @@ class ofApp : public ofBaseApp{
 		void printFamily(SceneObject *);
 		void saveToFile();
 		void loadFromFile();
+		void clearAnimation();
+		Joint *newJoint(glm::vec3 p);
+		void clearScene();
 
 		// Keyframe
 		Keyframe animation;
 
+		// flat pose of the skeleton, evaluated in one pass while playing.
+		// rebuilt whenever joints are created, removed or loaded
+		ScenePose skeletonPose;
+		bool bPoseDirty = true;
+
+		// world space BVH used for selection, rebuilt on the same events
+		ScenePicker picker;
+		bool bPickerDirty = true;
+
+		// the joints (scene[1] on) drawn as one batch, see SkeletonBatch.h.
+		// Their parents are looked up again on the same events
+		SkeletonBatch skeletonBatch;
+		SkeletonRenderer skeletonRenderer;
+		vector<int> batchParents;
+		vector<glm::mat4> batchWorld;
+		vector<glm::vec3> batchTranslations;
+		vector<float> batchRadii;
+		vector<glm::vec4> batchColors;
+		bool bBatchDirty = true;
+		void drawSkeleton();
+
 		// models
 		vector<Mesh> models;
 		vector<SceneObject*> mods;
+
+		// OBJ files still being loaded on a worker thread
+		struct PendingModel {
+			string name;
+			PoolHandle joint;                // dropped if the joint is gone when it's done
+			std::future<ModelSource> result;
+		};
+		vector<PendingModel> pendingModels;
+		vector<std::future<ModelSource>> abandonedModels;   // dropped by clearAnimation(), released once done
+		void addModel(Model model, string name, SceneObject *joint);
+		void finishPendingModels();
+		void skinModels(SceneObject *joint);
+		void toggleDualQuaternion(SceneObject *joint);
+		void benchmarkSkinning();
 		bool bModelLoaded = false;
 
 		// Gui
 		ofxPanel gui;
 		ofxFloatSlider dur;
+		ofxFloatSlider scrub;
+		float lastScrub = 0;
+		ofxToggle quatKeys;
+		ofxToggle geodesicWeights;
+		ofxToggle meshLod;
+
+		// Tracing, one label per zone seen so far
+		ofxToggle traceZones;
+		std::deque<ofxLabel> traceLabels;
+		unordered_map<string, int> traceLabelIndex;
+		float lastTraceStats = 0;
+		string tracePath;
+		void updateTraceStats();
+		void dumpTrace();
 		
 		// File
 		//
@@ -230,6 +361,12 @@ class ofApp : public ofBaseApp{
 		//
 		vector<SceneObject *> scene;
 		vector<SceneObject *> selected;
+
+		// the joints come from the pool and the ground is part of the app, so
+		// clearing the scene hands the joints back at once instead of leaking
+		// them (see ObjectPool.h)
+		ObjectPool<Joint> jointPool;
+		Plane ground = Plane(glm::vec3(0, -2, 0), glm::vec3(0, 1, 0));
 		ofPlanePrimitive plane;
 
 		// Addtional Parameters